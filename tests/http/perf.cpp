@@ -0,0 +1,228 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+// Performance test measuring heap allocations and throughput of small HTTP
+// requests, comparing the HTTP engines under load
+
+#define BOOST_TEST_MODULE http_perf
+
+#include <zeroeq/defines.h>
+#include <zeroeq/http/helpers.h>
+#include <zeroeq/http/server.h>
+#include <zeroeq/uri.h>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+using std::chrono::duration_cast;
+using std::chrono::high_resolution_clock;
+using std::chrono::microseconds;
+
+namespace
+{
+std::atomic<size_t> allocations{0};
+
+const float TIMEOUT = 100.f; // milliseconds
+const size_t warmupRequests = 100;
+const size_t numRequests = 2000;
+}
+
+// count all heap allocations of the process, including the ones of the HTTP
+// server thread
+void* operator new(const size_t size)
+{
+    ++allocations;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+BOOST_AUTO_TEST_CASE(ready_response)
+{
+    for (size_t i = 0; i < warmupRequests; ++i)
+        zeroeq::http::make_ready_response(zeroeq::http::Code::OK).get();
+
+    // Boost.Test may allocate, check once done
+    bool valid = true;
+    const size_t before = allocations;
+    for (size_t i = 0; i < numRequests; ++i)
+    {
+        auto response =
+            zeroeq::http::make_ready_response(zeroeq::http::Code::OK, "ok");
+        valid = valid && response.get().body == "ok";
+    }
+    const float perResponse =
+        float(allocations - before) / float(numRequests);
+    BOOST_CHECK(valid);
+
+    std::cout << "make_ready_response: " << perResponse
+              << " allocations/response" << std::endl;
+    BOOST_CHECK_EQUAL(perResponse, 0.f);
+}
+
+namespace
+{
+namespace asio = boost::asio;
+
+const size_t numClients = 4;
+const std::string getRequest("GET /tiny HTTP/1.1\r\nHost: zeroeq\r\n\r\n");
+const std::string closeRequest(
+    "GET /tiny HTTP/1.1\r\nHost: zeroeq\r\nConnection: close\r\n\r\n");
+
+// A server answering GET /tiny on the given engine, see ZEROEQ_HTTP_ENGINE,
+// with the clients sending requests to it.
+class Benchmark
+{
+public:
+    explicit Benchmark(const char* engine)
+        : _server(_createServer(engine))
+        , _thread([this] {
+            while (_running)
+                _server->receive(TIMEOUT);
+        })
+    {
+        asio::io_service io;
+        const auto& uri = _server->getURI();
+        asio::ip::tcp::resolver resolver(io);
+        _endpoint = (*resolver.resolve(
+                         {uri.getHost(), std::to_string(int(uri.getPort()))}))
+                        .endpoint();
+    }
+
+    ~Benchmark()
+    {
+        _running = false;
+        _thread.join();
+    }
+
+    // GET on a new connection, which the server closes after the response
+    void get(asio::io_service& io) const
+    {
+        asio::ip::tcp::socket socket(io);
+        socket.connect(_endpoint);
+        asio::write(socket, asio::buffer(closeRequest));
+
+        char buffer[4096];
+        boost::system::error_code error;
+        while (!error)
+            socket.read_some(asio::buffer(buffer), error);
+    }
+
+    // @return the requests/s of several clients sending requests at once, on
+    //         new or on keep-alive connections
+    float load(const bool keepAlive) const
+    {
+        const size_t perClient = numRequests / numClients;
+        std::vector<std::thread> clients;
+        const auto startTime = high_resolution_clock::now();
+        for (size_t i = 0; i < numClients; ++i)
+        {
+            clients.emplace_back([this, keepAlive, perClient] {
+                asio::io_service io;
+                if (!keepAlive)
+                {
+                    for (size_t j = 0; j < perClient; ++j)
+                        get(io);
+                    return;
+                }
+
+                asio::ip::tcp::socket socket(io);
+                socket.connect(_endpoint);
+                asio::streambuf buffer;
+                for (size_t j = 0; j < perClient; ++j)
+                {
+                    asio::write(socket, asio::buffer(getRequest));
+                    // the "ok" body ends each response
+                    buffer.consume(
+                        asio::read_until(socket, buffer, "\r\n\r\nok"));
+                }
+            });
+        }
+        for (auto& client : clients)
+            client.join();
+        const auto endTime = high_resolution_clock::now();
+
+        const float seconds =
+            float(duration_cast<microseconds>(endTime - startTime).count()) /
+            1000000.f;
+        return float(perClient * numClients) / seconds;
+    }
+
+private:
+    std::unique_ptr<zeroeq::http::Server> _server;
+    std::atomic<bool> _running{true};
+    std::thread _thread;
+    asio::ip::tcp::endpoint _endpoint;
+
+    static zeroeq::http::Server* _createServer(const char* engine)
+    {
+#ifdef ZEROEQ_USE_EPOLL
+        if (engine)
+            ::setenv("ZEROEQ_HTTP_ENGINE", engine, 1);
+#endif
+        auto server = new zeroeq::http::Server;
+#ifdef ZEROEQ_USE_EPOLL
+        ::unsetenv("ZEROEQ_HTTP_ENGINE");
+#endif
+        server->handle(zeroeq::http::Method::GET, "tiny",
+                       [](const zeroeq::http::Request&) {
+                           return zeroeq::http::make_ready_response(
+                               zeroeq::http::Code::OK, "ok");
+                       });
+        server->setIOThreads(numClients);
+        return server;
+    }
+};
+}
+
+BOOST_AUTO_TEST_CASE(get_request)
+{
+    const Benchmark benchmark(nullptr);
+    asio::io_service io;
+    for (size_t i = 0; i < warmupRequests; ++i)
+        benchmark.get(io);
+
+    const size_t before = allocations;
+    const auto startTime = high_resolution_clock::now();
+    for (size_t i = 0; i < numRequests; ++i)
+        benchmark.get(io);
+    const auto endTime = high_resolution_clock::now();
+    const size_t count = allocations - before;
+
+    const float seconds =
+        float(duration_cast<microseconds>(endTime - startTime).count()) /
+        1000000.f;
+    std::cout << "HTTP GET: " << float(count) / float(numRequests)
+              << " allocations/request (client and server), "
+              << float(numRequests) / seconds << " requests/s" << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(get_load)
+{
+    {
+        const Benchmark cppnetlib(nullptr);
+        std::cout << "HTTP GET load, cppnetlib: " << cppnetlib.load(false)
+                  << " requests/s" << std::endl;
+    }
+#ifdef ZEROEQ_USE_EPOLL
+    const Benchmark epoll("epoll");
+    std::cout << "HTTP GET load, epoll: " << epoll.load(false)
+              << " requests/s, keep-alive: " << epoll.load(true)
+              << " requests/s" << std::endl;
+#endif
+}
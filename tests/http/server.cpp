@@ -8,6 +8,7 @@
 
 #define BOOST_TEST_MODULE http_server
 
+#include <zeroeq/http/executor.h>
 #include <zeroeq/http/helpers.h>
 #include <zeroeq/http/request.h>
 #include <zeroeq/http/response.h>
@@ -16,10 +17,21 @@
 
 #include <servus/serializable.h>
 
+#include <boost/asio.hpp>
 #include <boost/network/protocol/http/client.hpp>
 #include <boost/test/unit_test.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
 #include <map>
 #include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h> // getpid
+#endif
 
 static const float TIMEOUT = 100.f; // milliseconds
 
@@ -59,6 +71,18 @@ Response _buildResponse(const std::string& body = std::string())
     return {ServerReponse::ok, body, {{"Content-Type", "application/json"}}};
 }
 
+// the response to a GET request of a Serializable object depends on the Accept
+// request header and carries the version of the object
+Response _buildObjectResponse(const std::string& body,
+                              const std::string& version = "0")
+{
+    return {ServerReponse::ok,
+            body,
+            {{"Content-Type", "application/json"},
+             {"ETag", "\"" + version + "\""},
+             {"Vary", "Accept"}}};
+}
+
 const auto echoFunc = [](const zeroeq::http::Request& request) {
     auto body = request.path;
 
@@ -86,6 +110,8 @@ Response error500(const std::string& body)
 
 const std::string jsonGet("Not JSON, just want to see that the is data a-ok");
 const std::string jsonPut("See what my stepbrother jsonGet says");
+const std::string binaryGet("Binary jsonGet, skipping the JSON step");
+const std::string binaryPut("Binary jsonPut, skipping the JSON step");
 
 class Foo : public servus::Serializable
 {
@@ -107,6 +133,18 @@ private:
 
     bool _fromJSON(const std::string& json) final { return jsonPut == json; }
     std::string _toJSON() const final { return jsonGet; }
+    bool _fromBinary(const void* data, const size_t size) final
+    {
+        return binaryPut == std::string(static_cast<const char*>(data), size);
+    }
+    Data _toBinary() const final
+    {
+        Data data;
+        data.ptr =
+            std::shared_ptr<const void>(binaryGet.data(), [](const void*) {});
+        data.size = binaryGet.size();
+        return data;
+    }
     bool _notified;
 };
 
@@ -167,6 +205,20 @@ public:
         get(request_);
     }
 
+    std::map<std::string, std::string> getHeaders(
+        const std::string& request,
+        const std::map<std::string, std::string>& requestHeaders)
+    {
+        HTTPClient::request request_(_baseURL + request);
+        for (const auto& h : requestHeaders)
+            request_ << boost::network::header(h.first, h.second);
+
+        std::map<std::string, std::string> responseHeaders;
+        for (const auto& header : headers(get(request_)))
+            responseHeaders.insert(header);
+        return responseHeaders;
+    }
+
 private:
     std::string _baseURL;
 
@@ -268,8 +320,17 @@ private:
                                 std::to_string(status(response)) + " != " +
                                 std::to_string(int(expected.status)));
 
-        std::map<std::string, std::string> expectedHeaders{
-            {"Content-Length", std::to_string(expected.body.size())}};
+        // 304 responses don't announce the size of the unchanged resource
+        std::map<std::string, std::string> expectedHeaders;
+        if (expected.status != ServerReponse::status_type(304))
+            expectedHeaders.insert(
+                {"Content-Length", std::to_string(expected.body.size())});
+        // complete GET responses advertise the support of range requests
+        if (method == zeroeq::http::Method::GET &&
+            expected.status == ServerReponse::ok && !expected.body.empty())
+        {
+            expectedHeaders.insert({"Accept-Ranges", "bytes"});
+        }
         for (const auto& header : expected.additionalHeaders)
             expectedHeaders.insert(header);
 
@@ -467,7 +528,7 @@ BOOST_AUTO_TEST_CASE(get_serializable)
     client.checkGET("/unknown", error404, __LINE__);
     BOOST_CHECK(!foo.getNotified());
 
-    client.checkGET("/test/foo", _buildResponse(jsonGet), __LINE__);
+    client.checkGET("/test/foo", _buildObjectResponse(jsonGet), __LINE__);
     BOOST_CHECK(foo.getNotified());
 
     running = false;
@@ -525,7 +586,7 @@ BOOST_AUTO_TEST_CASE(shared)
     Client client2(server2.getURI());
 
     client1.checkGET("/test/foo", error404, __LINE__);
-    client2.checkGET("/test/foo", _buildResponse(jsonGet), __LINE__);
+    client2.checkGET("/test/foo", _buildObjectResponse(jsonGet), __LINE__);
 
     running = false;
     thread.join();
@@ -558,6 +619,157 @@ BOOST_AUTO_TEST_CASE(put_serializable)
     thread.join();
 }
 
+// Serializable keeping its JSON as is, to test partial updates
+class JSONObject : public servus::Serializable
+{
+public:
+    explicit JSONObject(const std::string& json)
+        : _json(json)
+    {
+    }
+    const std::string& getJSON() const { return _json; }
+
+private:
+    std::string getTypeName() const final { return "test::JSONObject"; }
+    virtual zeroeq::uint128_t getTypeIdentifier() const final
+    {
+        return servus::make_uint128(getTypeName());
+    }
+
+    bool _fromJSON(const std::string& json) final
+    {
+        _json = json;
+        return true;
+    }
+    std::string _toJSON() const final { return _json; }
+    bool _fromBinary(const void*, const size_t) final { return false; }
+    Data _toBinary() const final { return Data(); }
+    std::string _json;
+};
+
+BOOST_AUTO_TEST_CASE(patch_serializable)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    JSONObject camera(R"({"fov":45,"name":"main","position":{"x":1,"y":0}})");
+    bool notified = false;
+    camera.registerDeserializedCallback([&] { notified = true; });
+    BOOST_CHECK(server.handle("camera", camera));
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    using Method = zeroeq::http::Method;
+    Client client(server.getURI());
+    client.check(Method::PATCH, "/camera", "Not JSON", error400, __LINE__);
+    BOOST_CHECK(!notified);
+
+    client.check(Method::PATCH, "/camera",
+                 R"({"fov":60,"name":null,"position":{"y":2}})",
+                 response200, __LINE__);
+    BOOST_CHECK(notified);
+    BOOST_CHECK_EQUAL(camera.getJSON(),
+                      "{\"fov\":60,\"position\":{\"x\":1,\"y\":2}}\n");
+
+    // non-object patches replace the member
+    client.check(Method::PATCH, "/camera", R"({"position":[0,1]})",
+                 response200, __LINE__);
+    BOOST_CHECK_EQUAL(camera.getJSON(), "{\"fov\":60,\"position\":[0,1]}\n");
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(binary_serializable)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    Foo foo;
+    server.handle(foo);
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    using Method = zeroeq::http::Method;
+    Client client(server.getURI());
+
+    const std::string binaryType("application/octet-stream");
+    const Response binaryResponse{ServerReponse::ok,
+                                  binaryGet,
+                                  {{"Content-Type", binaryType},
+                                   {"ETag", "\"0-binary\""},
+                                   {"Vary", "Accept"}}};
+    client.check(Method::GET, "/test/foo", "", binaryResponse, __LINE__,
+                 {{"Accept", binaryType}});
+    client.check(Method::GET, "/test/foo", "", binaryResponse, __LINE__,
+                 {{"Accept", binaryType + ", */*;q=0.8"}});
+    client.check(Method::GET, "/test/foo", "", _buildObjectResponse(jsonGet),
+                 __LINE__,
+                 {{"Accept", "application/json, " + binaryType + ";q=0.5"}});
+    client.check(Method::GET, "/test/foo", "", _buildObjectResponse(jsonGet),
+                 __LINE__, {{"Accept", "*/*"}});
+
+    const std::map<std::string, std::string> binaryPayload{
+        {"Content-Type", binaryType}};
+    client.check(Method::PUT, "/test/foo", binaryPut, response200, __LINE__,
+                 binaryPayload);
+    client.check(Method::PUT, "/test/foo", jsonPut, error400, __LINE__,
+                 binaryPayload);
+    client.checkPUT("/test/foo", binaryPut, error400, __LINE__);
+    client.checkPUT("/test/foo", jsonPut, response200, __LINE__);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(request_body_limits)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    server.setMaxBodySize(jsonPut.size());
+    server.setBodySpillSize(16);
+
+    Foo foo;
+    server.handlePUT(foo);
+
+    bool spilled = false;
+    server.handle(zeroeq::http::Method::POST, "upload",
+                  [&](const zeroeq::http::Request& request) {
+                      spilled = request.body.empty();
+                      return zeroeq::http::make_ready_response(
+                          zeroeq::http::Code::OK,
+                          std::string(request.getPayload(),
+                                      request.getPayloadSize()));
+                  });
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    Client client(server.getURI());
+    client.checkPOST("/upload", "small", {ServerReponse::ok, "small"},
+                     __LINE__);
+    BOOST_CHECK(!spilled);
+
+    client.checkPOST("/upload", jsonPut, {ServerReponse::ok, jsonPut},
+                     __LINE__);
+#ifndef _WIN32
+    BOOST_CHECK(spilled);
+#endif
+    client.checkPUT("/test/foo", jsonPut, response200, __LINE__);
+
+    const Response error413{ServerReponse::status_type(413), ""};
+    client.checkPOST("/upload", jsonPut + "!", error413, __LINE__);
+
+    running = false;
+    thread.join();
+}
+
 BOOST_AUTO_TEST_CASE(put_event)
 {
     bool running = true;
@@ -596,9 +808,9 @@ BOOST_AUTO_TEST_CASE(post_serializable)
     Foo foo;
     server.handle(foo);
 
-    const Response error405GetPut{ServerReponse::method_not_allowed,
+    const Response error405Allow{ServerReponse::method_not_allowed,
                                   "",
-                                  {{"Allow", "GET, PUT"}}};
+                                  {{"Allow", "GET, PUT, PATCH"}}};
 
     std::thread thread([&]() {
         while (running)
@@ -606,7 +818,7 @@ BOOST_AUTO_TEST_CASE(post_serializable)
     });
 
     Client client(server.getURI());
-    client.checkPOST("/test/foo", jsonPut, error405GetPut, __LINE__);
+    client.checkPOST("/test/foo", jsonPut, error405Allow, __LINE__);
 
     running = false;
     thread.join();
@@ -877,13 +1089,14 @@ BOOST_AUTO_TEST_CASE(cors_preflight_request)
 
     const Response response(ServerReponse::ok, std::string(),
                             {{"Access-Control-Allow-Headers", "Content-Type"},
-                             {"Access-Control-Allow-Methods", "GET, PUT"},
+                             {"Access-Control-Allow-Methods",
+                              "GET, PUT, PATCH"},
                              {"Access-Control-Allow-Origin", "*"}});
     client.checkCORSPreflight(request, "GET", response, __LINE__);
     client.checkCORSPreflight(request, "PUT", response, __LINE__);
+    client.checkCORSPreflight(request, "PATCH", response, __LINE__);
 
     client.checkCORSPreflight(request, "POST", error405, __LINE__);
-    client.checkCORSPreflight(request, "PATCH", error405, __LINE__);
     client.checkCORSPreflight(request, "DELETE", error405, __LINE__);
     client.checkCORSPreflight(request, "OPTIONS", error405, __LINE__);
 
@@ -925,7 +1138,7 @@ BOOST_AUTO_TEST_CASE(cors_request)
 
     using Method = zeroeq::http::Method;
 
-    auto getResp = _buildResponse(jsonGet);
+    auto getResp = _buildObjectResponse(jsonGet);
     getResp.additionalHeaders.insert({"Access-Control-Allow-Origin", "*"});
 
     auto putResp = response200;
@@ -935,17 +1148,15 @@ BOOST_AUTO_TEST_CASE(cors_request)
     client.check(Method::PUT, request, jsonPut, putResp, __LINE__,
                  corsReqHeaders);
 
-    const Response cors405GetPut(ServerReponse::method_not_allowed,
+    const Response cors405Allow(ServerReponse::method_not_allowed,
                                  std::string(),
                                  {{"Access-Control-Allow-Origin", "*"},
-                                  {"Allow", "GET, PUT"}});
-    client.check(Method::POST, request, "", cors405GetPut, __LINE__,
-                 corsReqHeaders);
-    client.check(Method::PATCH, request, "", cors405GetPut, __LINE__,
+                                  {"Allow", "GET, PUT, PATCH"}});
+    client.check(Method::POST, request, "", cors405Allow, __LINE__,
                  corsReqHeaders);
-    client.check(Method::DELETE, request, "", cors405GetPut, __LINE__,
+    client.check(Method::DELETE, request, "", cors405Allow, __LINE__,
                  corsReqHeaders);
-    client.check(Method::OPTIONS, request, "", cors405GetPut, __LINE__,
+    client.check(Method::OPTIONS, request, "", cors405Allow, __LINE__,
                  corsReqHeaders);
 
     running = false;
@@ -966,7 +1177,211 @@ BOOST_AUTO_TEST_CASE(large_get)
 
     Client client(server.getURI());
     const auto request = std::string("/test/foo?") + std::string(4096, 'o');
-    client.checkGET(request, _buildResponse(jsonGet), __LINE__);
+    client.checkGET(request, _buildObjectResponse(jsonGet), __LINE__);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(compression)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    const std::string large(4096, 'z');
+    server.handleGET("large", [&] { return large; });
+    server.handleGET("small", [] { return jsonGet; });
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    Client client(server.getURI());
+    client.checkGET("/small", _buildResponse(jsonGet), __LINE__);
+
+#ifdef ZEROEQ_USE_ZLIB
+    // cppnetlib client only accepts identity encoding by default
+    auto identityResponse = _buildResponse(large);
+    identityResponse.additionalHeaders.insert({"Vary", "Accept-Encoding"});
+    client.checkGET("/large", identityResponse, __LINE__);
+
+    const std::map<std::string, std::string> gzip{{"Accept-Encoding", "gzip"}};
+    auto headers = client.getHeaders("/large", gzip);
+    BOOST_CHECK_EQUAL(headers["Content-Encoding"], "gzip");
+    BOOST_CHECK_EQUAL(headers["Vary"], "Accept-Encoding");
+    const auto compressedSize = std::stoul(headers["Content-Length"]);
+    BOOST_CHECK_LT(compressedSize, large.size());
+
+    // served from cache
+    headers = client.getHeaders("/large", gzip);
+    BOOST_CHECK_EQUAL(headers["Content-Encoding"], "gzip");
+    BOOST_CHECK_EQUAL(std::stoul(headers["Content-Length"]), compressedSize);
+
+    headers = client.getHeaders("/large", {{"Accept-Encoding", "deflate"}});
+    BOOST_CHECK_EQUAL(headers["Content-Encoding"], "deflate");
+
+    headers = client.getHeaders("/small", gzip);
+    BOOST_CHECK_EQUAL(headers.count("Content-Encoding"), 0);
+    BOOST_CHECK_EQUAL(headers.count("Vary"), 0);
+#endif
+
+    server.setCompressionThreshold(0);
+    client.checkGET("/large", _buildResponse(large), __LINE__);
+    const auto uncompressed =
+        client.getHeaders("/large", {{"Accept-Encoding", "gzip"}});
+    BOOST_CHECK_EQUAL(uncompressed.count("Content-Encoding"), 0);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(range_request)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    std::string data;
+    for (size_t i = 0; i < 10; ++i)
+        data.append("0123456789");
+    server.handleGET("data", [&] { return data; });
+    Foo foo;
+    server.handleGET(foo);
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    using Method = zeroeq::http::Method;
+    Client client(server.getURI());
+
+    const auto headers = client.getHeaders("/data", {});
+    BOOST_CHECK_EQUAL(headers.at("Accept-Ranges"), "bytes");
+
+    const auto partialContent = ServerReponse::status_type(206);
+    const auto unsatisfiableRange = ServerReponse::status_type(416);
+    const auto partial = [&](const std::string& body,
+                             const std::string& range) {
+        return Response{partialContent,
+                        body,
+                        {{"Content-Range", range},
+                         {"Content-Type", "application/json"}}};
+    };
+
+    client.check(Method::GET, "/data", "", partial("0123", "bytes 0-3/100"),
+                 __LINE__, {{"Range", "bytes=0-3"}});
+    client.check(Method::GET, "/data", "", partial("56789", "bytes 95-99/100"),
+                 __LINE__, {{"Range", "bytes=95-"}});
+    client.check(Method::GET, "/data", "", partial("789", "bytes 97-99/100"),
+                 __LINE__, {{"Range", "bytes=-3"}});
+    client.check(Method::GET, "/data", "", partial("89", "bytes 98-99/100"),
+                 __LINE__, {{"Range", "bytes=98-1000"}});
+
+    const Response unsatisfiable{unsatisfiableRange,
+                                 "",
+                                 {{"Content-Range", "bytes */100"}}};
+    client.check(Method::GET, "/data", "", unsatisfiable, __LINE__,
+                 {{"Range", "bytes=100-200"}});
+
+    // invalid and multiple ranges are ignored
+    client.check(Method::GET, "/data", "", _buildResponse(data), __LINE__,
+                 {{"Range", "bytes=5-2"}});
+    client.check(Method::GET, "/data", "", _buildResponse(data), __LINE__,
+                 {{"Range", "bytes=0-1,5-6"}});
+    client.check(Method::GET, "/data", "", _buildResponse(data), __LINE__,
+                 {{"Range", "lines=0-1"}});
+
+    // If-Range with the strong ETag of an object, a full response if changed
+    const Response objectPartial{
+        partialContent,
+        jsonGet.substr(0, 4),
+        {{"Content-Range",
+          "bytes 0-3/" + std::to_string(jsonGet.size())},
+         {"Content-Type", "application/json"},
+         {"ETag", "\"0\""},
+         {"Vary", "Accept"}}};
+    client.check(Method::GET, "/test/foo", "", objectPartial, __LINE__,
+                 {{"Range", "bytes=0-3"}, {"If-Range", "\"0\""}});
+    client.check(Method::GET, "/test/foo", "", _buildObjectResponse(jsonGet),
+                 __LINE__, {{"Range", "bytes=0-3"}, {"If-Range", "\"1\""}});
+    client.check(Method::GET, "/test/foo", "", _buildObjectResponse(jsonGet),
+                 __LINE__, {{"Range", "bytes=0-3"}, {"If-Range", "W/\"0\""}});
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(stream_response)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    const size_t numChunks = 16;
+    std::atomic<size_t> produced{0};
+    std::atomic<size_t> calls{0};
+    std::string expected;
+    for (size_t i = 0; i < numChunks; ++i)
+        expected += "chunk " + std::to_string(i) + "\n";
+
+    server.handle(zeroeq::http::Method::GET, "export",
+                  [&](const zeroeq::http::Request&) {
+                      produced = 0;
+                      calls = 0;
+                      zeroeq::http::Response response(zeroeq::http::Code::OK,
+                                                      "", "text/plain");
+                      response.stream = [&](std::string& chunk) {
+                          // nothing to send yet on every other call
+                          if (++calls % 2 == 1)
+                              return true;
+                          chunk = "chunk " + std::to_string(produced) + "\n";
+                          return ++produced < numChunks;
+                      };
+                      return zeroeq::http::make_ready_response(response);
+                  });
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    Client client(server.getURI());
+    const auto headers = client.getHeaders("/export", {});
+    BOOST_CHECK_EQUAL(headers.at("Transfer-Encoding"), "chunked");
+    BOOST_CHECK_EQUAL(headers.at("Content-Type"), "text/plain");
+    BOOST_CHECK_EQUAL(headers.count("Content-Length"), 0);
+    BOOST_CHECK_EQUAL(produced, numChunks);
+
+    namespace asio = boost::asio;
+    asio::io_service io;
+    asio::ip::tcp::socket socket(io);
+    asio::ip::tcp::resolver resolver(io);
+    const auto& uri = server.getURI();
+    asio::connect(socket,
+                  resolver.resolve({uri.getHost(),
+                                    std::to_string(int(uri.getPort()))}));
+    asio::write(socket, asio::buffer(std::string(
+                            "GET /export HTTP/1.1\r\nHost: zeroeq\r\n\r\n")));
+
+    asio::streambuf buffer;
+    asio::read_until(socket, buffer, "\r\n0\r\n\r\n");
+    const std::string received(asio::buffers_begin(buffer.data()),
+                               asio::buffers_end(buffer.data()));
+
+    // the concatenated chunks, without empty ones ending the body early
+    std::string body;
+    size_t pos = received.find("\r\n\r\n");
+    BOOST_REQUIRE(pos != std::string::npos);
+    pos += 4;
+    while (true)
+    {
+        const auto end = received.find("\r\n", pos);
+        BOOST_REQUIRE(end != std::string::npos);
+        const auto size = std::stoul(received.substr(pos, end - pos), nullptr,
+                                     16);
+        if (size == 0)
+            break;
+        body.append(received, end + 2, size);
+        pos = end + 2 + size + 2;
+    }
+    BOOST_CHECK_EQUAL(body, expected);
 
     running = false;
     thread.join();
@@ -1034,7 +1449,7 @@ BOOST_AUTO_TEST_CASE(urlcasesensitivity)
 
     Client client(server.getURI());
     client.checkGET("/TEST/FOO", error404, __LINE__);
-    client.checkGET("/test/foo", _buildResponse(jsonGet), __LINE__);
+    client.checkGET("/test/foo", _buildObjectResponse(jsonGet), __LINE__);
 
     client.checkGET("/BlA/CamelCase", _buildResponse("{}"), __LINE__);
     client.checkGET("/bla/camelcase", error404, __LINE__);
@@ -1080,7 +1495,7 @@ BOOST_AUTO_TEST_CASE(filled_registry)
         R"({
    "all/" : [ "GET", "POST", "PUT", "PATCH", "DELETE", "OPTIONS" ],
    "bla/bar" : [ "PUT" ],
-   "test/foo" : [ "GET", "PUT" ]
+   "test/foo" : [ "GET", "PUT", "PATCH" ]
 }
 )";
     Client client(server.getURI());
@@ -1091,6 +1506,57 @@ BOOST_AUTO_TEST_CASE(filled_registry)
     thread.join();
 }
 
+BOOST_AUTO_TEST_CASE(updated_registry)
+{
+    zeroeq::http::Server server;
+    Foo foo;
+    server.handle(foo);
+
+    bool running = true;
+    const auto receive = [&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    };
+    std::thread thread(receive);
+
+    const char* registry =
+        R"({
+   "test/foo" : [ "GET", "PUT", "PATCH" ]
+}
+)";
+    Client client(server.getURI());
+    client.checkGET("/registry", _buildResponse(registry), __LINE__);
+    running = false;
+    thread.join();
+
+    // the registry and allowed methods follow handle() and remove()
+    server.remove(foo);
+    server.handlePUT("test/foo", [] { return true; });
+    running = true;
+    thread = std::thread(receive);
+
+    registry =
+        R"({
+   "test/foo" : [ "PUT" ]
+}
+)";
+    const Response error405put{ServerReponse::method_not_allowed,
+                               "",
+                               {{"Allow", "PUT"}}};
+    client.checkGET("/registry", _buildResponse(registry), __LINE__);
+    client.checkGET("/test/foo", error405put, __LINE__);
+    running = false;
+    thread.join();
+
+    server.remove("test/foo");
+    running = true;
+    thread = std::thread(receive);
+    client.checkGET("/registry", _buildResponse("{}\n"), __LINE__);
+
+    running = false;
+    thread.join();
+}
+
 BOOST_AUTO_TEST_CASE(object_schema)
 {
     zeroeq::http::Server server;
@@ -1257,7 +1723,7 @@ BOOST_AUTO_TEST_CASE(multiple_event_name_for_same_object)
 
     foo.setNotified(false);
 
-    client.checkGET("/test/foo", _buildResponse(jsonGet), __LINE__);
+    client.checkGET("/test/foo", _buildObjectResponse(jsonGet), __LINE__);
     BOOST_CHECK(foo.getNotified());
 
     const Response error405put{ServerReponse::method_not_allowed,
@@ -1268,3 +1734,1013 @@ BOOST_AUTO_TEST_CASE(multiple_event_name_for_same_object)
     running = false;
     thread.join();
 }
+
+BOOST_AUTO_TEST_CASE(event_stream)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    BOOST_CHECK(server.handleEventStream("events"));
+    BOOST_CHECK(!server.handleEventStream("events"));
+    BOOST_CHECK(!server.pushEvent("unknown", "foo", "bar"));
+
+    zeroeq::Publisher publisher(zeroeq::NULL_SESSION);
+    zeroeq::Subscriber subscriber(zeroeq::URIs{publisher.getURI()}, server);
+    Foo foo;
+    BOOST_CHECK(server.bridgeEvents("events", subscriber, foo));
+    BOOST_CHECK(!server.bridgeEvents("unknown", subscriber, foo));
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    namespace asio = boost::asio;
+    asio::io_service io;
+    asio::ip::tcp::socket socket(io);
+    asio::ip::tcp::resolver resolver(io);
+    const auto& uri = server.getURI();
+    asio::connect(socket,
+                  resolver.resolve({uri.getHost(),
+                                    std::to_string(int(uri.getPort()))}));
+    asio::write(socket, asio::buffer(std::string(
+                            "GET /events HTTP/1.1\r\nHost: zeroeq\r\n\r\n")));
+
+    asio::streambuf buffer;
+    asio::read_until(socket, buffer, ": connected\n\n");
+
+    server.pushEvent("events", "foo", "bar\nbaz");
+    asio::read_until(socket, buffer, "data: baz\n\n");
+
+    // published events arrive once the subscriber is connected
+    for (size_t i = 0; i < 50 && socket.available() == 0; ++i)
+    {
+        publisher.publish(servus::make_uint128("test::Foo"), binaryPut.data(),
+                          binaryPut.size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    asio::read_until(socket, buffer, "data: " + jsonGet + "\n\n");
+
+    const std::string received(asio::buffers_begin(buffer.data()),
+                               asio::buffers_end(buffer.data()));
+    BOOST_CHECK(received.find("Content-Type: text/event-stream") !=
+                std::string::npos);
+    BOOST_CHECK(received.find("event: foo\ndata: bar\ndata: baz\n\n") !=
+                std::string::npos);
+    BOOST_CHECK(received.find("event: test::Foo\n") != std::string::npos);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(web_socket)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    BOOST_CHECK(server.handleWebSocket("ws"));
+    BOOST_CHECK(!server.handleWebSocket("ws"));
+
+    Foo foo;
+    foo.registerDeserializedCallback([&] { foo.setNotified(); });
+    BOOST_CHECK(server.subscribe(foo));
+    BOOST_CHECK(!server.subscribe(foo));
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    Client client(server.getURI());
+    const Response error426{ServerReponse::status_type(426),
+                            "",
+                            {{"Upgrade", "websocket"}}};
+    client.checkGET("/ws", error426, __LINE__);
+
+    // nothing is delivered without a connected client
+    BOOST_CHECK(!server.publish(foo));
+
+    namespace asio = boost::asio;
+    asio::io_service io;
+    asio::ip::tcp::socket socket(io);
+    asio::ip::tcp::resolver resolver(io);
+    const auto& uri = server.getURI();
+    asio::connect(socket,
+                  resolver.resolve({uri.getHost(),
+                                    std::to_string(int(uri.getPort()))}));
+    asio::write(socket,
+                asio::buffer(std::string("GET /ws HTTP/1.1\r\n"
+                                         "Host: zeroeq\r\n"
+                                         "Upgrade: websocket\r\n"
+                                         "Connection: Upgrade\r\n"
+                                         "Sec-WebSocket-Key: "
+                                         "dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                         "Sec-WebSocket-Version: 13\r\n"
+                                         "\r\n")));
+
+    asio::streambuf buffer;
+    const size_t headerSize = asio::read_until(socket, buffer, "\r\n\r\n");
+    const std::string headers(asio::buffers_begin(buffer.data()),
+                              asio::buffers_begin(buffer.data()) + headerSize);
+    buffer.consume(headerSize);
+    BOOST_CHECK_EQUAL(headers.substr(0, 12), "HTTP/1.1 101");
+    BOOST_CHECK(headers.find("Sec-WebSocket-Accept: "
+                             "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") !=
+                std::string::npos);
+
+    // masked client frame: (event, payload)
+    const auto event = servus::make_uint128("test::Foo");
+    std::string message;
+    for (int i = 7; i >= 0; --i)
+        message.push_back(char(event.high() >> (i * 8)));
+    for (int i = 7; i >= 0; --i)
+        message.push_back(char(event.low() >> (i * 8)));
+    message.append(binaryPut);
+
+    const char mask[] = {0x12, 0x34, 0x56, 0x78};
+    std::string frame{char(0x82), char(0x80 | message.size())};
+    frame.append(mask, 4);
+    for (size_t i = 0; i < message.size(); ++i)
+        frame.push_back(message[i] ^ mask[i % 4]);
+    asio::write(socket, asio::buffer(frame));
+
+    for (size_t i = 0; i < 50 && !foo.getNotified(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    BOOST_CHECK(foo.getNotified());
+
+    // unmasked server frame with the published object
+    BOOST_CHECK(server.publish(foo));
+    const size_t expectedSize = 2 + 16 + binaryGet.size();
+    if (buffer.size() < expectedSize)
+        asio::read(socket, buffer,
+                   asio::transfer_at_least(expectedSize - buffer.size()));
+    const std::string received(asio::buffers_begin(buffer.data()),
+                               asio::buffers_end(buffer.data()));
+    BOOST_REQUIRE_EQUAL(received.size(), expectedSize);
+    BOOST_CHECK_EQUAL(uint8_t(received[0]), 0x82);
+    BOOST_CHECK_EQUAL(size_t(received[1]), 16 + binaryGet.size());
+    BOOST_CHECK_EQUAL(received.substr(2, 16), message.substr(0, 16));
+    BOOST_CHECK_EQUAL(received.substr(18), binaryGet);
+
+    running = false;
+    thread.join();
+}
+
+namespace
+{
+class RestrictedServer : public zeroeq::http::Server
+{
+protected:
+    std::future<zeroeq::http::Response> respondTo(
+        zeroeq::http::Request& request) const final
+    {
+        if (request.path == "/private")
+            return zeroeq::http::make_ready_response(
+                zeroeq::http::Code::FORBIDDEN);
+        return Server::respondTo(request);
+    }
+};
+}
+
+BOOST_AUTO_TEST_CASE(web_socket_rejected_by_respond_to)
+{
+    bool running = true;
+    RestrictedServer server;
+    BOOST_CHECK(server.handleWebSocket("private"));
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    namespace asio = boost::asio;
+    asio::io_service io;
+    asio::ip::tcp::socket socket(io);
+    asio::ip::tcp::resolver resolver(io);
+    const auto& uri = server.getURI();
+    asio::connect(socket,
+                  resolver.resolve({uri.getHost(),
+                                    std::to_string(int(uri.getPort()))}));
+    asio::write(socket,
+                asio::buffer(std::string("GET /private HTTP/1.1\r\n"
+                                         "Host: zeroeq\r\n"
+                                         "Upgrade: websocket\r\n"
+                                         "Connection: Upgrade\r\n"
+                                         "Sec-WebSocket-Key: "
+                                         "dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                         "Sec-WebSocket-Version: 13\r\n"
+                                         "\r\n")));
+
+    asio::streambuf buffer;
+    const size_t headerSize = asio::read_until(socket, buffer, "\r\n\r\n");
+    const std::string headers(asio::buffers_begin(buffer.data()),
+                              asio::buffers_begin(buffer.data()) + headerSize);
+    BOOST_CHECK_EQUAL(headers.substr(0, 12), "HTTP/1.1 403");
+    BOOST_CHECK_EQUAL(headers.find("Sec-WebSocket-Accept"), std::string::npos);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(long_poll)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    Foo foo;
+    BOOST_CHECK(server.handle(foo));
+    BOOST_CHECK(!server.notify("unknown"));
+    server.setLongPollTimeout(200);
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    const auto versioned = [](const std::string& version) {
+        return _buildObjectResponse(jsonGet, version);
+    };
+    const Response response304{ServerReponse::status_type(304), ""};
+
+    Client client(server.getURI());
+    client.checkGET("/test/foo?since=one", error400, __LINE__);
+
+    // no newer version until the timeout
+    client.checkGET("/test/foo?since=0", response304, __LINE__);
+
+    // successful PUT requests increment the version
+    client.checkPUT("/test/foo", jsonPut, response200, __LINE__);
+    client.checkGET("/test/foo?since=0", versioned("1"), __LINE__);
+
+    // parked requests are answered by notify()
+    server.setLongPollTimeout(10000);
+    std::thread poll([&] {
+        Client pollClient(server.getURI());
+        pollClient.checkGET("/test/foo?since=1", versioned("2"), __LINE__);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    BOOST_CHECK(server.notify(foo));
+    poll.join();
+
+    // plain GET requests return the current version to wait for
+    client.checkGET("/test/foo", versioned("2"), __LINE__);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(batch)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    Foo foo;
+    BOOST_CHECK(server.handle(foo));
+    BOOST_CHECK_THROW(server.handleGET("batch", [] { return std::string(); }),
+                      std::runtime_error);
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    const std::string batch =
+        "[{\"method\": \"GET\", \"path\": \"/test/foo\"},"
+        " {\"method\": \"PUT\", \"path\": \"test/foo\", \"body\": \"" +
+        jsonPut +
+        "\"},"
+        " {\"method\": \"GET\", \"path\": \"/registry\"},"
+        " {\"method\": \"GET\", \"path\": \"/unknown?bar\"},"
+        " {\"path\": \"/test/foo\"}]";
+    const std::string json = "{\"Content-Type\":\"application/json\"}";
+    const std::string object =
+        "{\"Content-Type\":\"application/json\",\"ETag\":\"\\\"0\\\"\","
+        "\"Vary\":\"Accept\"}";
+    const std::string expected =
+        "[{\"body\":\"" + jsonGet + "\",\"headers\":" + object +
+        ",\"status\":200},"
+        "{\"body\":\"\",\"headers\":{},\"status\":200},"
+        "{\"body\":{\"test/foo\":[\"GET\",\"PUT\",\"PATCH\"]},\"headers\":" +
+        json +
+        ",\"status\":200},"
+        "{\"body\":\"\",\"headers\":{},\"status\":404},"
+        "{\"body\":\"\",\"headers\":{},\"status\":400}]\n";
+
+    Client client(server.getURI());
+    client.checkPOST("/batch", batch, _buildResponse(expected), __LINE__);
+    client.checkPOST("/batch", "{}", error400, __LINE__);
+    client.checkGET("/batch", error404, __LINE__);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(coalesced_get)
+{
+    // coalesced requests still reach respondTo() one by one
+    class CountingServer : public zeroeq::http::Server
+    {
+    public:
+        mutable std::atomic<int> requests{0};
+
+    protected:
+        std::future<zeroeq::http::Response> respondTo(
+            zeroeq::http::Request& request) const final
+        {
+            ++requests;
+            return Server::respondTo(request);
+        }
+    };
+
+    bool running = true;
+    CountingServer server;
+    std::atomic<int> calls{0};
+    const auto slowFunc = [&calls](const zeroeq::http::Request&) {
+        ++calls;
+        return std::async(std::launch::async, [] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            return zeroeq::http::Response(zeroeq::http::Code::OK, "done");
+        });
+    };
+    // answered through a pending response, which completes all requests
+    const auto executor = std::make_shared<zeroeq::http::Executor>();
+    server.handle(zeroeq::http::Method::GET, "slow", slowFunc, executor);
+    server.handle(zeroeq::http::Method::GET, "uncoalesced", slowFunc);
+    server.setCoalescing("slow");
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    const Response expected{ServerReponse::ok, "done"};
+    const auto get = [&](const std::string& request) {
+        Client client(server.getURI());
+        client.checkGET(request, expected, __LINE__);
+    };
+    // the second request arrives while the first one is being answered
+    const auto getTwice = [&](const std::string& request) {
+        std::thread first(get, request);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::thread second(get, request);
+        first.join();
+        second.join();
+    };
+
+    getTwice("/slow");
+    BOOST_CHECK_EQUAL(calls.load(), 1);
+    BOOST_CHECK_EQUAL(server.requests.load(), 2);
+
+    // completed responses are not reused
+    get("/slow");
+    BOOST_CHECK_EQUAL(calls.load(), 2);
+
+    getTwice("/uncoalesced");
+    BOOST_CHECK_EQUAL(calls.load(), 4);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(io_threads)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    server.handleGET("test", [] { return std::string("hello"); });
+    server.setIOThreads(4);
+
+    // each request waits on its I/O thread for its response, which is only
+    // ready once the other request has reached the handler
+    std::atomic<size_t> arrived{0};
+    std::promise<void> bothArrived;
+    const auto rendezvous = bothArrived.get_future().share();
+    server.handle(zeroeq::http::Method::GET, "rendezvous",
+                  [&, rendezvous](const zeroeq::http::Request&) {
+                      if (++arrived == 2)
+                          bothArrived.set_value();
+                      return std::async(std::launch::async, [rendezvous] {
+                          const auto status =
+                              rendezvous.wait_for(std::chrono::seconds(5));
+                          return zeroeq::http::Response(
+                              zeroeq::http::Code::OK,
+                              status == std::future_status::ready ? "met"
+                                                                  : "alone");
+                      });
+                  });
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < 8; ++i)
+        clients.emplace_back([&server] {
+            Client client(server.getURI());
+            for (size_t j = 0; j < 20; ++j)
+                client.checkGET("/test", {ServerReponse::ok, "hello"},
+                                __LINE__);
+        });
+    for (auto& client : clients)
+        client.join();
+
+    std::vector<std::thread> waiters;
+    for (size_t i = 0; i < 2; ++i)
+        waiters.emplace_back([&server] {
+            Client client(server.getURI());
+            client.checkGET("/rendezvous", {ServerReponse::ok, "met"},
+                            __LINE__);
+        });
+    for (auto& client : waiters)
+        client.join();
+    BOOST_CHECK_EQUAL(arrived.load(), 2);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(executor)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    auto executor = std::make_shared<zeroeq::http::Executor>(2);
+    std::promise<std::thread::id> handlerThread;
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    const auto slowFunc = [&, released](const zeroeq::http::Request&) {
+        handlerThread.set_value(std::this_thread::get_id());
+        released.wait_for(std::chrono::seconds(10));
+        return zeroeq::http::make_ready_response(zeroeq::http::Code::OK,
+                                                 "slow");
+    };
+    const auto echoFunc = [](const zeroeq::http::Request& request) {
+        return zeroeq::http::make_ready_response(zeroeq::http::Code::OK,
+                                                 request.body);
+    };
+    const auto throwFunc = [](const zeroeq::http::Request&)
+        -> std::future<zeroeq::http::Response> {
+        throw std::runtime_error("I've had enough!");
+    };
+    BOOST_CHECK(server.handle(zeroeq::http::Method::GET, "slow", slowFunc,
+                              executor));
+    BOOST_CHECK(server.handle(zeroeq::http::Method::POST, "echo", echoFunc,
+                              executor));
+    BOOST_CHECK(server.handle(zeroeq::http::Method::GET, "throw", throwFunc,
+                              executor));
+    BOOST_CHECK(!server.handle(zeroeq::http::Method::GET, "slow", slowFunc,
+                               executor));
+    server.handleGET("fast", [] { return std::string("fast"); });
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    // the fast endpoint is answered while the slow handler runs
+    std::thread slow([&server] {
+        Client client(server.getURI());
+        client.checkGET("/slow", {ServerReponse::ok, "slow"}, __LINE__);
+    });
+    const auto handlerThreadId = handlerThread.get_future().get();
+    BOOST_CHECK(handlerThreadId != thread.get_id());
+
+    Client client(server.getURI());
+    client.checkGET("/fast", {ServerReponse::ok, "fast"}, __LINE__);
+    release.set_value();
+    slow.join();
+
+    client.checkPOST("/echo", "payload", {ServerReponse::ok, "payload"},
+                     __LINE__);
+    client.checkGET("/throw",
+                    error500("Request handler exception: I've had enough!"),
+                    __LINE__);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(metrics)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    server.handleGET("test", [] { return std::string("hello"); });
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    namespace asio = boost::asio;
+    const auto getMetrics = [&server] {
+        asio::io_service io;
+        asio::ip::tcp::socket socket(io);
+        asio::ip::tcp::resolver resolver(io);
+        const auto& uri = server.getURI();
+        asio::connect(socket,
+                      resolver.resolve({uri.getHost(),
+                                        std::to_string(int(uri.getPort()))}));
+        asio::write(socket, asio::buffer(std::string(
+                                "GET /metrics HTTP/1.1\r\n"
+                                "Connection: close\r\n\r\n")));
+        std::string reply;
+        boost::system::error_code error;
+        std::array<char, 1024> buffer;
+        while (!error)
+        {
+            const auto size = socket.read_some(asio::buffer(buffer), error);
+            reply.append(buffer.data(), size);
+        }
+        return reply;
+    };
+
+    BOOST_CHECK_EQUAL(getMetrics().find("HTTP/1.1 404"), 0);
+    server.setMetrics();
+
+    Client client(server.getURI());
+    client.checkGET("/test", _buildResponse("hello"), __LINE__);
+    client.checkGET("/test", _buildResponse("hello"), __LINE__);
+    client.checkGET("/unknown", error404, __LINE__);
+    client.checkPUT("/test", "", {ServerReponse::method_not_allowed,
+                                  "",
+                                  {{"Allow", "GET"}}},
+                    __LINE__);
+
+    const auto metrics = getMetrics();
+    BOOST_CHECK_EQUAL(metrics.find("HTTP/1.1 200"), 0);
+    BOOST_CHECK_NE(metrics.find("text/plain; version=0.0.4"),
+                   std::string::npos);
+    for (const auto& sample :
+         {"zeroeq_http_requests_total{method=\"GET\",endpoint=\"test\","
+          "code=\"200\"} 2\n",
+          "zeroeq_http_requests_total{method=\"GET\",endpoint=\"\","
+          "code=\"404\"} 1\n",
+          "zeroeq_http_requests_total{method=\"PUT\",endpoint=\"test\","
+          "code=\"405\"} 1\n",
+          "zeroeq_http_queue_seconds_count{method=\"GET\",endpoint=\"test\"} "
+          "2\n",
+          "zeroeq_http_handler_seconds_bucket{method=\"GET\",endpoint=\"test\","
+          "le=\"+Inf\"} 2\n",
+          "zeroeq_http_response_body_bytes_sum{method=\"GET\","
+          "endpoint=\"test\"} 10\n",
+          "zeroeq_http_request_body_bytes_count 5\n",
+          "# TYPE zeroeq_http_connections gauge\n"})
+    {
+        BOOST_CHECK_MESSAGE(metrics.find(sample) != std::string::npos,
+                            sample);
+    }
+
+    server.setMetrics(false);
+    BOOST_CHECK_EQUAL(getMetrics().find("HTTP/1.1 404"), 0);
+
+    running = false;
+    thread.join();
+}
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE(serve_directory)
+{
+    char dirTemplate[] = "/tmp/zeroeqXXXXXX";
+    const std::string dir = ::mkdtemp(dirTemplate);
+    const std::string script = "var answer = 42;";
+    std::string large(600000, 'x');
+    for (size_t i = 0; i < large.size(); i += 1000)
+        large[i] = char('a' + (i / 1000) % 26);
+    std::ofstream(dir + "/index.html") << "<html/>";
+    std::ofstream(dir + "/app.js") << script;
+    std::ofstream(dir + "/large.bin") << large;
+
+    bool running = true;
+    zeroeq::http::Server server;
+    BOOST_CHECK(server.serveDirectory("assets", dir));
+    BOOST_CHECK(!server.serveDirectory("assets", dir));
+    server.handleGET("assets/dynamic", [] { return std::string("api"); });
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    using Method = zeroeq::http::Method;
+    Client client(server.getURI());
+    auto headers = client.getHeaders("/assets/app.js", {});
+    const auto etag = headers["ETag"];
+    const auto modified = headers["Last-Modified"];
+    BOOST_CHECK(!etag.empty());
+    BOOST_CHECK_EQUAL(modified.substr(modified.size() - 4), " GMT");
+
+    const Response js{ServerReponse::ok,
+                      script,
+                      {{"Content-Type", "application/javascript"},
+                       {"ETag", etag},
+                       {"Last-Modified", modified}}};
+    client.checkGET("/assets/app.js", js, __LINE__);
+
+    Response corsJs = js;
+    corsJs.additionalHeaders.insert({"Access-Control-Allow-Origin", "*"});
+    client.check(Method::GET, "/assets/app.js", "", corsJs, __LINE__,
+                 {{"Origin", "http://localhost:1234"}});
+
+    headers = client.getHeaders("/assets/", {});
+    BOOST_CHECK_EQUAL(headers["Content-Type"], "text/html");
+
+    // conditional and range requests
+    const Response notModified{ServerReponse::status_type(304),
+                               "",
+                               {{"Content-Type", "application/javascript"},
+                                {"ETag", etag},
+                                {"Last-Modified", modified}}};
+    client.check(Method::GET, "/assets/app.js", "", notModified, __LINE__,
+                 {{"If-None-Match", etag}});
+    client.check(Method::GET, "/assets/app.js", "", notModified, __LINE__,
+                 {{"If-Modified-Since", modified}});
+    headers = client.getHeaders("/assets/app.js", {{"If-None-Match", etag}});
+    BOOST_CHECK_EQUAL(headers.count("Content-Length"), 0);
+
+    const Response partial{ServerReponse::status_type(206),
+                           "answer",
+                           {{"Content-Range", "bytes 4-9/16"},
+                            {"Content-Type", "application/javascript"},
+                            {"ETag", etag},
+                            {"Last-Modified", modified}}};
+    client.check(Method::GET, "/assets/app.js", "", partial, __LINE__,
+                 {{"Range", "bytes=4-9"}});
+    client.check(Method::GET, "/assets/app.js", "", partial, __LINE__,
+                 {{"Range", "bytes=4-9"}, {"If-Range", etag}});
+    client.check(Method::GET, "/assets/app.js", "", partial, __LINE__,
+                 {{"Range", "bytes=4-9"}, {"If-Range", modified}});
+
+    // written in several slices
+    headers = client.getHeaders("/assets/large.bin", {});
+    client.checkGET("/assets/large.bin",
+                    {ServerReponse::ok,
+                     large,
+                     {{"Content-Type", "application/octet-stream"},
+                      {"ETag", headers["ETag"]},
+                      {"Last-Modified", headers["Last-Modified"]}}},
+                    __LINE__);
+
+    // missing files are left to the other endpoints
+    client.checkGET("/assets/dynamic", {ServerReponse::ok, "api"}, __LINE__);
+    client.checkGET("/assets/missing.js", error404, __LINE__);
+    client.checkGET("/assets/../assets/app.js", error404, __LINE__);
+
+    running = false;
+    thread.join();
+
+    BOOST_CHECK(server.remove("assets"));
+    running = true;
+    std::thread removed([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+    client.checkGET("/assets/app.js", error404, __LINE__);
+    running = false;
+    removed.join();
+
+    ::unlink((dir + "/index.html").c_str());
+    ::unlink((dir + "/app.js").c_str());
+    ::unlink((dir + "/large.bin").c_str());
+    ::rmdir(dir.c_str());
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(rate_limit)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    server.handleGET("limited", [] { return std::string("limited"); });
+    server.handleGET("other", [] { return std::string("other"); });
+    server.setRateLimit("limited", 0.01, 2);
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    Client client(server.getURI());
+    const Response limited{ServerReponse::ok, "limited"};
+    const Response other{ServerReponse::ok, "other"};
+    client.checkGET("/limited", limited, __LINE__);
+    client.checkGET("/limited", limited, __LINE__);
+
+    const auto retryAfter = client.getHeaders("/limited", {})["Retry-After"];
+    BOOST_CHECK_GE(std::stoi(retryAfter), 1);
+    const Response unavailable{ServerReponse::service_unavailable,
+                               "",
+                               {{"Retry-After", retryAfter}}};
+    client.checkGET("/limited", unavailable, __LINE__);
+    client.checkGET("/other", other, __LINE__);
+
+    // the limit for all endpoints applies in addition
+    server.setRateLimit(0.01, 1);
+    client.checkGET("/other", other, __LINE__);
+    BOOST_CHECK(!client.getHeaders("/other", {})["Retry-After"].empty());
+    server.setRateLimit(0, 0);
+    client.checkGET("/other", other, __LINE__);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(max_queued_requests)
+{
+    bool running = true;
+    zeroeq::http::Server server;
+    std::promise<void> slowStarted;
+    std::promise<void> release;
+    const auto released = release.get_future().share();
+    server.handle(zeroeq::http::Method::GET, "slow",
+                  [&, released](const zeroeq::http::Request&) {
+                      slowStarted.set_value();
+                      return std::async(std::launch::async, [released] {
+                          released.wait();
+                          return zeroeq::http::Response(zeroeq::http::OK,
+                                                        "slow");
+                      });
+                  });
+    server.handle(zeroeq::http::Method::GET, "throw",
+                  [](const zeroeq::http::Request&) {
+                      return std::async(std::launch::async, [] {
+                          throw std::runtime_error("failed");
+                          return zeroeq::http::Response();
+                      });
+                  });
+    server.handleGET("fast", [] { return std::string("fast"); });
+    server.setIOThreads(2);
+    server.setMaxQueuedRequests(1);
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    // the slow request stays queued on one I/O thread until released
+    std::thread slow([&server] {
+        Client client(server.getURI());
+        client.checkGET("/slow", {ServerReponse::ok, "slow"}, __LINE__);
+    });
+    auto started = slowStarted.get_future();
+    BOOST_REQUIRE(started.wait_for(std::chrono::seconds(10)) ==
+                  std::future_status::ready);
+
+    Client client(server.getURI());
+    const Response unavailable{ServerReponse::service_unavailable,
+                               "",
+                               {{"Retry-After", "1"}}};
+    client.checkGET("/fast", unavailable, __LINE__);
+    release.set_value();
+    slow.join();
+    client.checkGET("/fast", {ServerReponse::ok, "fast"}, __LINE__);
+
+    // failed responses leave the queue as well
+    for (size_t i = 0; i < 2; ++i)
+        client.checkGET("/throw", error500(""), __LINE__);
+    client.checkGET("/fast", {ServerReponse::ok, "fast"}, __LINE__);
+
+    running = false;
+    thread.join();
+}
+
+#ifdef ZEROEQ_USE_EPOLL
+BOOST_AUTO_TEST_CASE(epoll_engine)
+{
+    ::setenv("ZEROEQ_HTTP_ENGINE", "epoll", 1);
+    zeroeq::http::Server server;
+    ::unsetenv("ZEROEQ_HTTP_ENGINE");
+    BOOST_CHECK_NE(server.getURI().getPort(), 0);
+
+    server.handleGET("test", [] { return std::string("hello"); });
+    server.handle(zeroeq::http::Method::PUT, "echo",
+                  [](const zeroeq::http::Request& request) {
+                      return zeroeq::http::make_ready_response(
+                          zeroeq::http::Code::OK, request.body);
+                  });
+    server.setIOThreads(2);
+
+    bool running = true;
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    namespace asio = boost::asio;
+    asio::io_service io;
+    asio::ip::tcp::socket socket(io);
+    asio::ip::tcp::resolver resolver(io);
+    const auto& uri = server.getURI();
+    asio::connect(socket,
+                  resolver.resolve({uri.getHost(),
+                                    std::to_string(int(uri.getPort()))}));
+
+    // pipelined requests on one connection are answered in order, the
+    // connection is kept alive until the client asks to close it
+    asio::write(socket, asio::buffer(std::string(
+                            "GET /test HTTP/1.1\r\nHost: zeroeq\r\n\r\n"
+                            "PUT /echo HTTP/1.1\r\ncontent-length: 4\r\n\r\n"
+                            "body"
+                            "GET /missing HTTP/1.1\r\n\r\n"
+                            "GET /test HTTP/1.1\r\nConnection: close\r\n\r\n"
+                            "GET /ignored HTTP/1.1\r\n\r\n")));
+
+    std::string reply;
+    boost::system::error_code error;
+    std::array<char, 1024> buffer;
+    while (!error)
+    {
+        const auto size = socket.read_some(asio::buffer(buffer), error);
+        reply.append(buffer.data(), size);
+    }
+
+    const auto first = reply.find("HTTP/1.1 200 OK");
+    const auto echo = reply.find("\r\n\r\nbody");
+    const auto missing = reply.find("HTTP/1.1 404 Not Found");
+    const auto closing = reply.find("Connection: close");
+    BOOST_CHECK_EQUAL(first, 0);
+    BOOST_CHECK_NE(reply.find("\r\n\r\nhello"), std::string::npos);
+    BOOST_CHECK(first < echo && echo < missing && missing < closing);
+    BOOST_CHECK_EQUAL(reply.substr(reply.size() - 9), "\r\n\r\nhello");
+    BOOST_CHECK_EQUAL(reply.find("ignored"), std::string::npos);
+
+    const auto stats = server.getConnectionStats();
+    BOOST_CHECK_EQUAL(stats.opened, 1);
+    BOOST_CHECK_EQUAL(stats.reused, 3);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(epoll_engine_busy_receive)
+{
+    ::setenv("ZEROEQ_HTTP_ENGINE", "epoll", 1);
+    zeroeq::http::Server server;
+    ::unsetenv("ZEROEQ_HTTP_ENGINE");
+
+    std::promise<void> blocked;
+    std::promise<void> release;
+    const auto released = release.get_future().share();
+    server.handle(zeroeq::http::Method::GET, "block",
+                  [&, released](const zeroeq::http::Request&) {
+                      blocked.set_value();
+                      released.wait();
+                      return zeroeq::http::make_ready_response(
+                          zeroeq::http::Code::OK, "done");
+                  });
+
+    bool running = true;
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    std::thread blocker([&server] {
+        Client client(server.getURI());
+        client.checkGET("/block", {ServerReponse::ok, "done"}, __LINE__);
+    });
+    auto started = blocked.get_future();
+    BOOST_REQUIRE(started.wait_for(std::chrono::seconds(10)) ==
+                  std::future_status::ready);
+
+    // the only loop still answers other connections while receive() is busy
+    namespace asio = boost::asio;
+    asio::io_service io;
+    asio::ip::tcp::socket socket(io);
+    asio::ip::tcp::resolver resolver(io);
+    const auto& uri = server.getURI();
+    asio::connect(socket,
+                  resolver.resolve({uri.getHost(),
+                                    std::to_string(int(uri.getPort()))}));
+    asio::write(socket, asio::buffer(std::string("garbage\r\n\r\n")));
+
+    std::string reply;
+    boost::system::error_code error;
+    std::array<char, 1024> buffer;
+    while (!error)
+    {
+        const auto size = socket.read_some(asio::buffer(buffer), error);
+        reply.append(buffer.data(), size);
+    }
+    BOOST_CHECK_EQUAL(reply.substr(0, 24), "HTTP/1.1 400 Bad Request");
+
+    release.set_value();
+    blocker.join();
+    running = false;
+    thread.join();
+}
+#endif
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+namespace
+{
+std::string _requestUnix(const std::string& path, const std::string& request)
+{
+    boost::asio::io_service io;
+    boost::asio::local::stream_protocol::socket socket(io);
+    socket.connect(boost::asio::local::stream_protocol::endpoint(path));
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    std::string reply;
+    boost::system::error_code error;
+    std::array<char, 1024> buffer;
+    while (!error)
+    {
+        const auto size = socket.read_some(boost::asio::buffer(buffer), error);
+        reply.append(buffer.data(), size);
+    }
+    return reply;
+}
+}
+
+BOOST_AUTO_TEST_CASE(unix_socket)
+{
+    const std::string path =
+        "/tmp/zeroeq-http-" + std::to_string(::getpid()) + ".sock";
+    bool running = true;
+    zeroeq::http::Server server(zeroeq::URI("unix://" + path));
+    BOOST_CHECK_NE(server.getURI().getPort(), 0);
+
+    server.handleGET("test", [] { return std::string("hello"); });
+    server.handle(zeroeq::http::Method::PUT, "echo",
+                  [](const zeroeq::http::Request& request) {
+                      return zeroeq::http::make_ready_response(
+                          zeroeq::http::Code::OK, request.body);
+                  });
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    const auto get =
+        _requestUnix(path, "GET /test HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    BOOST_CHECK_EQUAL(get.substr(0, 15), "HTTP/1.1 200 OK");
+    BOOST_CHECK_NE(get.find("Content-Length: 5\r\n"), std::string::npos);
+    BOOST_CHECK_EQUAL(get.substr(get.size() - 9), "\r\n\r\nhello");
+
+    const auto put = _requestUnix(path,
+                                  "PUT /echo HTTP/1.1\r\n"
+                                  "content-length: 4\r\n\r\nbody");
+    BOOST_CHECK_EQUAL(put.substr(put.size() - 8), "\r\n\r\nbody");
+
+    const auto missing = _requestUnix(path, "GET /missing HTTP/1.1\r\n\r\n");
+    BOOST_CHECK_EQUAL(missing.substr(0, 22), "HTTP/1.1 404 Not Found");
+
+    const auto invalid = _requestUnix(path, "garbage\r\n\r\n");
+    BOOST_CHECK_EQUAL(invalid.substr(0, 24), "HTTP/1.1 400 Bad Request");
+
+    const auto ambiguous = _requestUnix(path,
+                                        "PUT /echo HTTP/1.1\r\n"
+                                        "content-length: 4\r\n"
+                                        "content-length: 2\r\n\r\nbody");
+    BOOST_CHECK_EQUAL(ambiguous.substr(0, 24), "HTTP/1.1 400 Bad Request");
+
+    // the regular TCP server is still available
+    Client client(server.getURI());
+    client.checkGET("/test", {ServerReponse::ok, "hello"}, __LINE__);
+
+    running = false;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(keep_alive)
+{
+    const std::string path =
+        "/tmp/zeroeq-http-" + std::to_string(::getpid()) + "-keep-alive.sock";
+    bool running = true;
+    zeroeq::http::Server server(zeroeq::URI("unix://" + path));
+    server.handleGET("test", [] { return std::string("hello"); });
+    server.setKeepAlive(200, 3);
+
+    std::thread thread([&]() {
+        while (running)
+            server.receive(TIMEOUT);
+    });
+
+    // pipelined requests are answered in order until the request limit
+    std::string requests;
+    for (size_t i = 0; i < 4; ++i)
+        requests.append("GET /test HTTP/1.1\r\n\r\n");
+    const auto pipelined = _requestUnix(path, requests);
+    size_t responses = 0;
+    for (auto pos = pipelined.find("hello"); pos != std::string::npos;
+         pos = pipelined.find("hello", pos + 1))
+    {
+        ++responses;
+    }
+    BOOST_CHECK_EQUAL(responses, 3);
+    BOOST_CHECK_EQUAL(pipelined.find("Connection: close"),
+                      pipelined.rfind("Connection: "));
+
+    // HTTP/1.0 connections stay open on request until idle
+    const auto start = std::chrono::steady_clock::now();
+    const auto idle = _requestUnix(path,
+                                   "GET /test HTTP/1.0\r\n"
+                                   "Connection: keep-alive\r\n\r\n");
+    BOOST_CHECK_NE(idle.find("Connection: keep-alive"), std::string::npos);
+    BOOST_CHECK(std::chrono::steady_clock::now() - start >=
+                std::chrono::milliseconds(200));
+
+    const auto stats = server.getConnectionStats();
+    BOOST_CHECK_EQUAL(stats.opened, 2);
+    BOOST_CHECK_EQUAL(stats.reused, 2);
+
+    running = false;
+    thread.join();
+}
+#endif
@@ -0,0 +1,197 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#define BOOST_TEST_MODULE zeroeq_metrics
+
+#include "common.h"
+
+#include <thread>
+
+namespace
+{
+const float TIMEOUT = 1000.f; // milliseconds
+const std::string message("The quick brown fox");
+
+zeroeq::Metrics::Event getEvent(const zeroeq::uint128_t& type)
+{
+    const auto snapshot = zeroeq::Metrics::getSnapshot();
+    const auto event = snapshot.find(type);
+    return event ? *event : zeroeq::Metrics::Event();
+}
+}
+
+BOOST_AUTO_TEST_CASE(disabled)
+{
+    const auto type = zeroeq::make_uint128("zeroeq::test::metrics::disabled");
+    BOOST_CHECK(!zeroeq::Metrics::isEnabled());
+
+    zeroeq::Publisher publisher(zeroeq::NULL_SESSION);
+    BOOST_CHECK(publisher.publish(type, message.data(), message.size()));
+    BOOST_CHECK(!zeroeq::Metrics::getSnapshot().find(type));
+}
+
+BOOST_AUTO_TEST_CASE(publish_receive)
+{
+    const auto type = zeroeq::make_uint128("zeroeq::test::metrics::event");
+    zeroeq::Metrics::setEnabled();
+
+    zeroeq::Publisher publisher(zeroeq::NULL_SESSION);
+    zeroeq::Subscriber subscriber(publisher.getURI());
+    BOOST_CHECK(subscriber.subscribe(type, zeroeq::EventPayloadFunc(
+                                               [](const void*, size_t) {})));
+
+    size_t published = 0;
+    for (size_t i = 0; i < 10; ++i)
+    {
+        BOOST_CHECK(publisher.publish(type, message.data(), message.size()));
+        ++published;
+        if (subscriber.receive(100))
+            break;
+    }
+
+    const auto event = getEvent(type);
+    BOOST_CHECK_EQUAL(event.type, type);
+    BOOST_CHECK_EQUAL(event.sent, published);
+    BOOST_CHECK_EQUAL(event.sentBytes, published * message.size());
+    BOOST_CHECK_EQUAL(event.received, 1);
+    BOOST_CHECK_EQUAL(event.receivedBytes, message.size());
+    BOOST_CHECK_EQUAL(event.dropped, 0);
+    BOOST_CHECK_EQUAL(event.handlerTime.count, 1);
+    BOOST_CHECK_EQUAL(event.roundTripTime.count, 0);
+    zeroeq::Metrics::setEnabled(false);
+}
+
+BOOST_AUTO_TEST_CASE(request_reply)
+{
+    const test::Echo request(message);
+    const test::Echo reply("Jumped over the lazy dog");
+    const auto type = test::Echo::IDENTIFIER();
+    const auto before = getEvent(type);
+    zeroeq::Metrics::setEnabled();
+
+    zeroeq::Server server(zeroeq::NULL_SESSION);
+    zeroeq::Client client({server.getURI()});
+    server.handle(type, [&](const void*, size_t) {
+        return zeroeq::ReplyData{type, reply.toBinary()};
+    });
+
+    std::thread thread([&] { server.receive(TIMEOUT); });
+    bool handled = false;
+    BOOST_CHECK(client.request(request, [&](const zeroeq::uint128_t&,
+                                            const void*, size_t) {
+        handled = true;
+    }));
+    BOOST_CHECK(client.receive(TIMEOUT));
+    thread.join();
+    BOOST_CHECK(handled);
+
+    // the client and the server count the request and the reply
+    const auto event = getEvent(type);
+    BOOST_CHECK_EQUAL(event.sent - before.sent, 2);
+    BOOST_CHECK_EQUAL(event.sentBytes - before.sentBytes,
+                      message.size() + reply.getMessage().size());
+    BOOST_CHECK_EQUAL(event.received - before.received, 2);
+    BOOST_CHECK_EQUAL(event.dropped - before.dropped, 0);
+    BOOST_CHECK_EQUAL(event.handlerTime.count - before.handlerTime.count, 1);
+    BOOST_CHECK_EQUAL(event.roundTripTime.count - before.roundTripTime.count,
+                      1);
+    BOOST_CHECK_GE(event.roundTripTime.max, event.handlerTime.max);
+    zeroeq::Metrics::setEnabled(false);
+}
+
+BOOST_AUTO_TEST_CASE(unhandled_request)
+{
+    const auto type = zeroeq::make_uint128("zeroeq::test::metrics::request");
+    zeroeq::Metrics::setEnabled();
+
+    zeroeq::Server server(zeroeq::NULL_SESSION);
+    zeroeq::Client client({server.getURI()});
+
+    std::thread thread([&] { server.receive(TIMEOUT); });
+    BOOST_CHECK(client.request(type, nullptr, 0,
+                               [](const zeroeq::uint128_t&, const void*,
+                                  size_t) {}));
+    BOOST_CHECK(client.receive(TIMEOUT));
+    thread.join();
+
+    const auto event = getEvent(type);
+    BOOST_CHECK_EQUAL(event.sent, 1);
+    BOOST_CHECK_EQUAL(event.received, 1);
+    BOOST_CHECK_EQUAL(event.dropped, 1);
+    BOOST_CHECK_EQUAL(event.handlerTime.count, 0);
+    BOOST_CHECK_EQUAL(event.roundTripTime.count, 1);
+    zeroeq::Metrics::setEnabled(false);
+}
+
+BOOST_AUTO_TEST_CASE(publish_snapshot)
+{
+    zeroeq::Metrics::setEnabled();
+    zeroeq::Publisher publisher(zeroeq::NULL_SESSION);
+    zeroeq::Subscriber subscriber(publisher.getURI());
+
+    std::string json;
+    const auto onSnapshot = [&](const void* data, const size_t size) {
+        json.assign(static_cast<const char*>(data), size);
+    };
+    BOOST_CHECK(subscriber.subscribe(zeroeq::METRICS_EVENT,
+                                     zeroeq::EventPayloadFunc(onSnapshot)));
+
+    // the first snapshot may not contain the counters of the metrics event
+    const std::string type = zeroeq::METRICS_EVENT.getString();
+    for (size_t i = 0; i < 10 && json.find(type) == std::string::npos; ++i)
+    {
+        BOOST_CHECK(zeroeq::Metrics::publish(publisher));
+        subscriber.receive(100);
+    }
+
+    BOOST_CHECK_EQUAL(json.find("{\"events\":[{\"type\":\""), 0);
+    BOOST_CHECK_NE(json.find(type), std::string::npos);
+    BOOST_CHECK_GE(getEvent(zeroeq::METRICS_EVENT).received, 1);
+    zeroeq::Metrics::setEnabled(false);
+}
+
+BOOST_AUTO_TEST_CASE(extended_header)
+{
+    const auto type = zeroeq::make_uint128("zeroeq::test::metrics::extended");
+    const auto other = zeroeq::make_uint128("zeroeq::test::metrics::other");
+    zeroeq::Metrics::setEnabled();
+
+    zeroeq::Publisher publisher(zeroeq::NULL_SESSION);
+    publisher.setExtendedHeader();
+    zeroeq::Subscriber subscriber(publisher.getURI());
+
+    size_t received = 0;
+    const auto onEvent = [&](const void* data, const size_t size) {
+        BOOST_CHECK_EQUAL(std::string(static_cast<const char*>(data), size),
+                          message);
+        ++received;
+    };
+    BOOST_CHECK(subscriber.subscribe(type, zeroeq::EventPayloadFunc(onEvent)));
+
+    for (size_t i = 0; i < 10 && received == 0; ++i)
+    {
+        BOOST_CHECK(publisher.publish(type, message.data(), message.size()));
+        subscriber.receive(100);
+    }
+    BOOST_REQUIRE_GT(received, 0);
+
+    // events of other types don't count as lost
+    BOOST_CHECK(publisher.publish(other));
+    for (size_t i = 0; i < 3; ++i)
+    {
+        BOOST_CHECK(publisher.publish(type, message.data(), message.size()));
+        BOOST_CHECK(subscriber.receive(TIMEOUT));
+    }
+
+    const auto snapshot = zeroeq::Metrics::getSnapshot();
+    const auto source = snapshot.findSource(publisher.getIdentifier());
+    BOOST_REQUIRE(source);
+    BOOST_CHECK_EQUAL(source->received, received);
+    BOOST_CHECK_EQUAL(source->lost, 0);
+    BOOST_CHECK_EQUAL(source->latency.count, received);
+    BOOST_CHECK_LE(source->latency.p50, source->latency.p999);
+    BOOST_CHECK_LE(source->latency.p999, source->latency.max);
+    zeroeq::Metrics::setEnabled(false);
+}
@@ -88,6 +88,7 @@ void runPubSub(const std::string& uri)
 {
     zeroeq::Publisher publisher(zeroeq::URI(uri), zeroeq::NULL_SESSION);
     zeroeq::Subscriber subscriber(publisher.getURI());
+    publisher.setExtendedHeader();
     {
         // establish subscription
         Message message(4096);
@@ -104,7 +105,8 @@ void runPubSub(const std::string& uri)
     }
 
     std::cout << publisher.getURI().getScheme()
-              << " pub-sub: msg size, MB/s, P/s, loss" << std::endl;
+              << " pub-sub: msg size, MB/s, P/s, loss, gaps" << std::endl;
+    uint64_t lost = subscriber.getLostEvents();
     for (size_t i = 1; i <= maxMsgSize; i = i << 1)
     {
         Publisher runner(i);
@@ -146,10 +148,15 @@ void runPubSub(const std::string& uri)
 
         subscriber.unsubscribe(message);
 
+        // the tail of a lost burst is not a gap
+        const uint64_t gaps = subscriber.getLostEvents() - lost;
+        lost += gaps;
+        BOOST_CHECK_LE(gaps, runner.sent - received);
+
         std::cout << size << ", "
                   << float(received * i) / 1024.f / 1024.f / seconds << ", "
-                  << float(received) / seconds << ", " << loss << "%"
-                  << std::endl;
+                  << float(received) / seconds << ", " << loss << "%, "
+                  << gaps << std::endl;
     }
     std::cout << std::endl;
 }
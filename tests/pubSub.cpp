@@ -115,6 +115,65 @@ BOOST_AUTO_TEST_CASE(publish_receive_empty_event)
     BOOST_CHECK(!"reachable");
 }
 
+BOOST_AUTO_TEST_CASE(publish_receive_extended_header)
+{
+    zeroeq::Publisher publisher(zeroeq::NULL_SESSION);
+    zeroeq::Subscriber subscriber(publisher.getURI());
+    publisher.setExtendedHeader();
+
+    test::Echo echo;
+    bool received = false;
+    BOOST_CHECK(subscriber.subscribe(echo));
+    BOOST_CHECK(
+        subscriber.subscribe(zeroeq::make_uint128("Empty"),
+                             zeroeq::EventFunc([&]() { received = true; })));
+
+    for (size_t i = 0; i < 10 && echo.getMessage().empty(); ++i)
+    {
+        BOOST_CHECK(publisher.publish(test::Echo(test::echoMessage)));
+        subscriber.receive(100);
+    }
+    BOOST_CHECK_EQUAL(echo.getMessage(), test::echoMessage);
+
+    BOOST_CHECK(publisher.publish(zeroeq::make_uint128("Empty")));
+    for (size_t i = 0; i < 10 && !received; ++i)
+        subscriber.receive(100);
+    BOOST_CHECK(received);
+}
+
+BOOST_AUTO_TEST_CASE(no_gaps_between_events)
+{
+    const auto type = zeroeq::make_uint128("Gaps");
+    const auto other = zeroeq::make_uint128("Other");
+    zeroeq::Publisher publisher(zeroeq::NULL_SESSION);
+    zeroeq::Subscriber subscriber(publisher.getURI());
+    publisher.setExtendedHeader();
+
+    size_t gaps = 0;
+    subscriber.setGapFunc([&](const zeroeq::uint128_t&,
+                              const zeroeq::uint128_t&, uint64_t) { ++gaps; });
+    size_t received = 0;
+    BOOST_CHECK(subscriber.subscribe(
+        type, zeroeq::EventFunc([&]() { ++received; })));
+
+    for (size_t i = 0; i < 10 && received == 0; ++i)
+    {
+        BOOST_CHECK(publisher.publish(type));
+        subscriber.receive(100);
+    }
+    BOOST_REQUIRE_GT(received, 0);
+
+    // each event has its own sequence, unsubscribed ones are no gap
+    for (size_t i = 0; i < 10; ++i)
+    {
+        BOOST_CHECK(publisher.publish(other));
+        BOOST_CHECK(publisher.publish(type));
+        BOOST_CHECK(subscriber.receive(1000));
+    }
+    BOOST_CHECK_EQUAL(gaps, 0);
+    BOOST_CHECK_EQUAL(subscriber.getLostEvents(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(two_publishers)
 {
     zeroeq::Publisher publisher1(zeroeq::NULL_SESSION);
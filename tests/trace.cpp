@@ -0,0 +1,178 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#define BOOST_TEST_MODULE zeroeq_trace
+
+#include "common.h"
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const std::string traceFile("zeroeq-trace-test.json");
+const std::string message("The quick brown fox");
+
+// Publish a few events from a thread, whose trace events are written when it
+// exits
+void _publishFromThread()
+{
+    std::thread thread([] {
+        const auto type = zeroeq::make_uint128("zeroeq::test::trace");
+        zeroeq::Publisher publisher(zeroeq::NULL_SESSION);
+        for (size_t i = 0; i < 10; ++i)
+            publisher.publish(type, message.data(), message.size());
+    });
+    thread.join();
+}
+
+using Object = std::map<std::string, std::string>;
+
+// Minimal JSON parser for the flat objects of strings and integers written by
+// the tracer
+class Parser
+{
+public:
+    explicit Parser(const std::string& json)
+        : _json(json)
+    {
+    }
+
+    // The JSON array format, the closing ']' and a trailing ',' are optional
+    bool parseEvents(std::vector<Object>& events)
+    {
+        if (!_consume('['))
+            return false;
+        while (true)
+        {
+            _skipSpace();
+            if (_pos == _json.size() || _consume(']'))
+                return _atEnd();
+
+            Object object;
+            if (!_parseObject(object))
+                return false;
+            events.push_back(object);
+
+            _skipSpace();
+            if (_consume(']'))
+                return _atEnd();
+            if (_pos < _json.size() && !_consume(','))
+                return false;
+        }
+    }
+
+private:
+    const std::string& _json;
+    size_t _pos = 0;
+
+    void _skipSpace()
+    {
+        while (_pos < _json.size() && std::isspace(_json[_pos]))
+            ++_pos;
+    }
+
+    bool _consume(const char c)
+    {
+        _skipSpace();
+        if (_pos == _json.size() || _json[_pos] != c)
+            return false;
+        ++_pos;
+        return true;
+    }
+
+    bool _atEnd()
+    {
+        _skipSpace();
+        return _pos == _json.size();
+    }
+
+    bool _parseString(std::string& value)
+    {
+        if (!_consume('"'))
+            return false;
+        const auto end = _json.find('"', _pos);
+        if (end == std::string::npos)
+            return false;
+        value = _json.substr(_pos, end - _pos);
+        if (value.find('\\') != std::string::npos) // no escapes expected
+            return false;
+        _pos = end + 1;
+        return true;
+    }
+
+    bool _parseInteger(std::string& value)
+    {
+        _skipSpace();
+        const auto begin = _pos;
+        if (_pos < _json.size() && _json[_pos] == '-')
+            ++_pos;
+        while (_pos < _json.size() && std::isdigit(_json[_pos]))
+            ++_pos;
+        value = _json.substr(begin, _pos - begin);
+        return !value.empty() && value != "-";
+    }
+
+    bool _parseObject(Object& object)
+    {
+        if (!_consume('{'))
+            return false;
+        do
+        {
+            std::string key;
+            std::string value;
+            if (!_parseString(key) || !_consume(':'))
+                return false;
+            _skipSpace();
+            const bool isString = _pos < _json.size() && _json[_pos] == '"';
+            if (!(isString ? _parseString(value) : _parseInteger(value)))
+                return false;
+            if (!object.insert({key, value}).second)
+                return false;
+        } while (_consume(','));
+        return _consume('}');
+    }
+};
+}
+
+BOOST_AUTO_TEST_CASE(trace_file)
+{
+    std::remove(traceFile.c_str());
+    setenv("ZEROEQ_TRACE_FILE", traceFile.c_str(), 1);
+    _publishFromThread();
+
+    std::ifstream file(traceFile);
+#ifdef ZEROEQ_USE_TRACE
+    BOOST_REQUIRE(file.is_open());
+    std::stringstream json;
+    json << file.rdbuf();
+
+    std::vector<Object> events;
+    BOOST_CHECK_MESSAGE(Parser(json.str()).parseEvents(events), json.str());
+    BOOST_REQUIRE(!events.empty());
+
+    size_t published = 0;
+    for (const auto& event : events)
+    {
+        for (const auto& key : {"name", "cat", "ph", "ts", "dur", "pid", "tid"})
+            BOOST_CHECK_MESSAGE(event.count(key), key);
+        BOOST_CHECK_EQUAL(event.at("ph"), "X");
+        BOOST_CHECK_EQUAL(event.at("cat"), "zeroeq");
+        if (event.at("name") == "publish")
+            ++published;
+    }
+    BOOST_CHECK_EQUAL(published, 10);
+#else
+    // tracing is compiled out, no file is written
+    BOOST_CHECK(!file.is_open());
+#endif
+    file.close();
+    std::remove(traceFile.c_str());
+}
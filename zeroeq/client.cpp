@@ -6,7 +6,9 @@
 #include "client.h"
 
 #include "detail/common.h"
+#include "detail/metrics.h"
 #include "detail/receiver.h"
+#include "detail/trace.h"
 
 #include <servus/servus.h>
 #include <thread>
@@ -72,23 +74,35 @@ public:
     bool request(uint128_t requestID, const void* data, const size_t size,
                  const ReplyFunc& func)
     {
+        ZEROEQ_TRACE("request");
         const bool hasPayload = data && size > 0;
+        detail::EventCounters* counters = _metrics.get(requestID);
         ++_id;
 #ifdef ZEROEQ_BIGENDIAN
         detail::byteswap(requestID); // convert to little endian wire protocol
 #endif
 
-        if (!_send(&_id, sizeof(_id), ZMQ_SNDMORE) ||
-            !_send(nullptr, 0, ZMQ_SNDMORE) || // frame delimiter
-            !_send(&requestID, sizeof(requestID), hasPayload ? ZMQ_SNDMORE : 0))
+        const bool sent =
+            _send(&_id, sizeof(_id), ZMQ_SNDMORE) &&
+            _send(nullptr, 0, ZMQ_SNDMORE) && // frame delimiter
+            _send(&requestID, sizeof(requestID),
+                  hasPayload ? ZMQ_SNDMORE : 0) &&
+            (!hasPayload || _send(data, size, 0));
+        if (!sent)
         {
+            if (counters)
+                counters->countDropped();
             return false;
         }
 
-        if (hasPayload && !_send(data, size, 0))
-            return false;
-
-        _handlers[_id] = func;
+        Request& request = _handlers[_id];
+        request.func = func;
+        request.counters = counters;
+        if (counters)
+        {
+            counters->countSent(hasPayload ? size : 0);
+            request.sent = detail::Clock::now();
+        }
         return true;
     }
 
@@ -112,23 +126,37 @@ public:
             zmq_msg_recv(&msg, socket.socket, 0);
         }
 
+        detail::EventCounters* counters = _metrics.get(replyID);
         auto i = _handlers.find(id);
         if (i == _handlers.cend())
         {
             if (payload)
                 zmq_msg_close(&msg);
+            if (counters)
+                counters->countDropped();
 
             ZEROEQTHROW(std::runtime_error("Got unrequested reply " +
                                            std::to_string(id)));
         }
 
-        if (payload)
+        if (counters)
+            counters->countReceived(payload ? zmq_msg_size(&msg) : 0);
+        if (i->second.counters)
         {
-            i->second(replyID, zmq_msg_data(&msg), zmq_msg_size(&msg));
-            zmq_msg_close(&msg);
+            i->second.counters->roundTripTime.add(detail::Clock::now() -
+                                                  i->second.sent);
         }
-        else
-            i->second(replyID, nullptr, 0);
+
+        {
+            ZEROEQ_TRACE("callback");
+            if (payload)
+                i->second.func(replyID, zmq_msg_data(&msg),
+                               zmq_msg_size(&msg));
+            else
+                i->second.func(replyID, nullptr, 0);
+        }
+        if (payload)
+            zmq_msg_close(&msg);
         _handlers.erase(i);
         return true;
     }
@@ -182,8 +210,17 @@ private:
         return more;
     }
 
+    // A request waiting for its reply
+    struct Request
+    {
+        ReplyFunc func;
+        detail::EventCounters* counters = nullptr; // of the request type
+        detail::Clock::time_point sent;
+    };
+
     zmq::SocketPtr _servers;
-    std::unordered_map<uint64_t, ReplyFunc> _handlers;
+    std::unordered_map<uint64_t, Request> _handlers;
+    detail::MetricsCache _metrics;
     uint64_t _id{0};
 };
 
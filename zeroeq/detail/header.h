@@ -0,0 +1,87 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#pragma once
+
+#include <zeroeq/types.h>
+
+#include "byteswap.h" // after types.h for zeroeq::uint128_t
+
+#include <chrono>
+#include <cstring>
+
+namespace zeroeq
+{
+namespace detail
+{
+/**
+ * The optional extension of the event frame, sent after the event type by
+ * publishers with Publisher::setExtendedHeader(). Subscribers detect it by the
+ * size of the frame; older subscribers only read the event type.
+ */
+struct HeaderExtension
+{
+    uint128_t publisher;   // random identifier of the publisher
+    uint64_t sequence = 0; // per event type of the publisher
+    uint64_t time = 0;     // send time in microseconds since the epoch
+};
+
+const size_t EVENT_HEADER_SIZE = sizeof(uint128_t);
+const size_t EXTENDED_HEADER_SIZE =
+    EVENT_HEADER_SIZE + sizeof(uint128_t) + 2 * sizeof(uint64_t);
+
+/** @return the current time for HeaderExtension::time. */
+inline uint64_t getHeaderTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+/** Write the extension in little endian after the event type of a frame. */
+inline void writeHeaderExtension(HeaderExtension extension, uint8_t* frame)
+{
+#ifdef ZEROEQ_BIGENDIAN
+    byteswap(extension.publisher); // convert to little endian wire protocol
+    byteswap(extension.sequence);
+    byteswap(extension.time);
+#endif
+    uint8_t* data = frame + EVENT_HEADER_SIZE;
+    ::memcpy(data, &extension.publisher, sizeof(extension.publisher));
+    data += sizeof(extension.publisher);
+    ::memcpy(data, &extension.sequence, sizeof(extension.sequence));
+    data += sizeof(extension.sequence);
+    ::memcpy(data, &extension.time, sizeof(extension.time));
+}
+
+/**
+ * Read the extension of an event frame.
+ *
+ * @param frame the data of the event frame
+ * @param size the size of the event frame
+ * @param extension the extension to set
+ * @return true if the frame has an extension, false if not
+ */
+inline bool readHeaderExtension(const uint8_t* frame, const size_t size,
+                                HeaderExtension& extension)
+{
+    if (size < EXTENDED_HEADER_SIZE)
+        return false;
+
+    const uint8_t* data = frame + EVENT_HEADER_SIZE;
+    ::memcpy(&extension.publisher, data, sizeof(extension.publisher));
+    data += sizeof(extension.publisher);
+    ::memcpy(&extension.sequence, data, sizeof(extension.sequence));
+    data += sizeof(extension.sequence);
+    ::memcpy(&extension.time, data, sizeof(extension.time));
+#ifdef ZEROEQ_BIGENDIAN
+    byteswap(extension.publisher); // convert from little endian wire protocol
+    byteswap(extension.sequence);
+    byteswap(extension.time);
+#endif
+    return true;
+}
+}
+}
@@ -0,0 +1,138 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#pragma once
+
+#include <zeroeq/types.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+namespace zeroeq
+{
+namespace detail
+{
+using Clock = std::chrono::steady_clock;
+
+// Durations in microseconds, updated without locking
+struct TimeCounter
+{
+    void add(Clock::duration duration);
+
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> max{0};
+};
+
+// The process-wide counters of one event or request type, see zeroeq::Metrics
+struct EventCounters
+{
+    void countSent(const size_t size)
+    {
+        sent.fetch_add(1, std::memory_order_relaxed);
+        sentBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void countReceived(const size_t size)
+    {
+        received.fetch_add(1, std::memory_order_relaxed);
+        receivedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void countDropped() { dropped.fetch_add(1, std::memory_order_relaxed); }
+
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> sentBytes{0};
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> receivedBytes{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> lost{0};
+    TimeCounter handlerTime;
+    TimeCounter roundTripTime;
+};
+
+// Log-linear histogram of microseconds, updated without locking. Like an HDR
+// histogram, each power of two is split into linear sub-buckets, which bounds
+// the relative error of a recorded value to 1/subBuckets.
+struct LatencyHistogram
+{
+    static const size_t subBucketBits = 3;
+    static const size_t subBuckets = 1 << subBucketBits;
+    static const size_t numBuckets = subBuckets * (65 - subBucketBits);
+
+    void add(uint64_t us);
+
+    /** @return the index of the bucket counting the value */
+    static size_t getBucket(uint64_t value);
+
+    /** @return the smallest value counted in the bucket */
+    static uint64_t getLowest(size_t bucket);
+
+    /** @return the value below which the fraction of values are, or 0 */
+    uint64_t getPercentile(double fraction) const;
+
+    TimeCounter time;
+    std::array<std::atomic<uint64_t>, numBuckets> buckets{};
+};
+
+// The counters of the events received from one publisher which sends extended
+// headers, see zeroeq::Metrics::Source
+struct SourceCounters
+{
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> lost{0};
+    LatencyHistogram latency;
+};
+
+// The counters used by one publisher, subscriber, server or client. Caches the
+// process-wide counters of each type it has seen, and therefore is only used
+// from the thread owning the object.
+class MetricsCache
+{
+public:
+    /** @return the counters of the type, or nullptr if metrics are disabled */
+    EventCounters* get(const uint128_t& type)
+    {
+        if (!isMetricsEnabled())
+            return nullptr;
+
+        const auto i = _counters.find(type);
+        if (i != _counters.end())
+            return i->second;
+        return _counters[type] = &_register(type);
+    }
+
+    /** @return the counters of a publisher, or nullptr if disabled */
+    SourceCounters* getSource(const uint128_t& publisher)
+    {
+        if (!isMetricsEnabled())
+            return nullptr;
+
+        const auto i = _sources.find(publisher);
+        if (i != _sources.end())
+            return i->second;
+        return _sources[publisher] = &_registerSource(publisher);
+    }
+
+    static bool isMetricsEnabled()
+    {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class zeroeq::Metrics;
+    static std::atomic<bool> _enabled;
+
+    std::unordered_map<uint128_t, EventCounters*> _counters;
+    std::unordered_map<uint128_t, SourceCounters*> _sources;
+
+    static EventCounters& _register(const uint128_t& type);
+    static SourceCounters& _registerSource(const uint128_t& publisher);
+};
+}
+}
@@ -8,6 +8,7 @@
 #include "constants.h"
 #include "context.h"
 #include "socket.h"
+#include "trace.h"
 
 #include "../log.h"
 
@@ -70,6 +71,7 @@ public:
             return false;
 
         _updated = false;
+        ZEROEQ_TRACE("browse");
         _servus.browse(0);
         return _updated;
     }
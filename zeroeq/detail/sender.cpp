@@ -111,6 +111,12 @@ void Sender::announce()
                                        result.getString()));
 }
 
+void Sender::setAnnounceValue(const std::string& key,
+                              const std::string& value)
+{
+    _service.set(key, value);
+}
+
 void Sender::addSockets(std::vector<zeroeq::detail::Socket>& entries)
 {
     zeroeq::detail::Socket entry;
@@ -29,6 +29,10 @@ public:
 
     void initURI();
     ZEROEQ_API void announce();
+
+    /** Set an additional key of the zeroconf record, before announce(). */
+    ZEROEQ_API void setAnnounceValue(const std::string& key,
+                                     const std::string& value);
     void addSockets(std::vector<zeroeq::detail::Socket>& entries);
 
     const std::string& getSession() const { return _session; }
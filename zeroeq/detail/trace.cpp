@@ -0,0 +1,168 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "trace.h"
+
+#ifdef ZEROEQ_USE_TRACE
+#include "../log.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace zeroeq
+{
+namespace detail
+{
+namespace
+{
+const size_t traceBufferSize = 16384; // events per thread between writes
+
+struct TraceEvent
+{
+    const char* name;
+    TraceClock::time_point begin;
+    TraceClock::time_point end;
+};
+
+// The trace file shared by all threads, opened on the first write
+class TraceFile
+{
+public:
+    TraceFile()
+        : _pid(getpid())
+    {
+        const char* name = ::getenv("ZEROEQ_TRACE_FILE");
+        _name = name ? name : "zeroeq." + std::to_string(_pid) + ".trace.json";
+    }
+
+    ~TraceFile()
+    {
+        if (_file)
+            ::fclose(_file);
+    }
+
+    // Append events in the JSON array format, which may omit the closing ']'.
+    // The events are formatted without locking, the lock only guards opening
+    // the file and stdio writes the whole buffer at once.
+    void write(const std::vector<TraceEvent>& events, const size_t thread)
+    {
+        std::string output;
+        output.reserve(events.size() * 128);
+        char line[256];
+        for (const auto& event : events)
+        {
+            using std::chrono::duration_cast;
+            using std::chrono::microseconds;
+            const auto begin = duration_cast<microseconds>(
+                event.begin.time_since_epoch());
+            const auto duration =
+                duration_cast<microseconds>(event.end - event.begin);
+            const int size = ::snprintf(
+                line, sizeof(line),
+                "{\"name\":\"%s\",\"cat\":\"zeroeq\",\"ph\":\"X\","
+                "\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%zu},\n",
+                event.name, static_cast<long long>(begin.count()),
+                static_cast<long long>(duration.count()), _pid, thread);
+            if (size > 0 && size_t(size) < sizeof(line))
+                output.append(line, size_t(size));
+        }
+
+        FILE* file = _open();
+        if (!file)
+            return;
+        ::fwrite(output.data(), 1, output.size(), file);
+        ::fflush(file);
+    }
+
+private:
+    const int _pid;
+    std::string _name;
+    std::mutex _mutex;
+    FILE* _file = nullptr;
+    bool _failed = false;
+
+    FILE* _open()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_file || _failed)
+            return _file;
+
+        _file = ::fopen(_name.c_str(), "w");
+        if (!_file)
+        {
+            _failed = true; // warn only once
+            ZEROEQWARN << "Cannot open trace file " << _name << std::endl;
+            return nullptr;
+        }
+        ::fputs("[\n", _file);
+        return _file;
+    }
+};
+
+TraceFile& _getTraceFile()
+{
+    static TraceFile file;
+    return file;
+}
+
+// The events of one thread, only accessed by this thread
+class TraceBuffer
+{
+public:
+    TraceBuffer()
+        : _file(_getTraceFile())
+        , _thread(++_threads)
+    {
+        _events.reserve(traceBufferSize);
+    }
+
+    ~TraceBuffer() { flush(); }
+
+    void add(const TraceEvent& event)
+    {
+        _events.push_back(event);
+        if (_events.size() == traceBufferSize)
+            flush();
+    }
+
+    void flush()
+    {
+        if (_events.empty())
+            return;
+        _file.write(_events, _thread);
+        _events.clear();
+    }
+
+private:
+    static std::atomic<size_t> _threads;
+
+    TraceFile& _file; // constructed before, hence destroyed after this
+    const size_t _thread;
+    std::vector<TraceEvent> _events;
+};
+
+std::atomic<size_t> TraceBuffer::_threads{0};
+}
+
+void addTraceEvent(const char* name, const TraceClock::time_point begin,
+                   const TraceClock::time_point end)
+{
+    static thread_local TraceBuffer buffer;
+    buffer.add({name, begin, end});
+}
+}
+}
+#endif
@@ -0,0 +1,62 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#pragma once
+
+#include <zeroeq/defines.h>
+
+/**
+ * @def ZEROEQ_TRACE(name)
+ * Record the time until the end of the enclosing scope as a complete event in
+ * the Chrome trace event format. The name has to be a string literal.
+ *
+ * Expands to nothing unless built with the ZEROEQ_TRACE CMake option. The
+ * events are collected in a buffer of each thread without locking, and
+ * appended to the file given by the ZEROEQ_TRACE_FILE environment variable,
+ * zeroeq.<pid>.trace.json by default, when the buffer is full or the thread
+ * exits. Load the file in chrome://tracing or https://ui.perfetto.dev.
+ */
+#ifdef ZEROEQ_USE_TRACE
+#include <chrono>
+
+#define ZEROEQ_TRACE_CONCAT2(a, b) a##b
+#define ZEROEQ_TRACE_CONCAT(a, b) ZEROEQ_TRACE_CONCAT2(a, b)
+#define ZEROEQ_TRACE(name)                                                  \
+    const ::zeroeq::detail::TraceScope ZEROEQ_TRACE_CONCAT(_zeroeqTrace, \
+                                                           __LINE__)(name)
+
+namespace zeroeq
+{
+namespace detail
+{
+using TraceClock = std::chrono::steady_clock;
+
+/** Add a complete event to the buffer of the calling thread. */
+void addTraceEvent(const char* name, TraceClock::time_point begin,
+                   TraceClock::time_point end);
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : _name(name)
+        , _begin(TraceClock::now())
+    {
+    }
+
+    ~TraceScope() { addTraceEvent(_name, _begin, TraceClock::now()); }
+
+private:
+    const char* const _name;
+    const TraceClock::time_point _begin;
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+}
+}
+#else
+#define ZEROEQ_TRACE(name)
+#endif
@@ -0,0 +1,295 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "compression.h"
+
+#include <zeroeq/defines.h>
+
+#ifdef ZEROEQ_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+namespace zeroeq
+{
+namespace http
+{
+namespace
+{
+const size_t maxCacheSize = 16 * 1024 * 1024; // compressed bytes
+
+std::string _trim(const std::string& str)
+{
+    const auto begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return std::string();
+    const auto end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+// Parse "coding[;q=value]", return the lowercase coding and its quality
+std::pair<std::string, float> _parseCoding(const std::string& token)
+{
+    const auto separator = token.find(';');
+    auto coding = _trim(token.substr(0, separator));
+    std::transform(coding.begin(), coding.end(), coding.begin(), ::tolower);
+
+    float quality = 1.f;
+    if (separator != std::string::npos)
+    {
+        const auto param = _trim(token.substr(separator + 1));
+        if (param.compare(0, 2, "q=") == 0 || param.compare(0, 2, "Q=") == 0)
+            quality = std::strtof(param.c_str() + 2, nullptr);
+    }
+    return {coding, quality};
+}
+
+#ifdef ZEROEQ_USE_ZLIB
+std::string _deflate(const std::string& data, const int windowBits,
+                     const int flush)
+{
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return std::string();
+    }
+
+    // a sync flush may need a few bytes more than the bound of a finished
+    // stream for its empty stored block
+    std::string compressed;
+    compressed.resize(deflateBound(&stream, uLong(data.size())) + 8);
+
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = uInt(data.size());
+    stream.next_out = (Bytef*)&compressed[0];
+    stream.avail_out = uInt(compressed.size());
+
+    const int result = deflate(&stream, flush);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    if (result != (flush == Z_FINISH ? Z_STREAM_END : Z_OK) ||
+        stream.avail_in != 0)
+    {
+        return std::string();
+    }
+    return compressed;
+}
+#endif
+}
+
+Encoding selectEncoding(const std::string& acceptEncoding)
+{
+    // Missing codings are not acceptable, except identity (RFC 7231, 5.3.4)
+    float gzip = -1.f;
+    float deflate = -1.f;
+    float identity = -1.f;
+    float any = -1.f;
+
+    size_t begin = 0;
+    while (begin <= acceptEncoding.size())
+    {
+        auto end = acceptEncoding.find(',', begin);
+        if (end == std::string::npos)
+            end = acceptEncoding.size();
+
+        const auto coding =
+            _parseCoding(acceptEncoding.substr(begin, end - begin));
+        if (coding.first == "gzip" || coding.first == "x-gzip")
+            gzip = coding.second;
+        else if (coding.first == "deflate")
+            deflate = coding.second;
+        else if (coding.first == "identity")
+            identity = coding.second;
+        else if (coding.first == "*")
+            any = coding.second;
+
+        begin = end + 1;
+    }
+
+    if (gzip < 0.f)
+        gzip = std::max(any, 0.f);
+    if (deflate < 0.f)
+        deflate = std::max(any, 0.f);
+    if (identity < 0.f)
+        identity = any < 0.f ? 1.f : any;
+
+    if (gzip > 0.f && gzip >= deflate && gzip >= identity)
+        return Encoding::gzip;
+    if (deflate > 0.f && deflate >= identity)
+        return Encoding::deflate;
+    return Encoding::identity;
+}
+
+std::string toString(const Encoding encoding)
+{
+    switch (encoding)
+    {
+    case Encoding::gzip:
+        return "gzip";
+    case Encoding::deflate:
+        return "deflate";
+    case Encoding::identity:
+    default:
+        return "identity";
+    }
+}
+
+std::string compress(const std::string& data, const Encoding encoding)
+{
+#ifdef ZEROEQ_USE_ZLIB
+    switch (encoding)
+    {
+    case Encoding::gzip:
+        return _deflate(data, 15 + 16, Z_FINISH); // +16: gzip wrapper
+    case Encoding::deflate:
+        return _deflate(data, 15, Z_FINISH);
+    case Encoding::identity:
+    default:
+        return std::string();
+    }
+#else
+    (void)data;
+    (void)encoding;
+    return std::string();
+#endif
+}
+
+std::string deflateRaw(const std::string& data)
+{
+#ifdef ZEROEQ_USE_ZLIB
+    return _deflate(data, -15, Z_SYNC_FLUSH); // negative: no zlib header
+#else
+    (void)data;
+    return std::string();
+#endif
+}
+
+bool inflateRaw(const std::string& data, const size_t maxSize,
+                std::string& out)
+{
+#ifdef ZEROEQ_USE_ZLIB
+    z_stream stream{};
+    if (inflateInit2(&stream, -15) != Z_OK)
+        return false;
+
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = uInt(data.size());
+
+    out.clear();
+    char buffer[16384];
+    int result = Z_OK;
+    while (result == Z_OK && stream.avail_in > 0)
+    {
+        stream.next_out = (Bytef*)buffer;
+        stream.avail_out = sizeof(buffer);
+        result = inflate(&stream, Z_SYNC_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+        if (maxSize > 0 && out.size() > maxSize)
+            result = Z_BUF_ERROR;
+    }
+    inflateEnd(&stream);
+    return result == Z_OK || result == Z_STREAM_END;
+#else
+    (void)data;
+    (void)maxSize;
+    (void)out;
+    return false;
+#endif
+}
+
+void Compressor::encode(Response& response, const std::string& acceptEncoding,
+                        const std::string& cacheKey)
+{
+#ifdef ZEROEQ_USE_ZLIB
+    const size_t threshold = _threshold;
+    if (threshold == 0 || response.body.size() < threshold ||
+        response.headers.count(Header::CONTENT_ENCODING))
+    {
+        return;
+    }
+
+    // the response depends on Accept-Encoding, even if it is not compressed
+    // for this client
+    auto& vary = response.headers[Header::VARY];
+    vary.append(vary.empty() ? "Accept-Encoding" : ", Accept-Encoding");
+
+    const auto encoding = selectEncoding(acceptEncoding);
+    if (encoding == Encoding::identity)
+        return;
+
+    auto compressed = cacheKey.empty()
+                          ? compress(response.body, encoding)
+                          : _compress(cacheKey, response.body, encoding);
+    if (compressed.empty() || compressed.size() >= response.body.size())
+        return;
+
+    response.body.swap(compressed);
+    response.headers[Header::CONTENT_ENCODING] = toString(encoding);
+
+    // a strong validator must differ from the one of the identity body
+    auto etag = response.headers.find(Header::ETAG);
+    if (etag != response.headers.end() && etag->second.size() > 1 &&
+        etag->second.front() == '"' && etag->second.back() == '"')
+    {
+        etag->second.insert(etag->second.size() - 1, "-" + toString(encoding));
+    }
+#else
+    // no compression available, responses don't vary
+    (void)response;
+    (void)acceptEncoding;
+    (void)cacheKey;
+#endif
+}
+
+std::string Compressor::_compress(const std::string& key,
+                                  const std::string& body,
+                                  const Encoding encoding)
+{
+    const Key entryKey{key, encoding};
+    const size_t hash = std::hash<std::string>()(body);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto i = _entries.find(entryKey);
+        if (i != _entries.end() && i->second.size == body.size() &&
+            i->second.hash == hash)
+        {
+            return i->second.compressed;
+        }
+    }
+
+    // compress without holding the lock, concurrent requests for other
+    // resources shall not wait for this one
+    auto compressed = compress(body, encoding);
+    if (compressed.empty() || compressed.size() > maxCacheSize)
+        return compressed;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto result = _entries.insert({entryKey, Entry()});
+    auto& entry = result.first->second;
+    if (result.second)
+        _insertOrder.push_back(entryKey);
+    else
+        _cacheSize -= entry.compressed.size();
+    entry.size = body.size();
+    entry.hash = hash;
+    entry.compressed = compressed;
+    _cacheSize += compressed.size();
+
+    while (_cacheSize > maxCacheSize)
+    {
+        const auto oldest = _entries.find(_insertOrder.front());
+        _cacheSize -= oldest->second.compressed.size();
+        _entries.erase(oldest);
+        _insertOrder.pop_front();
+    }
+    return compressed;
+}
+}
+}
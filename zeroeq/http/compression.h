@@ -0,0 +1,108 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_COMPRESSION_H
+#define ZEROEQ_HTTP_COMPRESSION_H
+
+#include <zeroeq/http/response.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace zeroeq
+{
+namespace http
+{
+// Content codings supported for response bodies
+enum class Encoding
+{
+    identity,
+    gzip,
+    deflate
+};
+
+/**
+ * @return the preferred supported encoding for the given Accept-Encoding
+ *         request header value, honoring quality values.
+ */
+Encoding selectEncoding(const std::string& acceptEncoding);
+
+/** @return the Content-Encoding token for the given encoding. */
+std::string toString(Encoding encoding);
+
+/**
+ * @return the data compressed using the given encoding, or an empty string if
+ *         the encoding is not available.
+ */
+std::string compress(const std::string& data, Encoding encoding);
+
+/**
+ * @return the data compressed as a raw deflate stream, terminated by a sync
+ *         flush, or an empty string if compression is not available.
+ */
+std::string deflateRaw(const std::string& data);
+
+/**
+ * Decompress a raw deflate stream.
+ *
+ * @param data the compressed data
+ * @param maxSize the maximum size of the decompressed data, 0 for no limit
+ * @param out the decompressed data
+ * @return false on error, if the decompressed data exceeds maxSize or if
+ *         compression is not available.
+ */
+bool inflateRaw(const std::string& data, size_t maxSize, std::string& out);
+
+// Compresses response bodies on the cppnetlib side, and caches the compressed
+// bodies of GET responses up to a total size. Each entry is validated by the
+// size and hash of the uncompressed body, so that a changed resource is
+// recompressed without keeping a copy of it.
+class Compressor
+{
+public:
+    /** Set the minimum body size for compression, 0 disables compression. */
+    void setThreshold(const size_t size) { _threshold = size; }
+
+    size_t getThreshold() const { return _threshold; }
+
+    /**
+     * Compress the body of the response in place if it is large enough and the
+     * client accepts a supported encoding. Sets the Content-Encoding and Vary
+     * headers accordingly, and appends the encoding to a strong ETag.
+     *
+     * @param response the response to encode
+     * @param acceptEncoding the Accept-Encoding header of the request
+     * @param cacheKey the key for caching the compressed body, empty for
+     *                 uncacheable responses
+     */
+    void encode(Response& response, const std::string& acceptEncoding,
+                const std::string& cacheKey);
+
+private:
+    using Key = std::pair<std::string, Encoding>;
+    struct Entry
+    {
+        size_t size; // of the uncompressed body
+        size_t hash; // of the uncompressed body
+        std::string compressed;
+    };
+
+    std::atomic<size_t> _threshold{1024};
+
+    std::mutex _mutex;
+    std::map<Key, Entry> _entries;
+    std::deque<Key> _insertOrder; // for eviction of the oldest entries
+    size_t _cacheSize = 0;        // of all compressed bodies
+
+    std::string _compress(const std::string& key, const std::string& body,
+                          Encoding encoding);
+};
+}
+}
+
+#endif
@@ -0,0 +1,80 @@
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "dispatcher.h"
+
+#include "requestHandler.h"
+
+#include <zeroeq/log.h>
+
+#include <stdexcept>
+
+namespace zeroeq
+{
+namespace http
+{
+Dispatcher::Dispatcher(RequestHandler& handler, const std::string& zmqURL)
+    : _thread([this, &handler, zmqURL] { _run(handler, zmqURL); })
+{
+}
+
+Dispatcher::~Dispatcher()
+{
+    stop();
+}
+
+void Dispatcher::post(std::function<void()> func)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopped)
+            return;
+        _funcs.push_back(std::move(func));
+    }
+    _condition.notify_one();
+}
+
+void Dispatcher::stop()
+{
+    std::deque<std::function<void()>> funcs; // released outside of the lock
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopped)
+            return;
+        _stopped = true;
+        funcs.swap(_funcs);
+    }
+    _condition.notify_one();
+    _thread.join();
+}
+
+void Dispatcher::_run(RequestHandler& handler, const std::string& zmqURL)
+{
+    try
+    {
+        handler.connectThread(zmqURL);
+    }
+    catch (const std::exception& e)
+    {
+        ZEROEQERROR << "Cannot dispatch HTTP requests: " << e.what()
+                    << std::endl;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _condition.wait(lock, [this] { return _stopped || !_funcs.empty(); });
+        if (_stopped)
+            return;
+        auto func = std::move(_funcs.front());
+        _funcs.pop_front();
+        lock.unlock();
+        func();
+        func = nullptr; // release its captures outside of the lock
+        lock.lock();
+    }
+}
+}
+}
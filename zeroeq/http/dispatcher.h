@@ -0,0 +1,54 @@
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_DISPATCHER_H
+#define ZEROEQ_HTTP_DISPATCHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace zeroeq
+{
+namespace http
+{
+class RequestHandler;
+
+// Runs functions in order on a thread connected to the zeroeq::http::Server
+// with its own socket, see RequestHandler::connectThread(). Used by the
+// listeners whose I/O threads must not block in RequestHandler::process()
+// until receive() takes a request.
+class Dispatcher
+{
+public:
+    Dispatcher(RequestHandler& handler, const std::string& zmqURL);
+
+    /** Stop the thread, see stop(). */
+    ~Dispatcher();
+
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+
+    /** Queue a function, ignored once stopped. */
+    void post(std::function<void()> func);
+
+    /** Drop the queued functions and join the thread. */
+    void stop();
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<std::function<void()>> _funcs;
+    bool _stopped = false;
+    std::thread _thread; // last, uses the members above
+
+    void _run(RequestHandler& handler, const std::string& zmqURL);
+};
+}
+}
+
+#endif
@@ -0,0 +1,737 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "epollServer.h"
+
+#include "dispatcher.h"
+#include "protocol.h"
+#include "requestHandler.h"
+
+#include <zeroeq/defines.h>
+#include <zeroeq/log.h>
+#include <zeroeq/uri.h>
+
+#ifdef ZEROEQ_USE_EPOLL
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+#endif
+
+#include <stdexcept>
+
+namespace zeroeq
+{
+namespace http
+{
+#ifdef ZEROEQ_USE_EPOLL
+namespace
+{
+const size_t readChunkSize = 16 * 1024;
+const int maxEvents = 64;
+
+// bounds of the interval for closing idle connections, in ms
+const int minSweepInterval = 10;
+const int maxSweepInterval = 1000;
+
+// idle time before closing a connection which has not sent a complete request
+// head, or not read its response, in ms; independent of the keep-alive timeout
+// which may be 0
+const uint32_t transferTimeout = 10000;
+
+using Clock = std::chrono::steady_clock;
+using Milliseconds = std::chrono::milliseconds;
+
+// epoll data of the descriptors which are not connections
+const uint64_t listenToken = 0;
+const uint64_t wakeupToken = 1;
+
+std::string _getErrorString()
+{
+    return std::strerror(errno);
+}
+
+std::string _getSource(const sockaddr_in& address)
+{
+    char source[INET_ADDRSTRLEN] = {0};
+    ::inet_ntop(AF_INET, &address.sin_addr, source, sizeof(source));
+    return source;
+}
+
+// An accepted connection, only used from the thread of its loop.
+struct Connection
+{
+    Connection(const uint64_t id_, const int fd_, const std::string& source_)
+        : id(id_)
+        , fd(fd_)
+        , source(source_)
+    {
+    }
+
+    const uint64_t id;
+    int fd; // -1 once closed
+    const std::string source;
+    uint32_t events = EPOLLIN; // registered with epoll
+    size_t requests = 0;       // received on this connection
+
+    // last data sent or received, for closing idle connections
+    Clock::time_point activity = Clock::now();
+
+    std::string input;     // received, starting with the processed requests
+    size_t consumed = 0;   // size of the processed requests in the input
+    bool admitted = false; // the next request passed RequestHandler::admit()
+    std::string output;    // responses not sent yet
+    size_t written = 0;    // size of the sent output
+    bool closing = false;  // close once the output is sent
+    bool finished = false; // the client sent all its requests
+
+    // the response of the last request is awaited, which holds back the
+    // following pipelined requests
+    bool waiting = false;
+    std::shared_ptr<Message> message; // used by the dispatcher until ready
+
+    // of the last request, for its response
+    Method method = Method::GET;
+    std::string target;
+    std::string acceptEncoding;
+    bool http10 = false;
+    bool keepAlive = true;
+};
+using ConnectionPtr = std::shared_ptr<Connection>;
+}
+
+// The epoll instance and connections of one EpollServer::run() call.
+class EpollServer::Loop : public std::enable_shared_from_this<Loop>
+{
+public:
+    Loop(const int listenFd, RequestHandler& handler,
+         const std::string& zmqURL)
+        : _handler(handler)
+        , _listenFd(listenFd)
+        , _epoll(::epoll_create1(EPOLL_CLOEXEC))
+        , _wakeup(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+        , _dispatcher(handler, zmqURL)
+    {
+        epoll_event listenEvent{};
+        listenEvent.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+        // only wake up one of the loops for each new connection
+        listenEvent.events |= EPOLLEXCLUSIVE;
+#endif
+        listenEvent.data.u64 = listenToken;
+        epoll_event wakeupEvent{};
+        wakeupEvent.events = EPOLLIN;
+        wakeupEvent.data.u64 = wakeupToken;
+
+        if (_epoll == -1 || _wakeup == -1 ||
+            ::epoll_ctl(_epoll, EPOLL_CTL_ADD, _listenFd, &listenEvent) == -1 ||
+            ::epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &wakeupEvent) == -1)
+        {
+            const auto error = _getErrorString();
+            _closeDescriptors();
+            ZEROEQTHROW(
+                std::runtime_error("Cannot create epoll loop: " + error));
+        }
+    }
+
+    ~Loop() { _closeDescriptors(); }
+
+    void run()
+    {
+        std::array<epoll_event, maxEvents> events;
+        auto sweep = Clock::now();
+        while (!_stopped)
+        {
+            const uint32_t keepAlive = _handler.getKeepAliveTimeout();
+            const uint32_t timeout = keepAlive == 0
+                                         ? transferTimeout
+                                         : std::min(keepAlive, transferTimeout);
+            const int interval =
+                std::max(minSweepInterval,
+                         std::min(maxSweepInterval, int(timeout / 2)));
+            const int count =
+                ::epoll_wait(_epoll, events.data(), maxEvents, interval);
+            if (count == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                ZEROEQERROR << "Error during epoll_wait: " << _getErrorString()
+                            << std::endl;
+                break;
+            }
+
+            for (int i = 0; i < count; ++i)
+            {
+                const auto token = events[i].data.u64;
+                if (token == listenToken)
+                    _accept();
+                else if (token == wakeupToken)
+                    _takeResponses();
+                else
+                    _handleEvents(token, events[i].events);
+            }
+
+            const auto now = Clock::now();
+            if (now - sweep >= Milliseconds(interval))
+            {
+                _closeIdle(now, keepAlive);
+                sweep = now;
+            }
+        }
+
+        // the dispatched functions refer to this loop
+        _dispatcher.stop();
+        for (const auto& i : _connections)
+        {
+            if (i.second->fd == -1)
+                continue;
+            ::close(i.second->fd);
+            ++_handler.getConnectionCounters().closed;
+        }
+        _connections.clear();
+    }
+
+    void stop()
+    {
+        _stopped = true;
+        _notify();
+    }
+
+    /** Queue a connection whose response can be taken, from any thread. */
+    void post(const uint64_t id)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_readyMutex);
+            _ready.push_back(id);
+        }
+        _notify();
+    }
+
+private:
+    RequestHandler& _handler;
+    const int _listenFd;
+    int _epoll;
+    int _wakeup; // eventfd for post() and stop()
+    std::atomic<bool> _stopped{false};
+
+    uint64_t _nextId = wakeupToken + 1;
+    std::unordered_map<uint64_t, ConnectionPtr> _connections;
+    std::array<char, readChunkSize> _chunk;
+    RequestHead _head; // of the request being processed, reused
+
+    std::mutex _readyMutex;
+    std::vector<uint64_t> _ready; // connections with a response to take
+
+    Dispatcher _dispatcher; // hands the requests to the RequestHandler
+
+    void _closeDescriptors()
+    {
+        if (_wakeup != -1)
+            ::close(_wakeup);
+        if (_epoll != -1)
+            ::close(_epoll);
+    }
+
+    void _notify()
+    {
+        const uint64_t one = 1;
+        if (::write(_wakeup, &one, sizeof(one)) == -1)
+        {
+            // the counter is still set, the loop wakes up anyway
+        }
+    }
+
+    void _accept()
+    {
+        for (;;)
+        {
+            sockaddr_in address;
+            socklen_t length = sizeof(address);
+            const int fd = ::accept4(_listenFd,
+                                     reinterpret_cast<sockaddr*>(&address),
+                                     &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd == -1)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                // EAGAIN once all connections are accepted, maybe by another
+                // loop
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    ZEROEQWARN << "Cannot accept HTTP connection: "
+                               << _getErrorString() << std::endl;
+                return;
+            }
+
+            // the responses are written at once, do not wait for more data
+            const int noDelay = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay,
+                         sizeof(noDelay));
+
+            auto connection =
+                std::make_shared<Connection>(_nextId++, fd,
+                                             _getSource(address));
+            epoll_event event{};
+            event.events = connection->events;
+            event.data.u64 = connection->id;
+            if (::epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) == -1)
+            {
+                ::close(fd);
+                continue;
+            }
+            _connections.emplace(connection->id, connection);
+            ++_handler.getConnectionCounters().opened;
+        }
+    }
+
+    void _handleEvents(const uint64_t id, const uint32_t events)
+    {
+        const auto i = _connections.find(id);
+        if (i == _connections.end())
+            return;
+
+        const auto connection = i->second; // _close() may erase it
+        if (events & (EPOLLERR | EPOLLHUP))
+        {
+            _close(*connection);
+            return;
+        }
+        if (events & EPOLLIN)
+            _read(*connection);
+        if (connection->fd != -1)
+            _write(*connection);
+    }
+
+    void _read(Connection& connection)
+    {
+        bool closed = false;
+        for (;;)
+        {
+            const auto received =
+                ::recv(connection.fd, _chunk.data(), _chunk.size(), 0);
+            if (received > 0)
+            {
+                connection.activity = Clock::now();
+                connection.input.append(_chunk.data(), size_t(received));
+                if (size_t(received) < _chunk.size())
+                    break;
+                continue;
+            }
+            if (received == 0)
+            {
+                closed = true;
+                break;
+            }
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                _close(connection);
+                return;
+            }
+            break;
+        }
+
+        // the client closed its side, the complete requests are answered
+        connection.finished = closed;
+        _processInput(connection);
+    }
+
+    // Handle the complete requests of the input in order, until a response is
+    // awaited
+    void _processInput(Connection& connection)
+    {
+        auto& input = connection.input;
+        while (!connection.waiting && !connection.closing &&
+               connection.consumed < input.size())
+        {
+            const char* data = input.data() + connection.consumed;
+            const size_t size = input.size() - connection.consumed;
+            const auto result = parseRequestHead(data, size, _head);
+            if (result == ParseResult::incomplete)
+            {
+                if (size > maxRequestHeadSize)
+                    _reply(connection, Code::BAD_REQUEST);
+                break;
+            }
+            if (result == ParseResult::error)
+            {
+                _reply(connection, _head.error);
+                break;
+            }
+
+            // checked once the head is complete, before reading the body
+            if (!connection.admitted)
+            {
+                const auto retryAfter =
+                    _handler.admit(connection.source,
+                                   URI(_head.target.str()).getPath());
+                if (retryAfter > 0)
+                {
+                    _reply(connection, Code::SERVICE_UNAVAILABLE, retryAfter);
+                    break;
+                }
+
+                const size_t maxBodySize = _handler.getMaxBodySize();
+                if (maxBodySize > 0 && _head.contentLength > maxBodySize)
+                {
+                    _reply(connection, Code::PAYLOAD_TOO_LARGE);
+                    break;
+                }
+                connection.admitted = true;
+            }
+
+            if (size - _head.size < _head.contentLength)
+                break;
+            _handleRequest(connection, data);
+        }
+
+        if (connection.consumed == input.size())
+            input.clear();
+        else
+            input.erase(0, connection.consumed);
+        connection.consumed = 0;
+    }
+
+    void _handleRequest(Connection& connection, const char* data)
+    {
+        auto message = std::make_shared<Message>();
+        setRequest(_head, connection.source, *message);
+        message->request.body.assign(data + _head.size, _head.contentLength);
+
+        connection.consumed += _head.size + _head.contentLength;
+        connection.admitted = false;
+        connection.method = _head.method;
+        connection.target = _head.target.str();
+        connection.acceptEncoding = _head.getHeader("Accept-Encoding").str();
+        connection.http10 = _head.http10;
+
+        if (connection.requests++ > 0)
+            ++_handler.getConnectionCounters().reused;
+        const size_t maxRequests = _handler.getMaxKeepAliveRequests();
+        connection.keepAlive =
+            _head.keepAlive && _handler.getKeepAliveTimeout() > 0 &&
+            (maxRequests == 0 || connection.requests < maxRequests);
+
+        // RequestHandler::process() blocks until receive() takes the request,
+        // which must not stall the other connections of the loop. The message
+        // is only used by the dispatcher until the loop is posted, and the
+        // response may be completed later by the zeroeq::http::Server on any
+        // thread; the connection is only used from the loop thread.
+        connection.waiting = true;
+        connection.message = message;
+        const std::weak_ptr<Loop> loop = shared_from_this();
+        const auto id = connection.id;
+        _dispatcher.post([this, loop, id, message] {
+            _handler.process(*message);
+            if (!message->pending)
+            {
+                post(id);
+                return;
+            }
+            message->pending->onReady([loop, id] {
+                if (auto self = loop.lock())
+                    self->post(id);
+            });
+        });
+    }
+
+    void _takeResponses()
+    {
+        uint64_t count;
+        if (::read(_wakeup, &count, sizeof(count)) == -1)
+        {
+            // already reset by a previous wakeup
+        }
+
+        std::vector<uint64_t> ready;
+        {
+            std::lock_guard<std::mutex> lock(_readyMutex);
+            ready.swap(_ready);
+        }
+
+        for (const auto id : ready)
+        {
+            const auto i = _connections.find(id);
+            if (i == _connections.end() || !i->second->waiting)
+                continue;
+
+            const auto connection = i->second;
+            auto message = std::move(connection->message);
+            auto response =
+                _handler.takeResponse(message->response, message->route);
+            connection->waiting = false;
+            if (connection->fd == -1)
+            {
+                _connections.erase(id);
+                continue;
+            }
+
+            if (response.stream ||
+                (message->eventStream && response.code == OK))
+            {
+                response = Response(Code::NOT_IMPLEMENTED);
+            }
+            _appendResponse(*connection, response,
+                            message->corsResponseHeaders);
+            _processInput(*connection);
+            _write(*connection);
+        }
+    }
+
+    void _appendResponse(
+        Connection& connection, Response& response,
+        const std::map<CorsResponseHeader, std::string>& corsHeaders)
+    {
+        // only the unmodified GET resources are worth caching
+        static const std::string noCacheKey;
+        const bool cacheable =
+            connection.method == Method::GET && response.code == OK;
+        _handler.getCompressor().encode(response, connection.acceptEncoding,
+                                        cacheable ? connection.target
+                                                  : noCacheKey);
+        if (response.code == Code::NOT_MODIFIED)
+            response.body.clear(); // not announced by appendResponseHead()
+
+        if (!connection.keepAlive)
+            connection.closing = true;
+        appendResponseHead(response, corsHeaders,
+                           getConnectionHeader(connection.http10,
+                                               connection.closing),
+                           connection.output);
+        connection.output.append(response.body);
+    }
+
+    // Answer an invalid or rejected request, whose body is not read, and
+    // close the connection
+    void _reply(Connection& connection, const Code code,
+                const uint32_t retryAfter = 0)
+    {
+        Response response(code);
+        if (retryAfter > 0)
+            response.headers[Header::RETRY_AFTER] = std::to_string(retryAfter);
+        connection.closing = true;
+        appendResponseHead(response, {}, ConnectionHeader::close,
+                           connection.output);
+    }
+
+    void _write(Connection& connection)
+    {
+        auto& output = connection.output;
+        while (connection.written < output.size())
+        {
+            const auto sent =
+                ::send(connection.fd, output.data() + connection.written,
+                       output.size() - connection.written, MSG_NOSIGNAL);
+            if (sent >= 0)
+            {
+                connection.written += size_t(sent);
+                connection.activity = Clock::now();
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            _close(connection);
+            return;
+        }
+
+        if (connection.written == output.size())
+        {
+            output.clear();
+            connection.written = 0;
+            if ((connection.closing || connection.finished) &&
+                !connection.waiting)
+            {
+                _close(connection);
+                return;
+            }
+        }
+        _updateEvents(connection);
+    }
+
+    // Only read while requests are processed, and wait for writability while
+    // output is pending
+    void _updateEvents(Connection& connection)
+    {
+        uint32_t events = 0;
+        if (!connection.waiting && !connection.closing && !connection.finished)
+            events |= EPOLLIN;
+        if (!connection.output.empty())
+            events |= EPOLLOUT;
+        if (events == connection.events)
+            return;
+
+        connection.events = events;
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = connection.id;
+        ::epoll_ctl(_epoll, EPOLL_CTL_MOD, connection.fd, &event);
+    }
+
+    // Close the idle connections, except the ones waiting for a response.
+    // Connections between two requests are closed after the keep-alive
+    // timeout, the ones in the middle of a request or a response after the
+    // transfer timeout, or the keep-alive one if shorter.
+    void _closeIdle(const Clock::time_point now, const uint32_t keepAlive)
+    {
+        std::vector<ConnectionPtr> idle;
+        for (const auto& i : _connections)
+        {
+            const auto& connection = i.second;
+            if (connection->fd == -1 || connection->waiting)
+                continue;
+
+            const bool betweenRequests = connection->requests > 0 &&
+                                         connection->input.empty() &&
+                                         connection->output.empty();
+            uint32_t timeout = transferTimeout;
+            if (betweenRequests || (keepAlive > 0 && keepAlive < timeout))
+                timeout = keepAlive;
+            if (betweenRequests && timeout == 0)
+                continue; // closed after its response already
+            if (connection->activity < now - Milliseconds(timeout))
+                idle.push_back(connection);
+        }
+        for (const auto& connection : idle)
+            _close(*connection);
+    }
+
+    void _close(Connection& connection)
+    {
+        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, connection.fd, nullptr);
+        ::close(connection.fd);
+        connection.fd = -1;
+        ++_handler.getConnectionCounters().closed;
+
+        // a pending response is still taken once ready, to release its slot
+        // in the queued requests
+        if (!connection.waiting)
+            _connections.erase(connection.id);
+    }
+};
+
+EpollServer::EpollServer(const std::string& host, const uint16_t port,
+                         RequestHandler& handler)
+    : _handler(handler)
+    , _address(host)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    const auto service = std::to_string(port);
+    addrinfo* addresses = nullptr;
+    const int result =
+        ::getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses);
+    if (result != 0)
+    {
+        ZEROEQTHROW(std::runtime_error("Cannot resolve " + host + ": " +
+                                       ::gai_strerror(result)));
+    }
+
+    std::string error;
+    for (auto address = addresses; address; address = address->ai_next)
+    {
+        _fd = ::socket(address->ai_family,
+                       address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       address->ai_protocol);
+        if (_fd == -1)
+        {
+            error = _getErrorString();
+            continue;
+        }
+
+        const int reuse = 1;
+        ::setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (::bind(_fd, address->ai_addr, address->ai_addrlen) == 0 &&
+            ::listen(_fd, SOMAXCONN) == 0)
+        {
+            break;
+        }
+        error = _getErrorString();
+        ::close(_fd);
+        _fd = -1;
+    }
+    ::freeaddrinfo(addresses);
+
+    if (_fd == -1)
+    {
+        ZEROEQTHROW(std::runtime_error("Cannot listen on " + host + ":" +
+                                       service + ": " + error));
+    }
+
+    sockaddr_in bound;
+    socklen_t length = sizeof(bound);
+    if (::getsockname(_fd, reinterpret_cast<sockaddr*>(&bound), &length) == 0)
+        _port = ntohs(bound.sin_port);
+}
+
+EpollServer::~EpollServer()
+{
+    stop();
+    ::close(_fd);
+}
+
+void EpollServer::run(const std::string& zmqURL)
+{
+    auto loop = std::make_shared<Loop>(_fd, _handler, zmqURL);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopped)
+            return;
+        _loops.push_back(loop);
+    }
+    loop->run();
+}
+
+void EpollServer::stop()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopped = true;
+    for (const auto& loop : _loops)
+        loop->stop();
+}
+#else
+class EpollServer::Loop
+{
+};
+
+EpollServer::EpollServer(const std::string& host, uint16_t,
+                         RequestHandler& handler)
+    : _handler(handler)
+    , _address(host)
+{
+    ZEROEQTHROW(std::runtime_error(
+        "The epoll HTTP engine is not built, see the ZEROEQ_HTTP_EPOLL "
+        "CMake option"));
+}
+
+EpollServer::~EpollServer()
+{
+}
+
+void EpollServer::run(const std::string&)
+{
+}
+
+void EpollServer::stop()
+{
+}
+#endif
+}
+}
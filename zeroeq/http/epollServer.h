@@ -0,0 +1,81 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_EPOLLSERVER_H
+#define ZEROEQ_HTTP_EPOLLSERVER_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace zeroeq
+{
+namespace http
+{
+class RequestHandler;
+
+// HTTP/1.1 server on non-blocking sockets and epoll, used instead of the
+// cppnetlib server if selected with ZEROEQ_HTTP_ENGINE=epoll. Requests are
+// parsed in the receive buffer and handed to the RequestHandler by a
+// Dispatcher of each loop, so that a loop keeps serving its other connections
+// until receive() takes a request. Responses which are neither ready nor
+// pending are still awaited on the loop thread. Connections are kept alive
+// and pipelined requests are answered in order; streamed, event stream and
+// WebSocket responses, ranges, static directories and IPv6 are not supported.
+class EpollServer
+{
+public:
+    /**
+     * Bind and listen on the given address.
+     *
+     * @param host the IPv4 address to bind to, "0.0.0.0" for all interfaces
+     * @param port the port to bind to, 0 for a random port
+     * @param handler the handler of the requests
+     * @throw std::runtime_error if the socket cannot be bound, or if the
+     *        library is built without ZEROEQ_HTTP_EPOLL.
+     */
+    EpollServer(const std::string& host, uint16_t port,
+                RequestHandler& handler);
+
+    /** Close the listening socket, once all run() calls have returned. */
+    ~EpollServer();
+
+    EpollServer(const EpollServer&) = delete;
+    EpollServer& operator=(const EpollServer&) = delete;
+
+    const std::string& getAddress() const { return _address; }
+    uint16_t getPort() const { return _port; }
+
+    /**
+     * Accept and serve connections on the calling thread until stop(). May be
+     * called from several threads, each one serving the connections it
+     * accepted.
+     *
+     * @param zmqURL URL to the inproc socket handing over the requests of
+     *        this thread, see RequestHandler::connectThread()
+     */
+    void run(const std::string& zmqURL);
+
+    /** Make all run() calls return, closing their connections. */
+    void stop();
+
+private:
+    class Loop;
+
+    RequestHandler& _handler;
+    const std::string _address;
+    uint16_t _port = 0;
+    int _fd = -1;
+
+    std::mutex _mutex;
+    std::vector<std::shared_ptr<Loop>> _loops; // of the run() calls
+    bool _stopped = false;
+};
+}
+}
+
+#endif
@@ -0,0 +1,88 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "eventStream.h"
+
+#include <algorithm>
+
+namespace zeroeq
+{
+namespace http
+{
+namespace
+{
+// Format an event according to
+// https://html.spec.whatwg.org/multipage/server-sent-events.html
+std::string _format(const std::string& name, const std::string& data)
+{
+    std::string out;
+    if (!name.empty())
+        out.append("event: ").append(name).append("\n");
+
+    size_t begin = 0;
+    while (true)
+    {
+        const auto end = data.find('\n', begin);
+        out.append("data: ");
+        out.append(data, begin, end == std::string::npos ? end : end - begin);
+        out.append("\n");
+        if (end == std::string::npos)
+            break;
+        begin = end + 1;
+    }
+    out.append("\n");
+    return out;
+}
+}
+
+EventStream::EventStream(const size_t bufferSize)
+    : _bufferSize(bufferSize)
+{
+}
+
+SendQueuePtr EventStream::addClient(std::function<void()> notify)
+{
+    auto queue = std::make_shared<SendQueue>(_bufferSize, std::move(notify));
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_closed)
+        queue->close();
+    else
+        _clients.push_back(queue);
+    return queue;
+}
+
+void EventStream::push(const std::string& name, const std::string& data)
+{
+    std::vector<SendQueuePtr> clients;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto isClosed = [](const SendQueuePtr& queue) {
+            return queue->isClosed();
+        };
+        _clients.erase(std::remove_if(_clients.begin(), _clients.end(),
+                                      isClosed),
+                       _clients.end());
+        clients = _clients;
+    }
+
+    // notifying starts writes, don't block new clients meanwhile
+    const auto event = _format(name, data);
+    for (const auto& client : clients)
+        client->push(name, event);
+}
+
+void EventStream::close()
+{
+    std::vector<SendQueuePtr> clients;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        clients.swap(_clients);
+    }
+    for (const auto& client : clients)
+        client->close();
+}
+}
+}
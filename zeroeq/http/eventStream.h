@@ -0,0 +1,48 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_EVENTSTREAM_H
+#define ZEROEQ_HTTP_EVENTSTREAM_H
+
+#include "sendQueue.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace zeroeq
+{
+namespace http
+{
+// A text/event-stream endpoint, distributing the pushed events to the queues
+// of all connected clients.
+class EventStream
+{
+public:
+    explicit EventStream(size_t bufferSize);
+
+    /** Add a client, called from the cppnetlib thread. */
+    SendQueuePtr addClient(std::function<void()> notify);
+
+    /** Push an event to all open clients, and prune the closed ones. */
+    void push(const std::string& name, const std::string& data);
+
+    /** Close all clients, they are disconnected once idle. */
+    void close();
+
+private:
+    std::mutex _mutex;
+    const size_t _bufferSize;
+    std::vector<SendQueuePtr> _clients;
+    bool _closed = false;
+};
+
+using EventStreamPtr = std::shared_ptr<EventStream>;
+}
+}
+
+#endif
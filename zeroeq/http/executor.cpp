@@ -0,0 +1,110 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "executor.h"
+
+#include <zeroeq/log.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zeroeq
+{
+namespace http
+{
+class Executor::Impl
+{
+public:
+    explicit Impl(const size_t threads)
+    {
+        for (size_t i = 0; i < std::max(threads, size_t(1)); ++i)
+            _threads.emplace_back([this] { _run(); });
+    }
+
+    ~Impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopped = true;
+        }
+        _condition.notify_all();
+        for (auto& thread : _threads)
+            thread.join();
+    }
+
+    size_t getThreads() const { return _threads.size(); }
+
+    void post(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.push_back(std::move(task));
+        }
+        _condition.notify_one();
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<std::function<void()>> _tasks;
+    bool _stopped = false;
+    std::vector<std::thread> _threads;
+
+    // the remaining tasks are run before the threads exit
+    void _run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _condition.wait(lock,
+                            [this] { return _stopped || !_tasks.empty(); });
+            if (_tasks.empty())
+                return;
+
+            auto task = std::move(_tasks.front());
+            _tasks.pop_front();
+            lock.unlock();
+            try
+            {
+                task();
+            }
+            catch (const std::exception& e)
+            {
+                ZEROEQWARN << "Exception in executor task: " << e.what()
+                           << std::endl;
+            }
+            catch (...)
+            {
+                ZEROEQWARN << "Unknown exception in executor task" << std::endl;
+            }
+            lock.lock();
+        }
+    }
+};
+
+Executor::Executor(const size_t threads)
+    : _impl(new Impl(threads))
+{
+}
+
+Executor::~Executor()
+{
+}
+
+size_t Executor::getThreads() const
+{
+    return _impl->getThreads();
+}
+
+void Executor::post(std::function<void()> task)
+{
+    _impl->post(std::move(task));
+}
+}
+}
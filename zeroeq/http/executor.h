@@ -0,0 +1,57 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_EXECUTOR_H
+#define ZEROEQ_HTTP_EXECUTOR_H
+
+#include <zeroeq/http/api.h>
+
+#include <functional>
+#include <memory>
+
+namespace zeroeq
+{
+namespace http
+{
+/**
+ * A pool of threads running tasks in the order they are posted.
+ *
+ * Used to run the handlers of slow endpoints outside of Server::receive(), see
+ * Server::handle(). An executor may be shared by several endpoints and
+ * servers.
+ */
+class Executor
+{
+public:
+    /**
+     * Start the threads of the pool.
+     *
+     * @param threads the number of threads, at least one
+     */
+    ZEROEQHTTP_API explicit Executor(size_t threads = 1);
+
+    /** Run the remaining tasks and join the threads. */
+    ZEROEQHTTP_API ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    /** @return the number of threads of the pool. */
+    ZEROEQHTTP_API size_t getThreads() const;
+
+    /**
+     * Run a task on one of the threads of the pool. Exceptions thrown by the
+     * task are logged and ignored.
+     */
+    ZEROEQHTTP_API void post(std::function<void()> task);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> _impl;
+};
+}
+}
+
+#endif
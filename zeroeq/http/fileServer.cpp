@@ -0,0 +1,266 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "fileServer.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+
+namespace zeroeq
+{
+namespace http
+{
+namespace
+{
+const std::string indexFile = "index.html";
+
+std::string _getExtension(const std::string& file)
+{
+    const auto dot = file.find_last_of("./");
+    if (dot == std::string::npos || file[dot] != '.')
+        return std::string();
+    auto extension = file.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   ::tolower);
+    return extension;
+}
+
+// @return false for ".." segments and backslashes, which could escape the
+//         served directory
+bool _isSafe(const std::string& path)
+{
+    if (path.find('\\') != std::string::npos)
+        return false;
+
+    size_t begin = 0;
+    while (begin <= path.size())
+    {
+        auto end = path.find('/', begin);
+        if (end == std::string::npos)
+            end = path.size();
+        if (path.compare(begin, end - begin, "..") == 0)
+            return false;
+        begin = end + 1;
+    }
+    return true;
+}
+
+// @return the path relative to the endpoint, or false if the path is not
+//         below the endpoint
+bool _getRelativePath(const std::string& path, const std::string& endpoint,
+                      std::string& relative)
+{
+    if (endpoint.empty())
+    {
+        relative = path;
+        return true;
+    }
+    if (path.compare(0, endpoint.size(), endpoint) != 0)
+        return false;
+    if (path.size() == endpoint.size())
+    {
+        relative.clear();
+        return true;
+    }
+    if (path[endpoint.size()] != '/')
+        return false;
+    relative = path.substr(endpoint.size() + 1);
+    return true;
+}
+}
+
+const std::string& getMediaType(const std::string& file)
+{
+    static const std::map<std::string, std::string> types{
+        {"css", "text/css"},
+        {"gif", "image/gif"},
+        {"htm", "text/html"},
+        {"html", "text/html"},
+        {"ico", "image/x-icon"},
+        {"jpeg", "image/jpeg"},
+        {"jpg", "image/jpeg"},
+        {"js", "application/javascript"},
+        {"json", "application/json"},
+        {"map", "application/json"},
+        {"png", "image/png"},
+        {"svg", "image/svg+xml"},
+        {"txt", "text/plain"},
+        {"wasm", "application/wasm"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"}};
+    static const std::string binary = "application/octet-stream";
+
+    const auto i = types.find(_getExtension(file));
+    return i == types.end() ? binary : i->second;
+}
+
+std::string formatHTTPDate(const std::time_t time)
+{
+    std::tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &time);
+#else
+    gmtime_r(&time, &tm);
+#endif
+    // not using strftime, the names must not depend on the locale
+    static const char* days[] = {"Sun", "Mon", "Tue", "Wed",
+                                 "Thu", "Fri", "Sat"};
+    static const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    char date[32];
+    snprintf(date, sizeof(date), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+             days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon],
+             tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    return date;
+}
+
+StaticFile::StaticFile(const std::string& path)
+{
+#ifdef _WIN32
+    struct _stat info;
+    if (::_stat(path.c_str(), &info) != 0 || !(info.st_mode & _S_IFREG))
+        return;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return;
+    std::ostringstream content;
+    content << file.rdbuf();
+    _content = content.str();
+    _size = _content.size();
+    _modified = info.st_mtime;
+    _open = true;
+#else
+    _fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd == -1)
+        return;
+
+    struct stat info;
+    if (::fstat(_fd, &info) == 0 && S_ISREG(info.st_mode))
+    {
+        _size = size_t(info.st_size);
+        _modified = info.st_mtime;
+        _open = true;
+    }
+#endif
+}
+
+StaticFile::~StaticFile()
+{
+#ifndef _WIN32
+    if (_fd != -1)
+        ::close(_fd);
+#endif
+}
+
+bool StaticFile::read(const size_t offset, const size_t size,
+                      std::string& data) const
+{
+#ifdef _WIN32
+    if (offset + size > _content.size())
+        return false;
+    data.assign(_content, offset, size);
+    return true;
+#else
+    data.resize(size);
+    size_t done = 0;
+    while (done < size)
+    {
+        const auto count =
+            ::pread(_fd, &data[done], size - done, off_t(offset + done));
+        if (count > 0)
+        {
+            done += size_t(count);
+            continue;
+        }
+        if (count == -1 && errno == EINTR)
+            continue;
+        return false; // 0 once truncated
+    }
+    return true;
+#endif
+}
+
+std::string StaticFile::getETag() const
+{
+    char etag[40];
+    snprintf(etag, sizeof(etag), "\"%llx-%llx\"", (unsigned long long)_size,
+             (unsigned long long)_modified);
+    return etag;
+}
+
+bool FileServer::addDirectory(const std::string& endpoint,
+                              const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_directories.insert({endpoint, path}).second)
+        return false;
+    _empty = false;
+    return true;
+}
+
+bool FileServer::removeDirectory(const std::string& endpoint)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_directories.erase(endpoint) == 0)
+        return false;
+    _empty = _directories.empty();
+    return true;
+}
+
+bool FileServer::resolve(const std::string& path, std::string& file) const
+{
+    if (_empty || path.empty() || path[0] != '/')
+        return false;
+
+    const auto endpointPath = path.substr(1);
+    std::string relative;
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        size_t matched = 0;
+        bool found = false;
+        for (const auto& i : _directories)
+        {
+            std::string candidate;
+            if ((!found || i.first.size() > matched) &&
+                _getRelativePath(endpointPath, i.first, candidate))
+            {
+                found = true;
+                matched = i.first.size();
+                relative.swap(candidate);
+                directory = i.second;
+            }
+        }
+        if (!found)
+            return false;
+    }
+
+    if (!_isSafe(relative))
+        return false;
+    if (relative.empty() || relative.back() == '/')
+        relative.append(indexFile);
+
+    file = directory;
+    if (file.empty() || file.back() != '/')
+        file.push_back('/');
+    file.append(relative);
+    return true;
+}
+}
+}
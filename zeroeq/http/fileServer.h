@@ -0,0 +1,96 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_FILESERVER_H
+#define ZEROEQ_HTTP_FILESERVER_H
+
+#include <atomic>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace zeroeq
+{
+namespace http
+{
+/** @return the media type for the extension of a file, e.g. "text/html". */
+const std::string& getMediaType(const std::string& file);
+
+/** @return the given time as an HTTP date (RFC 7231, 7.1.1.1). */
+std::string formatHTTPDate(std::time_t time);
+
+// A regular file opened for reading in slices. Unlike a memory mapping, a
+// file truncated while being sent only fails read() instead of faulting.
+class StaticFile
+{
+public:
+    explicit StaticFile(const std::string& path);
+    ~StaticFile();
+
+    StaticFile(const StaticFile&) = delete;
+    StaticFile& operator=(const StaticFile&) = delete;
+
+    /** @return false if the file is not a readable regular file. */
+    bool isOpen() const { return _open; }
+
+    /** @return the size when the file was opened. */
+    size_t getSize() const { return _size; }
+    std::time_t getModified() const { return _modified; }
+
+    /** @return a strong validator built from size and modification time. */
+    std::string getETag() const;
+
+    /**
+     * Read a slice of the file.
+     *
+     * @return false on errors, or if the file has been truncated since it was
+     *         opened.
+     */
+    bool read(size_t offset, size_t size, std::string& data) const;
+
+private:
+    bool _open = false;
+    size_t _size = 0;
+    std::time_t _modified = 0;
+#ifdef _WIN32
+    std::string _content;
+#else
+    int _fd = -1;
+#endif
+};
+
+// The directories served by Server::serveDirectory(), resolved from the
+// cppnetlib thread.
+class FileServer
+{
+public:
+    /** @return false if the endpoint is already served. */
+    bool addDirectory(const std::string& endpoint, const std::string& path);
+
+    /** @return false if the endpoint is not served. */
+    bool removeDirectory(const std::string& endpoint);
+
+    /**
+     * Resolve the path of a request to a file below a served directory, using
+     * the longest matching endpoint. The endpoint itself and paths ending
+     * with a slash resolve to index.html, paths containing ".." segments are
+     * rejected.
+     *
+     * @param path the request path, e.g. "/assets/app.js"
+     * @param file set to the file system path of the requested file
+     * @return true if the path resolves to a file path, which may not exist
+     */
+    bool resolve(const std::string& path, std::string& file) const;
+
+private:
+    mutable std::mutex _mutex;
+    std::map<std::string, std::string> _directories; // endpoint -> path
+    std::atomic<bool> _empty{true}; // skip locking unless used
+};
+}
+}
+
+#endif
@@ -0,0 +1,142 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "helpers.h"
+
+#include <array>
+#include <memory> // std::allocator_arg
+#include <mutex>
+#include <new>
+
+namespace zeroeq
+{
+namespace detail
+{
+namespace
+{
+const size_t blockSize = 64;
+const size_t maxBlocks = 8;      // largest pooled size: 512 bytes
+const size_t maxFreeBlocks = 64; // per size, bounds the idle memory
+
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+// Free lists for each multiple of the block size. The states are allocated by
+// the zeroeq::http::Server thread and freed by the HTTP server thread.
+class Pool
+{
+public:
+    void* allocate(const size_t size)
+    {
+        const size_t index = _getIndex(size);
+        if (index >= maxBlocks)
+            return ::operator new(size);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto& list = _lists[index];
+            if (list.head)
+            {
+                FreeBlock* block = list.head;
+                list.head = block->next;
+                --list.size;
+                return block;
+            }
+        }
+        return ::operator new((index + 1) * blockSize);
+    }
+
+    void deallocate(void* ptr, const size_t size)
+    {
+        const size_t index = _getIndex(size);
+        if (index < maxBlocks)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto& list = _lists[index];
+            if (list.size < maxFreeBlocks)
+            {
+                list.head = new (ptr) FreeBlock{list.head};
+                ++list.size;
+                return;
+            }
+        }
+        ::operator delete(ptr);
+    }
+
+private:
+    struct FreeList
+    {
+        FreeBlock* head = nullptr;
+        size_t size = 0;
+    };
+
+    std::mutex _mutex;
+    std::array<FreeList, maxBlocks> _lists;
+
+    static size_t _getIndex(const size_t size)
+    {
+        return size == 0 ? 0 : (size - 1) / blockSize;
+    }
+};
+
+Pool& _getPool()
+{
+    // never destroyed, states may be freed during static destruction
+    static Pool* pool = new Pool;
+    return *pool;
+}
+
+// Allocator for the shared state of the futures of ready responses
+template <typename T>
+struct ResponseStateAllocator
+{
+    using value_type = T;
+
+    ResponseStateAllocator() = default;
+    template <typename U>
+    ResponseStateAllocator(const ResponseStateAllocator<U>&)
+    {
+    }
+
+    T* allocate(const size_t n)
+    {
+        return static_cast<T*>(_getPool().allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, const size_t n)
+    {
+        _getPool().deallocate(ptr, n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ResponseStateAllocator<T>&,
+                const ResponseStateAllocator<U>&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const ResponseStateAllocator<T>&,
+                const ResponseStateAllocator<U>&)
+{
+    return false;
+}
+}
+}
+
+namespace http
+{
+std::future<Response> make_ready_response(Response&& response)
+{
+    std::promise<Response> promise(
+        std::allocator_arg, detail::ResponseStateAllocator<Response>());
+    promise.set_value(std::move(response));
+    return promise.get_future();
+}
+}
+}
@@ -6,6 +6,7 @@
 #ifndef ZEROEQ_HTTP_HELPERS_H
 #define ZEROEQ_HTTP_HELPERS_H
 
+#include <zeroeq/http/api.h>
 #include <zeroeq/http/response.h>
 
 #include <future>
@@ -14,16 +15,21 @@ namespace zeroeq
 {
 namespace http
 {
+/**
+ * @return ready future wrapping the given HTTP Response. The memory of the
+ *         future's shared state is recycled, so ready responses do not
+ *         allocate in a steady state.
+ */
+ZEROEQHTTP_API std::future<Response> make_ready_response(Response&& response);
+
 /**
  * @return ready future wrapping an HTTP Response constructed with
- *         the values passed.
+ *         the values passed. The body is moved if passed as an rvalue.
  */
 template <typename... Args>
 std::future<Response> make_ready_response(Args&&... args)
 {
-    std::promise<Response> promise;
-    promise.set_value(Response(std::forward<Args>(args)...));
-    return promise.get_future();
+    return make_ready_response(Response(std::forward<Args>(args)...));
 }
 }
 }
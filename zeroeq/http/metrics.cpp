@@ -0,0 +1,232 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "metrics.h"
+
+#include "requestHandler.h"
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <type_traits>
+
+namespace zeroeq
+{
+namespace http
+{
+namespace
+{
+// in the order of the Code enum
+const Code countedCodes[] = {
+    SWITCHING_PROTOCOLS, OK, CREATED, ACCEPTED, NO_CONTENT, PARTIAL_CONTENT,
+    MULTIPLE_CHOICES, MOVED_PERMANENTLY, MOVED_TEMPORARILY, NOT_MODIFIED,
+    BAD_REQUEST, UNAUTHORIZED, FORBIDDEN, NOT_FOUND, NOT_SUPPORTED,
+    NOT_ACCEPTABLE, REQUEST_TIMEOUT, PRECONDITION_FAILED, PAYLOAD_TOO_LARGE,
+    UNSATISFIABLE_RANGE, UPGRADE_REQUIRED, INTERNAL_SERVER_ERROR,
+    NOT_IMPLEMENTED, BAD_GATEWAY, SERVICE_UNAVAILABLE, SPACE_UNAVAILABLE};
+static_assert(std::extent<decltype(countedCodes)>::value == numCountedCodes,
+              "numCountedCodes must match the number of counted codes");
+
+// 100us to 10s
+const std::vector<uint64_t> timeBuckets{
+    100,   250,    500,    1000,   2500,    5000,    10000,   25000,
+    50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+
+// 64B to 64MB
+const std::vector<uint64_t> sizeBuckets{64,      256,      1024,    4096,
+                                        16384,   65536,    262144,  1048576,
+                                        4194304, 16777216, 67108864};
+
+std::string _toString(const double value)
+{
+    std::ostringstream os;
+    os << value;
+    return os.str();
+}
+
+// Label values may contain any character except for these escaped ones
+std::string _escape(const std::string& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (const char c : value)
+    {
+        if (c == '\\' || c == '"')
+            escaped.append(1, '\\').append(1, c);
+        else if (c == '\n')
+            escaped.append("\\n");
+        else
+            escaped.append(1, c);
+    }
+    return escaped;
+}
+
+void _appendHeader(const std::string& name, const std::string& type,
+                   const std::string& help, std::string& output)
+{
+    output.append("# HELP ").append(name).append(" ").append(help);
+    output.append("\n# TYPE ").append(name).append(" ").append(type);
+    output.append("\n");
+}
+
+void _appendSample(const std::string& name, const std::string& labels,
+                   const std::string& value, std::string& output)
+{
+    output.append(name);
+    if (!labels.empty())
+        output.append("{").append(labels).append("}");
+    output.append(" ").append(value).append("\n");
+}
+}
+
+Histogram::Histogram(std::vector<uint64_t> bounds)
+    : _bounds(std::move(bounds))
+    , _buckets(new std::atomic<uint64_t>[_bounds.size() + 1])
+{
+    for (size_t i = 0; i <= _bounds.size(); ++i)
+        _buckets[i] = 0;
+}
+
+void Histogram::observe(const uint64_t value)
+{
+    const auto bucket =
+        std::lower_bound(_bounds.begin(), _bounds.end(), value) -
+        _bounds.begin();
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Histogram::write(const std::string& name, const std::string& labels,
+                      const double scale, std::string& output) const
+{
+    const std::string prefix = labels.empty() ? labels : labels + ",";
+    uint64_t count = 0;
+    for (size_t i = 0; i <= _bounds.size(); ++i)
+    {
+        count += _buckets[i].load(std::memory_order_relaxed);
+        const auto bound =
+            i < _bounds.size() ? _toString(_bounds[i] * scale) : "+Inf";
+        _appendSample(name + "_bucket", prefix + "le=\"" + bound + "\"",
+                      std::to_string(count), output);
+    }
+    _appendSample(name + "_sum", labels,
+                  _toString(_sum.load(std::memory_order_relaxed) * scale),
+                  output);
+    _appendSample(name + "_count", labels, std::to_string(count), output);
+}
+
+RouteMetrics::RouteMetrics()
+    : queueTime(timeBuckets)
+    , handlerTime(timeBuckets)
+    , responseSize(sizeBuckets)
+{
+    for (auto& count : responses)
+        count = 0;
+}
+
+void RouteMetrics::countResponse(const Code code, const size_t bodySize)
+{
+    const auto i =
+        std::find(std::begin(countedCodes), std::end(countedCodes), code) -
+        std::begin(countedCodes);
+    responses[i].fetch_add(1, std::memory_order_relaxed);
+    responseSize.observe(bodySize);
+}
+
+ServerMetrics::ServerMetrics()
+    : _requestSize(sizeBuckets)
+{
+}
+
+const RouteMetricsPtr& ServerMetrics::getRoute(const std::string& endpoint,
+                                         const Method method)
+{
+    auto& route = _routes[{endpoint, method}];
+    if (!route)
+        route = std::make_shared<RouteMetrics>();
+    return route;
+}
+
+std::string ServerMetrics::toString(const ConnectionCounters& connections,
+                              const size_t queued) const
+{
+    std::vector<std::string> labels;
+    labels.reserve(_routes.size());
+    for (const auto& route : _routes)
+        labels.push_back("method=\"" + http::toString(route.first.second) +
+                         "\",endpoint=\"" + _escape(route.first.first) +
+                         "\"");
+
+    std::string output;
+    const std::string requests = "zeroeq_http_requests_total";
+    _appendHeader(requests, "counter", "Requests answered by receive().",
+                  output);
+    size_t i = 0;
+    for (const auto& route : _routes)
+    {
+        const auto& responses = route.second->responses;
+        for (size_t j = 0; j < responses.size(); ++j)
+        {
+            const auto count = responses[j].load(std::memory_order_relaxed);
+            if (count == 0)
+                continue;
+            const auto code = j < numCountedCodes
+                                  ? std::to_string(int(countedCodes[j]))
+                                  : std::string("other");
+            _appendSample(requests, labels[i] + ",code=\"" + code + "\"",
+                          std::to_string(count), output);
+        }
+        ++i;
+    }
+
+    const std::string queueTime = "zeroeq_http_queue_seconds";
+    _appendHeader(queueTime, "histogram",
+                  "Time from the I/O thread until receive() took the request.",
+                  output);
+    i = 0;
+    for (const auto& route : _routes)
+        route.second->queueTime.write(queueTime, labels[i++], 1e-6, output);
+
+    const std::string handlerTime = "zeroeq_http_handler_seconds";
+    _appendHeader(handlerTime, "histogram",
+                  "Time spent in the request handlers during receive().",
+                  output);
+    i = 0;
+    for (const auto& route : _routes)
+        route.second->handlerTime.write(handlerTime, labels[i++], 1e-6,
+                                        output);
+
+    const std::string responseSize = "zeroeq_http_response_body_bytes";
+    _appendHeader(responseSize, "histogram",
+                  "Size of the uncompressed response bodies.", output);
+    i = 0;
+    for (const auto& route : _routes)
+        route.second->responseSize.write(responseSize, labels[i++], 1,
+                                         output);
+
+    const std::string requestSize = "zeroeq_http_request_body_bytes";
+    _appendHeader(requestSize, "histogram",
+                  "Size of the request bodies passed to receive().", output);
+    _requestSize.write(requestSize, "", 1, output);
+
+    const uint64_t opened = connections.opened;
+    const uint64_t closed = connections.closed;
+    _appendHeader("zeroeq_http_connections", "gauge", "Open connections.",
+                  output);
+    _appendSample("zeroeq_http_connections", "",
+                  std::to_string(opened - std::min(opened, closed)), output);
+    _appendHeader("zeroeq_http_connections_total", "counter",
+                  "Accepted connections.", output);
+    _appendSample("zeroeq_http_connections_total", "", std::to_string(opened),
+                  output);
+    _appendHeader("zeroeq_http_queued_requests", "gauge",
+                  "Requests passed to receive() and not answered yet.",
+                  output);
+    _appendSample("zeroeq_http_queued_requests", "", std::to_string(queued),
+                  output);
+    return output;
+}
+}
+}
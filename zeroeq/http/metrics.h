@@ -0,0 +1,120 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_METRICS_H
+#define ZEROEQ_HTTP_METRICS_H
+
+#include <zeroeq/http/request.h>
+#include <zeroeq/http/response.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace zeroeq
+{
+namespace http
+{
+struct ConnectionCounters;
+
+// Histogram with fixed buckets, updated without locking. Values are integers
+// in the unit of the histogram, e.g. microseconds or bytes.
+class Histogram
+{
+public:
+    /**
+     * @param bounds the upper bounds of the buckets in ascending order, the
+     *               bucket for larger values is implicit
+     */
+    explicit Histogram(std::vector<uint64_t> bounds);
+
+    /** Count a value in its bucket. */
+    void observe(uint64_t value);
+
+    /**
+     * Append the buckets, sum and count in the Prometheus text format.
+     *
+     * @param name the name of the metric
+     * @param labels the labels of all samples, e.g. 'method="GET"', or empty
+     * @param scale the factor converting values to the exposed unit, e.g.
+     *              1e-6 for microseconds exposed as seconds
+     * @param output the text to append to
+     */
+    void write(const std::string& name, const std::string& labels,
+               double scale, std::string& output) const;
+
+private:
+    const std::vector<uint64_t> _bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> _buckets; // bounds + 1
+    std::atomic<uint64_t> _sum{0};
+};
+
+// The status codes of the Code enum, counted separately from all others,
+// checked against the list of counted codes at compile time
+const size_t numCountedCodes = 26;
+
+// The metrics of the requests for one method on one endpoint
+struct RouteMetrics
+{
+    RouteMetrics();
+
+    /** Count an answered request and its response body. */
+    void countResponse(Code code, size_t bodySize);
+
+    // per counted code, the last one for all others
+    std::array<std::atomic<uint64_t>, numCountedCodes + 1> responses;
+    Histogram queueTime;    // us from the I/O thread to receive()
+    Histogram handlerTime;  // us spent in Server::respondTo()
+    Histogram responseSize; // bytes of the response bodies
+};
+
+using RouteMetricsPtr = std::shared_ptr<RouteMetrics>;
+
+// The request metrics of a server, exposed in the Prometheus text format. The
+// counters are updated from any thread, the routes are only looked up and
+// written from the thread calling Server::receive().
+class ServerMetrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ServerMetrics();
+
+    void setEnabled(const bool enabled) { _enabled = enabled; }
+    bool isEnabled() const { return _enabled; }
+
+    /**
+     * @param endpoint the endpoint which handled the request, empty if none
+     * @param method the method of the request
+     * @return the metrics of the route, created on first use
+     */
+    const RouteMetricsPtr& getRoute(const std::string& endpoint,
+                                    Method method);
+
+    /** Count the body of a request received by an I/O thread. */
+    void countRequest(size_t bodySize) { _requestSize.observe(bodySize); }
+
+    /**
+     * @param connections the counters of the connections
+     * @param queued the requests processed but not answered yet
+     * @return all metrics in the Prometheus text format
+     */
+    std::string toString(const ConnectionCounters& connections,
+                         size_t queued) const;
+
+private:
+    std::atomic<bool> _enabled{false};
+    std::map<std::pair<std::string, Method>, RouteMetricsPtr> _routes;
+    Histogram _requestSize;
+};
+}
+}
+
+#endif
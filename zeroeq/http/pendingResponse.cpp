@@ -0,0 +1,40 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "pendingResponse.h"
+
+namespace zeroeq
+{
+namespace http
+{
+void PendingResponse::complete(Response response)
+{
+    std::function<void()> onReady;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_completed)
+            return;
+        _completed = true;
+        _promise.set_value(std::move(response));
+        onReady.swap(_onReady);
+    }
+    if (onReady)
+        onReady();
+}
+
+void PendingResponse::onReady(std::function<void()> func)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_completed)
+        {
+            _onReady = std::move(func);
+            return;
+        }
+    }
+    func();
+}
+}
+}
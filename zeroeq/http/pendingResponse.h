@@ -0,0 +1,52 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_PENDINGRESPONSE_H
+#define ZEROEQ_HTTP_PENDINGRESPONSE_H
+
+#include <zeroeq/http/response.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+
+namespace zeroeq
+{
+namespace http
+{
+// A response which is completed later than the processing of its request by
+// the zeroeq::http::Server. The cppnetlib side is notified when the response is
+// ready instead of blocking on its future.
+class PendingResponse
+{
+public:
+    /** @return the future of the response, may only be called once. */
+    std::future<Response> getFuture() { return _promise.get_future(); }
+
+    /**
+     * Complete the response and call the ready function if set. Subsequent
+     * calls are ignored.
+     */
+    void complete(Response response);
+
+    /**
+     * Set the function called once the response is ready, from the thread
+     * completing it. Called immediately if the response is ready already.
+     */
+    void onReady(std::function<void()> func);
+
+private:
+    std::mutex _mutex;
+    std::promise<Response> _promise;
+    std::function<void()> _onReady;
+    bool _completed = false;
+};
+
+using PendingResponsePtr = std::shared_ptr<PendingResponse>;
+}
+}
+
+#endif
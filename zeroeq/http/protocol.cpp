@@ -0,0 +1,326 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "protocol.h"
+
+#include "requestHandler.h"
+
+#include <zeroeq/uri.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace zeroeq
+{
+namespace http
+{
+namespace
+{
+const char headEnd[] = "\r\n\r\n";
+
+bool _isSpace(const char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+StringRef _trim(const char* begin, const char* end)
+{
+    while (begin < end && _isSpace(*begin))
+        ++begin;
+    while (end > begin && _isSpace(*(end - 1)))
+        --end;
+    StringRef ref;
+    ref.data = begin;
+    ref.size = size_t(end - begin);
+    return ref;
+}
+
+bool _isDigit(const char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+ParseResult _fail(RequestHead& head, const Code code)
+{
+    head.error = code;
+    return ParseResult::error;
+}
+
+// Parse "METHOD target HTTP/1.x"
+ParseResult _parseRequestLine(const char* begin, const char* end,
+                              RequestHead& head)
+{
+    const char* methodEnd = std::find(begin, end, ' ');
+    const char* targetBegin = methodEnd + 1;
+    if (methodEnd == begin || targetBegin >= end)
+        return _fail(head, Code::BAD_REQUEST);
+
+    const char* targetEnd = std::find(targetBegin, end, ' ');
+    const char* version = targetEnd + 1;
+    if (targetEnd == targetBegin || version >= end ||
+        size_t(end - version) != 8 ||
+        std::strncmp(version, "HTTP/1.", 7) != 0 || !_isDigit(version[7]))
+    {
+        return _fail(head, Code::BAD_REQUEST);
+    }
+
+    try
+    {
+        head.method = toMethod(std::string(begin, methodEnd));
+    }
+    catch (const std::invalid_argument&)
+    {
+        return _fail(head, Code::NOT_SUPPORTED);
+    }
+
+    head.target.data = targetBegin;
+    head.target.size = size_t(targetEnd - targetBegin);
+    // persistent connections are the default since HTTP/1.1
+    head.http10 = version[7] == '0';
+    head.keepAlive = !head.http10;
+    return ParseResult::complete;
+}
+
+ParseResult _parseContentLength(const StringRef& value, RequestHead& head)
+{
+    if (value.empty())
+        return _fail(head, Code::BAD_REQUEST);
+
+    size_t length = 0;
+    for (size_t i = 0; i < value.size; ++i)
+    {
+        const char c = value.data[i];
+        if (!_isDigit(c))
+            return _fail(head, Code::BAD_REQUEST);
+        const size_t digit = size_t(c - '0');
+        if (length > (std::numeric_limits<size_t>::max() - digit) / 10)
+            return _fail(head, Code::PAYLOAD_TOO_LARGE);
+        length = length * 10 + digit;
+    }
+    head.contentLength = length;
+    return ParseResult::complete;
+}
+}
+
+bool StringRef::equalsNoCase(const char* other) const
+{
+    const size_t length = std::strlen(other);
+    if (length != size)
+        return false;
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (std::tolower((unsigned char)data[i]) !=
+            std::tolower((unsigned char)other[i]))
+            return false;
+    }
+    return true;
+}
+
+StringRef RequestHead::getHeader(const char* name) const
+{
+    for (const auto& header : headers)
+    {
+        if (header.first.equalsNoCase(name))
+            return header.second;
+    }
+    return StringRef();
+}
+
+ParseResult parseRequestHead(const char* data, const size_t size,
+                             RequestHead& head)
+{
+    const char* end = data + size;
+    const char* found = std::search(data, end, headEnd, headEnd + 4);
+    if (found == end)
+        return ParseResult::incomplete;
+
+    // the vector keeps its capacity for the following requests
+    head.headers.clear();
+    head.size = size_t(found - data) + 4;
+    head.contentLength = 0;
+    head.error = Code::OK;
+
+    const char* headersEnd = found + 2; // after the last CRLF of a header
+    const char* lineEnd = std::search(data, headersEnd, headEnd, headEnd + 2);
+    if (_parseRequestLine(data, lineEnd, head) != ParseResult::complete)
+        return ParseResult::error;
+
+    for (const char* line = lineEnd + 2; line < headersEnd; line = lineEnd + 2)
+    {
+        lineEnd = std::search(line, headersEnd, headEnd, headEnd + 2);
+        const char* colon = std::find(line, lineEnd, ':');
+        if (colon == line || colon == lineEnd || _isSpace(*(colon - 1)))
+            return _fail(head, Code::BAD_REQUEST);
+
+        StringRef name;
+        name.data = line;
+        name.size = size_t(colon - line);
+        head.headers.emplace_back(name, _trim(colon + 1, lineEnd));
+    }
+
+    if (!head.getHeader("Transfer-Encoding").empty())
+        return _fail(head, Code::NOT_IMPLEMENTED);
+
+    const auto connection = head.getHeader("Connection");
+    if (connection.equalsNoCase("close"))
+        head.keepAlive = false;
+    else if (connection.equalsNoCase("keep-alive"))
+        head.keepAlive = true;
+
+    // repeated, differing lengths would frame the body ambiguously, which
+    // allows smuggling requests on persistent connections (RFC 7230, section
+    // 3.3.2)
+    bool hasContentLength = false;
+    for (const auto& header : head.headers)
+    {
+        if (!header.first.equalsNoCase("Content-Length"))
+            continue;
+        const size_t previous = head.contentLength;
+        if (_parseContentLength(header.second, head) != ParseResult::complete)
+            return ParseResult::error;
+        if (hasContentLength && head.contentLength != previous)
+            return _fail(head, Code::BAD_REQUEST);
+        hasContentLength = true;
+    }
+    return ParseResult::complete;
+}
+
+void setRequest(const RequestHead& head, const std::string& source,
+                Message& message)
+{
+    message.request.method = head.method;
+    message.request.source = source;
+    const URI uri(head.target.str());
+    message.request.path = uri.getPath();
+    message.request.query = uri.getQuery();
+    message.request.contentType = head.getHeader("Content-Type").str();
+    message.request.accept = head.getHeader("Accept").str();
+
+    message.origin = head.getHeader("Origin").str();
+    message.accessControlRequestHeaders =
+        head.getHeader("Access-Control-Request-Headers").str();
+    const auto requestMethod = head.getHeader("Access-Control-Request-Method");
+    if (!requestMethod.empty())
+    {
+        try
+        {
+            message.accessControlRequestMethod = toMethod(requestMethod.str());
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+    }
+}
+
+ConnectionHeader getConnectionHeader(const bool http10, const bool close)
+{
+    if (close)
+        return ConnectionHeader::close;
+    return http10 ? ConnectionHeader::keepAlive : ConnectionHeader::none;
+}
+
+const char* getReasonPhrase(const Code code)
+{
+    switch (code)
+    {
+    case Code::SWITCHING_PROTOCOLS:
+        return "Switching Protocols";
+    case Code::OK:
+        return "OK";
+    case Code::CREATED:
+        return "Created";
+    case Code::ACCEPTED:
+        return "Accepted";
+    case Code::NO_CONTENT:
+        return "No Content";
+    case Code::PARTIAL_CONTENT:
+        return "Partial Content";
+    case Code::MULTIPLE_CHOICES:
+        return "Multiple Choices";
+    case Code::MOVED_PERMANENTLY:
+        return "Moved Permanently";
+    case Code::MOVED_TEMPORARILY:
+        return "Found";
+    case Code::NOT_MODIFIED:
+        return "Not Modified";
+    case Code::BAD_REQUEST:
+        return "Bad Request";
+    case Code::UNAUTHORIZED:
+        return "Unauthorized";
+    case Code::FORBIDDEN:
+        return "Forbidden";
+    case Code::NOT_FOUND:
+        return "Not Found";
+    case Code::NOT_SUPPORTED:
+        return "Method Not Allowed";
+    case Code::NOT_ACCEPTABLE:
+        return "Not Acceptable";
+    case Code::REQUEST_TIMEOUT:
+        return "Request Timeout";
+    case Code::PRECONDITION_FAILED:
+        return "Precondition Failed";
+    case Code::PAYLOAD_TOO_LARGE:
+        return "Payload Too Large";
+    case Code::UNSATISFIABLE_RANGE:
+        return "Range Not Satisfiable";
+    case Code::UPGRADE_REQUIRED:
+        return "Upgrade Required";
+    case Code::INTERNAL_SERVER_ERROR:
+        return "Internal Server Error";
+    case Code::NOT_IMPLEMENTED:
+        return "Not Implemented";
+    case Code::BAD_GATEWAY:
+        return "Bad Gateway";
+    case Code::SERVICE_UNAVAILABLE:
+        return "Service Unavailable";
+    case Code::SPACE_UNAVAILABLE:
+        return "Insufficient Storage";
+    default:
+        return "Unknown";
+    }
+}
+
+void appendResponseHead(
+    const Response& response,
+    const std::map<CorsResponseHeader, std::string>& corsHeaders,
+    const ConnectionHeader connection, std::string& output)
+{
+    output.append("HTTP/1.1 ");
+    output.append(std::to_string(int(response.code)));
+    output.push_back(' ');
+    output.append(getReasonPhrase(response.code));
+    output.append("\r\n");
+    // a 304 Content-Length would announce the size of the unchanged resource
+    if (response.code != Code::NOT_MODIFIED)
+    {
+        output.append("Content-Length: ");
+        output.append(std::to_string(response.body.size()));
+        output.append("\r\n");
+    }
+    for (const auto& it : response.headers)
+    {
+        output.append(toString(it.first));
+        output.append(": ");
+        output.append(it.second);
+        output.append("\r\n");
+    }
+    for (const auto& it : corsHeaders)
+    {
+        output.append(toString(it.first));
+        output.append(": ");
+        output.append(it.second);
+        output.append("\r\n");
+    }
+    if (connection == ConnectionHeader::close)
+        output.append("Connection: close\r\n");
+    else if (connection == ConnectionHeader::keepAlive)
+        output.append("Connection: keep-alive\r\n");
+    output.append("\r\n");
+}
+}
+}
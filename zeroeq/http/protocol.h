@@ -0,0 +1,117 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_PROTOCOL_H
+#define ZEROEQ_HTTP_PROTOCOL_H
+
+#include <zeroeq/http/request.h>
+#include <zeroeq/http/response.h>
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zeroeq
+{
+namespace http
+{
+enum class CorsResponseHeader;
+struct Message;
+
+// HTTP/1.1 request heads are rejected beyond this size
+const size_t maxRequestHeadSize = 64 * 1024;
+
+// Characters of a buffer owned by someone else, to parse without copying.
+struct StringRef
+{
+    const char* data = nullptr;
+    size_t size = 0;
+
+    bool empty() const { return size == 0; }
+    std::string str() const { return std::string(data, size); }
+
+    /** @return true if equal to the given string, ignoring the case. */
+    bool equalsNoCase(const char* other) const;
+};
+
+// The request line and headers of an HTTP/1.x request, referring to the
+// parsed buffer.
+struct RequestHead
+{
+    Method method = Method::GET;
+    StringRef target;
+    std::vector<std::pair<StringRef, StringRef>> headers;
+    size_t size = 0; // including the empty line ending the headers
+    size_t contentLength = 0;
+    bool http10 = false; // HTTP/1.0, which closes connections by default
+    bool keepAlive = true;
+    Code error = Code::OK; // if parsing failed
+
+    /** @return the value of the first header with the given name, or empty. */
+    StringRef getHeader(const char* name) const;
+};
+
+enum class ParseResult
+{
+    complete,
+    incomplete, // the empty line ending the headers is missing
+    error       // RequestHead::error holds the status code for the reply
+};
+
+/**
+ * Parse the request head at the beginning of a buffer, without copying. The
+ * head refers to the buffer until the buffer is modified. Chunked request
+ * bodies are not supported, requests with a body need a Content-Length.
+ */
+ParseResult parseRequestHead(const char* data, size_t size, RequestHead& head);
+
+/**
+ * Set the request of a message from a parsed head, except the body.
+ *
+ * @param head the parsed request head
+ * @param source the client, see Request::source
+ * @param message the message to set up
+ */
+void setRequest(const RequestHead& head, const std::string& source,
+                Message& message);
+
+// The Connection header announcing whether the connection stays open
+enum class ConnectionHeader
+{
+    none,     // the default of the request's HTTP version applies
+    close,    // the connection is closed after the response
+    keepAlive // the connection stays open, for HTTP/1.0 clients
+};
+
+/**
+ * @param http10 true if the request uses HTTP/1.0
+ * @param close true if the connection is closed after the response
+ * @return the Connection header for the response
+ */
+ConnectionHeader getConnectionHeader(bool http10, bool close);
+
+/** @return the reason phrase of a status code, e.g. "Not Found". */
+const char* getReasonPhrase(Code code);
+
+/**
+ * Append the status line and headers of a response, including the empty line
+ * ending the headers, to an output buffer.
+ *
+ * @param response the response, whose body is announced in Content-Length
+ *                 unless it is a 304 Not Modified response
+ * @param corsHeaders the CORS headers to add
+ * @param connection the Connection header to add
+ * @param output the buffer to append to
+ */
+void appendResponseHead(
+    const Response& response,
+    const std::map<CorsResponseHeader, std::string>& corsHeaders,
+    ConnectionHeader connection, std::string& output);
+}
+}
+
+#endif
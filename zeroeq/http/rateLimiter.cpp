@@ -0,0 +1,114 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "rateLimiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace zeroeq
+{
+namespace http
+{
+namespace
+{
+// the buckets of idle clients are forgotten after this many requests
+const size_t pruneInterval = 1024;
+
+uint32_t _getRetryAfter(const double tokens, const double rate)
+{
+    const double seconds = std::ceil((1.0 - tokens) / rate);
+    return uint32_t(std::max(1.0, std::min(seconds, 3600.0)));
+}
+}
+
+void RateLimiter::setLimit(const std::string& endpoint, const double rate,
+                           const size_t burst)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (rate > 0.0)
+        _limits[endpoint] = {rate, double(std::max(burst, size_t(1)))};
+    else
+        _limits.erase(endpoint);
+
+    // restart with full buckets under the new limits
+    _buckets.clear();
+    _enabled = !_limits.empty();
+}
+
+uint32_t RateLimiter::acquire(const std::string& source,
+                              const std::string& endpoint)
+{
+    if (!_enabled)
+        return 0;
+
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (++_acquired >= pruneInterval)
+        _prune(now);
+
+    // the bucket for all requests, then the one for the endpoint
+    static const std::string allEndpoints;
+    const std::string* endpoints[] = {&allEndpoints, &endpoint};
+    Bucket* buckets[] = {nullptr, nullptr};
+    uint32_t retryAfter = 0;
+    for (size_t i = 0; i < (endpoint.empty() ? 1 : 2); ++i)
+    {
+        const auto limit = _limits.find(*endpoints[i]);
+        if (limit == _limits.end())
+            continue;
+
+        buckets[i] = &_refill({source, limit->first}, limit->second, now);
+        if (buckets[i]->tokens < 1.0)
+            retryAfter = std::max(retryAfter,
+                                  _getRetryAfter(buckets[i]->tokens,
+                                                 limit->second.rate));
+    }
+    if (retryAfter > 0)
+        return retryAfter;
+
+    for (auto bucket : buckets)
+        if (bucket)
+            bucket->tokens -= 1.0;
+    return 0;
+}
+
+RateLimiter::Bucket& RateLimiter::_refill(const Key& key, const Limit& limit,
+                                          const Clock::time_point now)
+{
+    const auto result = _buckets.insert({key, {limit.burst, now}});
+    auto& bucket = result.first->second;
+    if (!result.second)
+    {
+        const std::chrono::duration<double> elapsed = now - bucket.update;
+        bucket.tokens = std::min(limit.burst,
+                                 bucket.tokens + elapsed.count() * limit.rate);
+        bucket.update = now;
+    }
+    return bucket;
+}
+
+void RateLimiter::_prune(const Clock::time_point now)
+{
+    _acquired = 0;
+    for (auto i = _buckets.begin(); i != _buckets.end();)
+    {
+        const auto limit = _limits.find(i->first.second);
+        if (limit == _limits.end())
+        {
+            i = _buckets.erase(i);
+            continue;
+        }
+        const std::chrono::duration<double> elapsed = now - i->second.update;
+        const double tokens =
+            i->second.tokens + elapsed.count() * limit->second.rate;
+        if (tokens >= limit->second.burst)
+            i = _buckets.erase(i);
+        else
+            ++i;
+    }
+}
+}
+}
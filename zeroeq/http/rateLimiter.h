@@ -0,0 +1,70 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_RATELIMITER_H
+#define ZEROEQ_HTTP_RATELIMITER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace zeroeq
+{
+namespace http
+{
+// Token buckets limiting the request rate of each client, for all requests and
+// for single endpoints, checked from the cppnetlib threads.
+class RateLimiter
+{
+public:
+    /**
+     * Set the limit of each client for an endpoint.
+     *
+     * @param endpoint the endpoint, empty for all requests
+     * @param rate the sustained number of requests per second, 0 to remove the
+     *             limit
+     * @param burst the number of requests accepted at once
+     */
+    void setLimit(const std::string& endpoint, double rate, size_t burst);
+
+    /**
+     * Take a token from the buckets of the client for all requests and for the
+     * endpoint, if both have one.
+     *
+     * @return 0 if the request is admitted, otherwise the number of seconds
+     *         until the client may retry
+     */
+    uint32_t acquire(const std::string& source, const std::string& endpoint);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Limit
+    {
+        double rate;
+        double burst;
+    };
+    struct Bucket
+    {
+        double tokens;
+        Clock::time_point update;
+    };
+    using Key = std::pair<std::string, std::string>; // source, endpoint
+
+    std::mutex _mutex;
+    std::map<std::string, Limit> _limits;
+    std::map<Key, Bucket> _buckets;
+    size_t _acquired = 0; // since the last pruning of the full buckets
+    std::atomic<bool> _enabled{false}; // skip locking unless used
+
+    Bucket& _refill(const Key& key, const Limit& limit, Clock::time_point now);
+    void _prune(Clock::time_point now);
+};
+}
+}
+
+#endif
@@ -7,7 +7,9 @@
 
 #include <zeroeq/types.h>
 
-#include <string> // member
+#include <cstddef> // size_t
+#include <memory>  // member
+#include <string>  // member
 
 namespace zeroeq
 {
@@ -45,7 +47,14 @@ enum class Method
  * "api/objects"       || "api/objects?size=4"         || "size=4" || ""
  * "api/windows/"      || "api/windows/jf321f?size=4"  || "size=4" || "jf321"
  *
- * The body is the HTTP request payload.
+ * The body is the HTTP request payload, its media type is given by contentType.
+ * Payloads larger than Server::setBodySpillSize() are not copied into the body
+ * but kept in a memory-mapped temporary file, see spilledPayload.
+ * getPayload() and getPayloadSize() always give a read-only view of the
+ * payload, which is valid as long as the request or a copy of it exists.
+ *
+ * The accept field contains the media types accepted by the client for the
+ * response payload.
  */
 struct Request
 {
@@ -54,6 +63,27 @@ struct Request
     std::string source;
     std::string query;
     std::string body;
+    std::string contentType;
+    std::string accept;
+
+    /**
+     * The payload spilled to disk instead of the body, empty if none. Shared
+     * by the copies of the request, the file is released with the last one.
+     */
+    std::shared_ptr<const char> spilledPayload;
+    size_t spilledPayloadSize = 0;
+
+    /** @return the payload, in the body unless it was spilled to disk. */
+    const char* getPayload() const
+    {
+        return spilledPayload ? spilledPayload.get() : body.data();
+    }
+
+    /** @return the size of the payload in bytes. */
+    size_t getPayloadSize() const
+    {
+        return spilledPayload ? spilledPayloadSize : body.size();
+    }
 };
 }
 }
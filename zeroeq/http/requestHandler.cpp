@@ -7,13 +7,26 @@
 
 #include "requestHandler.h"
 
+#include <zeroeq/defines.h>
 #include <zeroeq/log.h>
 #include <zeroeq/uri.h>
 
 #include <zmq.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <future>
 #include <memory> // shared_from_this
+#include <sstream>
 #include <stdexcept>
 
 namespace zeroeq
@@ -22,16 +35,94 @@ namespace http
 {
 namespace
 {
-int _getContentLength(const HTTPServer::request& request)
+// upper limit for preallocating the body from the announced Content-Length
+const size_t maxBodyReserve = 64 * 1024 * 1024;
+
+// size of the slices of served files handed to cppnetlib at once
+const size_t fileSliceSize = 256 * 1024;
+
+// delays before asking a stream producer which had nothing to send again
+const std::chrono::milliseconds minStreamDelay(1);
+const std::chrono::milliseconds maxStreamDelay(64);
+
+size_t _getContentLength(const HTTPServer::request& request)
 {
     for (const auto& i : request.headers)
     {
         if (i.name == "Content-Length")
-            return std::stoi(i.value);
+            return std::stoull(i.value);
     }
     return 0;
 }
 
+#ifndef _WIN32
+// Large request payload, written to an unlinked temporary file and mapped
+// read-only once it has been received completely.
+class SpillFile
+{
+public:
+    SpillFile()
+    {
+        const char* tmpDir = ::getenv("TMPDIR");
+        std::string path(tmpDir && *tmpDir ? tmpDir : "/tmp");
+        path.append("/zeroeqXXXXXX");
+        _fd = ::mkstemp(&path[0]);
+        if (_fd != -1)
+            ::unlink(path.c_str());
+    }
+
+    ~SpillFile()
+    {
+        if (_data)
+            ::munmap(_data, _size);
+        if (_fd != -1)
+            ::close(_fd);
+    }
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    bool isOpen() const { return _fd != -1; }
+
+    bool write(const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            const auto written = ::write(_fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += written;
+            size -= size_t(written);
+            _size += size_t(written);
+        }
+        return true;
+    }
+
+    /** @return the mapped file content, nullptr on error. */
+    const char* map()
+    {
+        if (!_data && _size > 0)
+        {
+            void* data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (data != MAP_FAILED)
+                _data = data;
+        }
+        return static_cast<const char*>(_data);
+    }
+
+    size_t getSize() const { return _size; }
+
+private:
+    int _fd = -1;
+    void* _data = nullptr;
+    size_t _size = 0;
+};
+#endif
+
 Method _getMethodType(const std::string& methodName)
 {
     if (methodName == "GET")
@@ -49,75 +140,218 @@ Method _getMethodType(const std::string& methodName)
     throw std::invalid_argument("Method not supported");
 }
 
-std::string _headerEnumToString(const Header header)
+// The header names are only built once, they are copied into the response
+// headers of each request.
+const std::string& _headerEnumToString(const Header header)
 {
-    switch (header)
-    {
-    case Header::ALLOW:
-        return "Allow";
-    case Header::CONTENT_TYPE:
-        return "Content-Type";
-    case Header::LAST_MODIFIED:
-        return "Last-Modified";
-    case Header::LOCATION:
-        return "Location";
-    case Header::RETRY_AFTER:
-        return "Retry-After";
-    default:
+    // in the order of the Header enum
+    static const std::string names[] = {
+        "Allow",         "Content-Type",     "Last-Modified",
+        "Location",      "Retry-After",      "Accept-Ranges",
+        "Cache-Control", "Content-Encoding", "Content-Range",
+        "ETag",          "Upgrade",          "Vary"};
+    const auto index = size_t(header);
+    if (index >= sizeof(names) / sizeof(names[0]))
         throw std::logic_error("no such header");
-    }
+    return names[index];
 }
 
-std::string _headerEnumToString(const CorsResponseHeader header)
+const std::string& _headerEnumToString(const CorsResponseHeader header)
 {
-    switch (header)
-    {
-    case CorsResponseHeader::access_control_allow_headers:
-        return "Access-Control-Allow-Headers";
-    case CorsResponseHeader::access_control_allow_methods:
-        return "Access-Control-Allow-Methods";
-    case CorsResponseHeader::access_control_allow_origin:
-        return "Access-Control-Allow-Origin";
-    default:
+    // in the order of the CorsResponseHeader enum
+    static const std::string names[] = {"Access-Control-Allow-Headers",
+                                        "Access-Control-Allow-Methods",
+                                        "Access-Control-Allow-Origin"};
+    const auto index = size_t(header);
+    if (index >= sizeof(names) / sizeof(names[0]))
         throw std::logic_error("no such header");
+    return names[index];
+}
+
+enum class RangeResult
+{
+    ignored,      // no or unsupported Range header, serve the full body
+    satisfiable,  // serve the given range with 206
+    unsatisfiable // reply 416
+};
+
+// Parse a single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range
+// for a body of the given size. Multiple ranges are not supported and ignored,
+// which is valid as per RFC 7233.
+RangeResult _parseRange(const std::string& value, const size_t size,
+                        size_t& first, size_t& last)
+{
+    const std::string unit = "bytes=";
+    if (value.compare(0, unit.size(), unit) != 0 ||
+        value.find(',') != std::string::npos)
+    {
+        return RangeResult::ignored;
+    }
+
+    const auto spec = value.substr(unit.size());
+    const auto dash = spec.find('-');
+    if (dash == std::string::npos ||
+        spec.find_first_not_of("0123456789-") != std::string::npos)
+    {
+        return RangeResult::ignored;
     }
+
+    const auto firstStr = spec.substr(0, dash);
+    const auto lastStr = spec.substr(dash + 1);
+    try
+    {
+        if (firstStr.empty()) // suffix range: last n bytes
+        {
+            if (lastStr.empty())
+                return RangeResult::ignored;
+            const size_t suffix = std::stoull(lastStr);
+            if (suffix == 0 || size == 0)
+                return RangeResult::unsatisfiable;
+            first = suffix < size ? size - suffix : 0;
+            last = size - 1;
+            return RangeResult::satisfiable;
+        }
+
+        first = std::stoull(firstStr);
+        last = lastStr.empty() ? size - 1 : size_t(std::stoull(lastStr));
+    }
+    catch (const std::out_of_range&)
+    {
+        return RangeResult::ignored;
+    }
+
+    if (!lastStr.empty() && last < first)
+        return RangeResult::ignored;
+    if (first >= size)
+        return RangeResult::unsatisfiable;
+    last = std::min(last, size - 1);
+    return RangeResult::satisfiable;
+}
+
+// The connection of the current I/O thread to the zeroeq::http::Server
+// thread, if connected by RequestHandler::connectThread(). An I/O thread only
+// serves a single RequestHandler.
+thread_local const RequestHandler* threadHandler = nullptr;
+thread_local void* threadSocket = nullptr;
+
+// 304 Not Modified responses have no body, but a Content-Length would announce
+// the size of the unchanged resource, not 0 (RFC 7230, section 3.3.2).
+bool _hasContentLength(const Code code)
+{
+    return code != Code::NOT_MODIFIED;
+}
+
+// Frame a chunk of a response using chunked transfer encoding, with the final
+// empty chunk appended if it is the last one.
+std::string _frameChunk(const std::string& chunk, const bool last)
+{
+    std::ostringstream frame;
+    if (!chunk.empty())
+        frame << std::hex << chunk.size() << "\r\n" << chunk << "\r\n";
+    if (last)
+        frame << "0\r\n\r\n";
+    return frame.str();
 }
 
 // The actual handler for each incoming request where the data is read from
 // a dedicated connection to the client.
 struct ConnectionHandler : std::enable_shared_from_this<ConnectionHandler>
 {
-    ConnectionHandler(const HTTPServer::request& request, void* socket)
+    ConnectionHandler(const HTTPServer::request& request,
+                      RequestHandler& handler, Compressor& compressor,
+                      const size_t maxBodySize, const size_t bodySpillSize)
         : _request(request)
-        , _socket(socket)
+        , _handler(handler)
+        , _compressor(compressor)
+        , _maxBodySize(maxBodySize)
+        , _bodySpillSize(bodySpillSize)
     {
+        // cppnetlib serves one request per connection
+        ++_handler.getConnectionCounters().opened;
     }
 
+    ~ConnectionHandler() { ++_handler.getConnectionCounters().closed; }
+
     void operator()(HTTPServer::connection_ptr connection)
     {
         try
         {
             const auto method = _getMethodType(_request.method);
+
+            // shed load before reading the payload
+            const auto path = URI(_request.destination).getPath();
+            const auto retryAfter = _handler.admit(_request.source, path);
+            if (retryAfter > 0)
+            {
+                _reply(connection, Code::SERVICE_UNAVAILABLE, retryAfter);
+                return;
+            }
+
             if (method != Method::GET)
             {
                 _size = _getContentLength(_request);
+                if (_maxBodySize > 0 && _size > _maxBodySize)
+                {
+                    _reply(connection, Code::PAYLOAD_TOO_LARGE);
+                    return;
+                }
+
                 // if we have payload, schedule an (async) read of all chunks.
                 // Will call _handleRequest() after all data has been read.
                 if (_size > 0)
                 {
+                    _prepareBody();
                     _readChunk(connection, method);
                     return;
                 }
             }
+            if (method == Method::GET && _serveFile(connection))
+                return;
             _handleRequest(method, connection);
         }
         catch (const std::invalid_argument&)
         {
             connection->set_status(HTTPServer::connection::not_supported);
         }
+        catch (const std::out_of_range&)
+        {
+            _reply(connection, Code::PAYLOAD_TOO_LARGE);
+        }
     }
 
 private:
+    // Reply with an empty body without reading the payload, cppnetlib closes
+    // the connection afterwards.
+    void _reply(HTTPServer::connection_ptr connection, const Code code,
+                const uint32_t retryAfter = 0)
+    {
+        std::vector<HTTPServer::response_header> headers{
+            {"Content-Length", "0"}};
+        if (retryAfter > 0)
+            headers.push_back({_headerEnumToString(Header::RETRY_AFTER),
+                               std::to_string(retryAfter)});
+        connection->set_status(HTTPServer::connection::status_t(code));
+        connection->set_headers(headers);
+        connection->write(std::string());
+    }
+
+    void _prepareBody()
+    {
+#ifndef _WIN32
+        if (_bodySpillSize > 0 && _size > _bodySpillSize)
+        {
+            _spillFile = std::make_shared<SpillFile>();
+            if (_spillFile->isOpen())
+                return;
+
+            ZEROEQWARN << "Cannot create temporary file for request payload: "
+                       << std::strerror(errno) << std::endl;
+            _spillFile.reset();
+        }
+#endif
+        _body.reserve(std::min(_size, maxBodyReserve));
+    }
+
     void _readChunk(HTTPServer::connection_ptr connection, const Method method)
     {
         namespace pl = std::placeholders;
@@ -139,8 +373,18 @@ private:
         }
         if (size > 0)
         {
-            _body.append(&range[0], size);
-            _size -= size;
+#ifndef _WIN32
+            if (_spillFile && !_spillFile->write(&range[0], size))
+            {
+                ZEROEQWARN << "Cannot write request payload to disk: "
+                           << std::strerror(errno) << std::endl;
+                _reply(connection, Code::SPACE_UNAVAILABLE);
+                return;
+            }
+            if (!_spillFile)
+#endif
+                _body.append(&range[0], size);
+            _size -= std::min(size, _size);
         }
         if (_size > 0)
             _readChunk(connection, method_);
@@ -157,31 +401,243 @@ private:
         const auto uri = URI(_request.destination);
         message.request.path = uri.getPath();
         message.request.query = uri.getQuery();
-        message.request.body.swap(_body);
+        if (!_setPayload(message.request))
+        {
+            _reply(connection, Code::INTERNAL_SERVER_ERROR);
+            return;
+        }
+        _parseContentHeaders(message);
         _parseCorsRequestHeaders(message);
+        message.webSocketUpgrade =
+            method == Method::GET && _isWebSocketUpgrade();
+        _process(message);
+        _corsResponseHeaders = message.corsResponseHeaders;
 
-        void* messagePtr = &message;
-        zmq_send(_socket, &messagePtr, sizeof(void*), 0);
-        bool done;
-        zmq_recv(_socket, &done, sizeof(done), 0);
+        // the response is completed later by the zeroeq::http::Server, e.g.
+        // for long-poll requests, don't block this thread meanwhile. It may
+        // be completed on any thread, the compression and the write are
+        // done on the I/O threads.
+        if (message.pending)
+        {
+            _pendingResponse = std::move(message.response);
+            auto self = ConnectionHandler::shared_from_this();
+            const auto route = message.route;
+            message.pending->onReady([self, method, connection, route] {
+                self->_handler.getIOService().post(
+                    [self, method, connection, route] {
+                        auto response =
+                            self->_handler.takeResponse(self->_pendingResponse,
+                                                        route);
+                        self->_writeResponse(method, response, connection);
+                    });
+            });
+            return;
+        }
 
-        Response response;
-        try
+        auto response = _handler.takeResponse(message.response, message.route);
+        if (response.stream)
+        {
+            _writeStream(response, connection);
+            return;
+        }
+
+        if (message.eventStream && response.code == Code::OK)
+        {
+            _writeEventStream(response, *message.eventStream, connection);
+            return;
+        }
+
+        if (message.webSocket && response.code == Code::SWITCHING_PROTOCOLS)
+        {
+            _upgradeWebSocket(message, connection);
+            return;
+        }
+
+        _writeResponse(method, response, connection);
+    }
+
+    void _writeResponse(const Method method, Response& response,
+                        HTTPServer::connection_ptr connection)
+    {
+        // compression is done here to not block the zeroeq::http::Server
+        // thread, only the unmodified GET resources are worth caching
+        static const std::string noCacheKey;
+        const bool cacheable = method == Method::GET && response.code == OK;
+        _compressor.encode(response, _getHeader("Accept-Encoding"),
+                           cacheable ? _request.destination : noCacheKey);
+
+        // the range applies to the encoded body, the slice to be sent is
+        // written without copying the body
+        size_t first = 0;
+        size_t last = response.body.size() - 1;
+        if (cacheable)
+            _applyRange(response, response.body.size(), first, last);
+        if (cacheable && response.code == Code::OK && !response.body.empty())
+            response.headers[Header::ACCEPT_RANGES] = "bytes";
+        const bool hasBody =
+            !response.body.empty() && _hasContentLength(response.code);
+        const size_t length = hasBody ? last - first + 1 : 0;
+
+        std::vector<HTTPServer::response_header> headers;
+        headers.reserve(1 + _corsResponseHeaders.size() +
+                        response.headers.size());
+        if (_hasContentLength(response.code))
+            headers.push_back({"Content-Length", std::to_string(length)});
+
+        for (const auto& it : _corsResponseHeaders)
+            headers.push_back({_headerEnumToString(it.first), it.second});
+
+        for (const auto& it : response.headers)
+            headers.push_back({_headerEnumToString(it.first), it.second});
+
+        const auto status = HTTPServer::connection::status_t(response.code);
+        connection->set_status(status);
+        connection->set_headers(headers);
+        const char* body = response.body.data();
+        connection->write(boost::make_iterator_range(body + first,
+                                                     body + first + length));
+    }
+
+    // Serve the files of Server::serveDirectory() from this thread, without
+    // going through the zeroeq::http::Server thread. Missing files are left
+    // to the registered endpoints.
+    bool _serveFile(HTTPServer::connection_ptr connection)
+    {
+        std::string path;
+        const auto uri = URI(_request.destination);
+        if (!_handler.getFileServer().resolve(uri.getPath(), path))
+            return false;
+
+        auto file = std::make_shared<StaticFile>(path);
+        if (!file->isOpen())
+            return false;
+
+        Response response(Code::OK);
+        response.headers[Header::CONTENT_TYPE] = getMediaType(path);
+        response.headers[Header::ETAG] = file->getETag();
+        response.headers[Header::LAST_MODIFIED] =
+            formatHTTPDate(file->getModified());
+
+        const size_t size = file->getSize();
+        size_t first = 0;
+        size_t last = size - 1; // unused for empty files
+        if (_isNotModified(response))
+            response.code = Code::NOT_MODIFIED;
+        else if (size > 0)
+            _applyRange(response, size, first, last);
+        if (response.code == Code::OK && size > 0)
+            response.headers[Header::ACCEPT_RANGES] = "bytes";
+        const bool hasBody = size > 0 && (response.code == Code::OK ||
+                                          response.code == PARTIAL_CONTENT);
+        const size_t length = hasBody ? last - first + 1 : 0;
+
+        std::vector<HTTPServer::response_header> headers;
+        headers.reserve(2 + response.headers.size());
+        if (_hasContentLength(response.code))
+            headers.push_back({"Content-Length", std::to_string(length)});
+        for (const auto& it : response.headers)
+            headers.push_back({_headerEnumToString(it.first), it.second});
+        if (!_getHeader("Origin").empty())
         {
-            response = message.response.get();
+            const auto origin = CorsResponseHeader::access_control_allow_origin;
+            headers.push_back({_headerEnumToString(origin), "*"});
         }
-        catch (std::future_error& error)
+
+        const auto status = HTTPServer::connection::status_t(response.code);
+        connection->set_status(status);
+        connection->set_headers(headers);
+        if (length == 0)
+            connection->write(std::string());
+        else
+            _writeFile(file, first, first + length, connection);
+        return true;
+    }
+
+    bool _isNotModified(const Response& response) const
+    {
+        const auto& ifNoneMatch = _getHeader("If-None-Match");
+        if (!ifNoneMatch.empty())
+            return ifNoneMatch == "*" ||
+                   ifNoneMatch.find(response.headers.at(Header::ETAG)) !=
+                       std::string::npos;
+
+        const auto& ifModifiedSince = _getHeader("If-Modified-Since");
+        return !ifModifiedSince.empty() &&
+               ifModifiedSince == response.headers.at(Header::LAST_MODIFIED);
+    }
+
+    // Write the file in slices, each slice is kept until it has been written.
+    // The headers are already sent if the file got truncated meanwhile, so
+    // the connection is left with a short body which the client detects from
+    // Content-Length.
+    void _writeFile(std::shared_ptr<StaticFile> file, const size_t begin,
+                    const size_t end, HTTPServer::connection_ptr connection)
+    {
+        const size_t size = std::min(end - begin, fileSliceSize);
+        auto slice = std::make_shared<std::string>();
+        if (!file->read(begin, size, *slice))
         {
-            response.code = http::Code::INTERNAL_SERVER_ERROR;
-            ZEROEQINFO << "Error during ConnectionHandler::_handleRequest: "
-                       << error.what() << std::endl;
+            ZEROEQINFO << "Error while reading HTTP response file, it was "
+                          "truncated or removed"
+                       << std::endl;
+            return;
         }
+        const char* data = slice->data();
+        namespace pl = std::placeholders;
+        connection->write(boost::make_iterator_range(data, data + size),
+                          std::bind(&ConnectionHandler::_handleFileWritten,
+                                    ConnectionHandler::shared_from_this(),
+                                    pl::_1, file, slice, begin + size, end,
+                                    connection));
+    }
 
+    void _handleFileWritten(const boost::system::error_code& error,
+                            std::shared_ptr<StaticFile> file,
+                            std::shared_ptr<std::string> /*slice*/,
+                            const size_t begin, const size_t end,
+                            HTTPServer::connection_ptr connection)
+    {
+        if (error)
+        {
+            ZEROEQINFO << "Error while writing HTTP response file: "
+                       << error.message() << std::endl;
+            return;
+        }
+        if (begin < end)
+            _writeFile(file, begin, end, connection);
+    }
+
+    bool _setPayload(Request& request)
+    {
+#ifndef _WIN32
+        if (_spillFile)
+        {
+            // the request keeps the file alive while it is mapped
+            const char* data = _spillFile->map();
+            if (data || _spillFile->getSize() == 0)
+            {
+                request.spilledPayload =
+                    std::shared_ptr<const char>(_spillFile, data);
+                request.spilledPayloadSize = _spillFile->getSize();
+                return true;
+            }
+
+            ZEROEQWARN << "Cannot map request payload: "
+                       << std::strerror(errno) << std::endl;
+            return false;
+        }
+#endif
+        request.body.swap(_body);
+        return true;
+    }
+
+    void _writeChunkedHeaders(const Response& response,
+                              HTTPServer::connection_ptr connection)
+    {
         std::vector<HTTPServer::response_header> headers;
-        headers.push_back(
-            {"Content-Length", std::to_string(response.body.length())});
+        headers.push_back({"Transfer-Encoding", "chunked"});
 
-        for (const auto& it : message.corsResponseHeaders)
+        for (const auto& it : _corsResponseHeaders)
             headers.push_back({_headerEnumToString(it.first), it.second});
 
         for (const auto& it : response.headers)
@@ -190,7 +646,303 @@ private:
         const auto status = HTTPServer::connection::status_t(response.code);
         connection->set_status(status);
         connection->set_headers(headers);
-        connection->write(response.body);
+    }
+
+    void _writeStream(Response& response, HTTPServer::connection_ptr connection)
+    {
+        _writeChunkedHeaders(response, connection);
+        _stream = std::move(response.stream);
+        _writeChunk(connection);
+    }
+
+    void _process(Message& message) { _handler.process(message); }
+
+    // Keep the connection open for the events pushed to the stream. The queue
+    // owns this handler until the stream or the connection is closed, writes
+    // are started by the pushing thread if no write is pending.
+    void _writeEventStream(const Response& response, EventStream& stream,
+                           HTTPServer::connection_ptr connection)
+    {
+        _writeChunkedHeaders(response, connection);
+
+        auto self = ConnectionHandler::shared_from_this();
+        _queue = stream.addClient(
+            [self, connection] { self->_writeQueued(connection); });
+
+        // send the headers right away, the client is connected
+        _writeQueuedData(": connected\n\n", connection);
+    }
+
+    // Switch the connection to the WebSocket protocol (RFC 6455). Like for
+    // event streams, the queue of the hub owns this handler, in addition to
+    // the pending read of the next frames.
+    void _upgradeWebSocket(const Message& message,
+                           HTTPServer::connection_ptr connection)
+    {
+#ifdef ZEROEQ_USE_ZLIB
+        const bool deflate =
+            _compressor.getThreshold() > 0 &&
+            offersPerMessageDeflate(_getHeader("Sec-WebSocket-Extensions"));
+#else
+        const bool deflate = false;
+#endif
+        const auto key = _getHeader("Sec-WebSocket-Key");
+        std::vector<HTTPServer::response_header> headers{
+            {"Upgrade", "websocket"},
+            {"Connection", "Upgrade"},
+            {"Sec-WebSocket-Accept", computeWebSocketAccept(key)}};
+        // every message is compressed on its own, no sliding window is kept
+        // between messages in both directions
+        if (deflate)
+            headers.push_back({"Sec-WebSocket-Extensions",
+                               "permessage-deflate; server_no_context_takeover;"
+                               " client_no_context_takeover"});
+
+        const auto status =
+            HTTPServer::connection::status_t(Code::SWITCHING_PROTOCOLS);
+        connection->set_status(status);
+        connection->set_headers(headers);
+
+        _decoder.reset(new WebSocketDecoder(deflate, _maxBodySize));
+        auto self = ConnectionHandler::shared_from_this();
+        _queue = message.webSocket->addClient(
+            message.webSocketQueueSize, deflate,
+            [self, connection] { self->_writeQueued(connection); });
+
+        _writeQueuedData(std::string(), connection); // send the headers
+        _readWebSocket(connection);
+    }
+
+    void _readWebSocket(HTTPServer::connection_ptr connection)
+    {
+        namespace pl = std::placeholders;
+        connection->read(std::bind(&ConnectionHandler::_handleWebSocketData,
+                                   ConnectionHandler::shared_from_this(),
+                                   pl::_1, pl::_2, pl::_3, connection));
+    }
+
+    void _handleWebSocketData(HTTPServer::connection::input_range range,
+                              const boost::system::error_code error,
+                              const size_t size,
+                              HTTPServer::connection_ptr connection)
+    {
+        if (error)
+        {
+            ZEROEQINFO << "Closing WebSocket connection: " << error.message()
+                       << std::endl;
+            _queue->close();
+            return;
+        }
+
+        const auto onMessage = [this](const std::string& data) {
+            Message message;
+            message.webSocketMessage = true;
+            message.request.method = Method::POST;
+            message.request.source = _request.source;
+            message.request.path = URI(_request.destination).getPath();
+            message.request.body = data;
+            _process(message);
+        };
+        const auto onControl = [this](const Opcode opcode,
+                                      const std::string& payload) {
+            if (opcode == Opcode::ping)
+                _queue->push(std::string(),
+                             encodeWebSocketFrame(Opcode::pong, payload));
+            else if (opcode == Opcode::close)
+                _closeWebSocket(payload.size() >= 2 ? payload.substr(0, 2)
+                                                    : std::string());
+        };
+
+        if (size > 0 &&
+            !_decoder->decode(&range[0], size, onMessage, onControl))
+        {
+            _closeWebSocket(encodeClosePayload(_decoder->getCloseCode()));
+        }
+
+        if (!_closing)
+            _readWebSocket(connection);
+    }
+
+    // Send the close frame, the connection is closed after it has been written
+    void _closeWebSocket(const std::string& payload)
+    {
+        if (_closing)
+            return;
+        _closing = true;
+        _queue->push(std::string(),
+                     encodeWebSocketFrame(Opcode::close, payload));
+    }
+
+    void _writeQueued(HTTPServer::connection_ptr connection)
+    {
+        const auto data = _queue->take();
+        if (!data.empty())
+            _writeQueuedData(data, connection);
+        else if (_closing)
+            _queue->close();
+    }
+
+    void _writeQueuedData(const std::string& data,
+                          HTTPServer::connection_ptr connection)
+    {
+        namespace pl = std::placeholders;
+        const auto callback =
+            std::bind(&ConnectionHandler::_handleQueuedWritten,
+                      ConnectionHandler::shared_from_this(), pl::_1,
+                      connection);
+        try
+        {
+            // WebSocket frames are written as is, events as chunks
+            connection->write(_decoder ? data : _frameChunk(data, false),
+                              callback);
+        }
+        catch (const std::exception& e)
+        {
+            ZEROEQINFO << "Closing connection: " << e.what() << std::endl;
+            _queue->close();
+        }
+    }
+
+    void _handleQueuedWritten(const boost::system::error_code& error,
+                              HTTPServer::connection_ptr connection)
+    {
+        if (error)
+        {
+            ZEROEQINFO << "Closing connection: " << error.message()
+                       << std::endl;
+            _queue->close();
+            return;
+        }
+        _writeQueued(connection);
+    }
+
+    // Write the next chunk of a streamed response, the following one is
+    // produced once cppnetlib has written this one to obey backpressure.
+    void _writeChunk(HTTPServer::connection_ptr connection)
+    {
+        std::string chunk;
+        bool last = false;
+        try
+        {
+            last = !_stream(chunk);
+        }
+        catch (const std::exception& e)
+        {
+            // abort the stream, the client detects the missing last chunk
+            ZEROEQWARN << "Error during ConnectionHandler::_writeChunk: "
+                       << e.what() << std::endl;
+            return;
+        }
+
+        // empty chunks would terminate the chunked encoding prematurely, ask
+        // the producer again later instead
+        if (chunk.empty() && !last)
+        {
+            _retryChunk(connection);
+            return;
+        }
+        _streamDelay = minStreamDelay;
+
+        namespace pl = std::placeholders;
+        connection->write(_frameChunk(chunk, last),
+                          std::bind(&ConnectionHandler::_handleChunkWritten,
+                                    ConnectionHandler::shared_from_this(),
+                                    pl::_1, connection, last));
+    }
+
+    // Wait before asking the producer for the next chunk again, doubling the
+    // delay while it has nothing to send.
+    void _retryChunk(HTTPServer::connection_ptr connection)
+    {
+        if (!_streamTimer)
+            _streamTimer.reset(
+                new boost::asio::steady_timer(_handler.getIOService()));
+        _streamTimer->expires_from_now(_streamDelay);
+        _streamDelay = std::min(_streamDelay * 2, maxStreamDelay);
+
+        auto self = ConnectionHandler::shared_from_this();
+        _streamTimer->async_wait(
+            [self, connection](const boost::system::error_code& error) {
+                if (!error)
+                    self->_writeChunk(connection);
+            });
+    }
+
+    void _handleChunkWritten(const boost::system::error_code& error,
+                             HTTPServer::connection_ptr connection,
+                             const bool last)
+    {
+        if (error)
+        {
+            ZEROEQINFO << "Error while writing HTTP response chunk: "
+                       << error.message() << std::endl;
+            return;
+        }
+        if (!last)
+            _writeChunk(connection);
+    }
+
+    // Turn a complete response into a 206 Partial Content or a 416 Range Not
+    // Satisfiable response for a Range request, updates the range to send.
+    void _applyRange(Response& response, const size_t size, size_t& first,
+                     size_t& last)
+    {
+        const auto& range = _getHeader("Range");
+        if (range.empty() || response.headers.count(Header::CONTENT_RANGE))
+            return;
+
+        // If-Range: only send the range if the resource is unchanged, as told
+        // by a strong ETag or the modification date (RFC 7233, section 3.2)
+        const auto& ifRange = _getHeader("If-Range");
+        if (!ifRange.empty() && !_matchesIfRange(response, ifRange))
+            return;
+
+        size_t rangeFirst = 0;
+        size_t rangeLast = 0;
+        switch (_parseRange(range, size, rangeFirst, rangeLast))
+        {
+        case RangeResult::satisfiable:
+            response.code = Code::PARTIAL_CONTENT;
+            response.headers[Header::CONTENT_RANGE] =
+                "bytes " + std::to_string(rangeFirst) + "-" +
+                std::to_string(rangeLast) + "/" + std::to_string(size);
+            first = rangeFirst;
+            last = rangeLast;
+            return;
+        case RangeResult::unsatisfiable:
+            response = Response(Code::UNSATISFIABLE_RANGE);
+            response.headers[Header::CONTENT_RANGE] =
+                "bytes */" + std::to_string(size);
+            first = 0;
+            last = 0;
+            return;
+        case RangeResult::ignored:
+        default:
+            return;
+        }
+    }
+
+    static bool _matchesIfRange(const Response& response,
+                                const std::string& ifRange)
+    {
+        const bool weak = ifRange.compare(0, 2, "W/") == 0;
+        const bool isETag = weak || ifRange.front() == '"';
+        const auto header = isETag ? Header::ETAG : Header::LAST_MODIFIED;
+        const auto value = response.headers.find(header);
+        if (value == response.headers.end() || value->second != ifRange)
+            return false;
+        return !weak; // weak validators never match
+    }
+
+    void _parseContentHeaders(Message& message)
+    {
+        for (const auto& header : _request.headers)
+        {
+            if (header.name == "Content-Type")
+                message.request.contentType = header.value;
+            else if (header.name == "Accept")
+                message.request.accept = header.value;
+        }
     }
 
     void _parseCorsRequestHeaders(Message& message)
@@ -215,13 +967,74 @@ private:
         }
     }
 
+    bool _isWebSocketUpgrade() const
+    {
+        auto upgrade = _getHeader("Upgrade");
+        std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(),
+                       ::tolower);
+        return upgrade.find("websocket") != std::string::npos &&
+               !_getHeader("Sec-WebSocket-Key").empty() &&
+               _getHeader("Sec-WebSocket-Version") == "13";
+    }
+
+    const std::string& _getHeader(const char* name) const
+    {
+        static const std::string none;
+        for (const auto& header : _request.headers)
+        {
+            if (header.name == name)
+                return header.value;
+        }
+        return none;
+    }
+
     const HTTPServer::request& _request;
-    void* _socket;
+    RequestHandler& _handler;
+    Compressor& _compressor;
+    const size_t _maxBodySize;
+    const size_t _bodySpillSize;
     std::string _body;
-    int _size = 0;
+#ifndef _WIN32
+    std::shared_ptr<SpillFile> _spillFile;
+#endif
+    size_t _size = 0;
+    std::map<CorsResponseHeader, std::string> _corsResponseHeaders;
+    std::future<Response> _pendingResponse;
+    StreamFunc _stream;
+    std::unique_ptr<boost::asio::steady_timer> _streamTimer;
+    std::chrono::milliseconds _streamDelay{minStreamDelay};
+    SendQueuePtr _queue; // of event stream and WebSocket connections
+    std::unique_ptr<WebSocketDecoder> _decoder;
+    std::atomic<bool> _closing{false}; // WebSocket close frame queued
 };
 } // anonymous namespace
 
+const std::string& toString(const Header header)
+{
+    return _headerEnumToString(header);
+}
+
+const std::string& toString(const CorsResponseHeader header)
+{
+    return _headerEnumToString(header);
+}
+
+Method toMethod(const std::string& name)
+{
+    return _getMethodType(name);
+}
+
+const std::string& toString(const Method method)
+{
+    // in the order of the Method enum
+    static const std::string names[] = {"GET",    "POST",   "PUT",
+                                        "PATCH",  "DELETE", "OPTIONS"};
+    const auto index = size_t(method);
+    if (index >= sizeof(names) / sizeof(names[0]))
+        throw std::logic_error("no such method");
+    return names[index];
+}
+
 RequestHandler::RequestHandler(const std::string& zmqURL)
     : _context(detail::getContext())
     , _socket(zmq_socket(_context.get(), ZMQ_PAIR))
@@ -235,9 +1048,119 @@ RequestHandler::RequestHandler(const std::string& zmqURL)
 
 RequestHandler::~RequestHandler()
 {
+    for (void* socket : _threadSockets)
+        zmq_close(socket);
     zmq_close(_socket);
 }
 
+void RequestHandler::setCompressionThreshold(const size_t size)
+{
+    _compressor.setThreshold(size);
+}
+
+size_t RequestHandler::getCompressionThreshold() const
+{
+    return _compressor.getThreshold();
+}
+
+void RequestHandler::setMaxBodySize(const size_t size)
+{
+    _maxBodySize = size;
+}
+
+void RequestHandler::setBodySpillSize(const size_t size)
+{
+    _bodySpillSize = size;
+}
+
+void RequestHandler::setKeepAlive(const uint32_t timeout,
+                                  const size_t maxRequests)
+{
+    _keepAliveTimeout = timeout;
+    _maxKeepAliveRequests = maxRequests;
+}
+
+void RequestHandler::connectThread(const std::string& zmqURL)
+{
+    void* socket = zmq_socket(_context.get(), ZMQ_PAIR);
+    if (zmq_connect(socket, zmqURL.c_str()) == -1)
+    {
+        zmq_close(socket);
+        ZEROEQTHROW(std::runtime_error(
+            "Cannot connect RequestHandler to inproc socket"));
+    }
+
+    std::lock_guard<std::mutex> lock(_threadSocketsMutex);
+    _threadSockets.push_back(socket);
+    threadHandler = this;
+    threadSocket = socket;
+}
+
+uint32_t RequestHandler::admit(const std::string& source,
+                               const std::string& path)
+{
+    const size_t maxQueued = _maxQueuedRequests;
+    if (maxQueued > 0 && _queuedRequests >= maxQueued)
+        return 1;
+    return _rateLimiter.acquire(source, path.empty() ? path : path.substr(1));
+}
+
+void RequestHandler::process(Message& message)
+{
+    // each I/O thread uses its own connection, as zmq sockets are not
+    // thread safe
+    void* socket = threadHandler == this ? threadSocket : _socket;
+    if (_metrics.isEnabled())
+    {
+        message.received = ServerMetrics::Clock::now();
+        _metrics.countRequest(message.request.getPayloadSize());
+    }
+
+    // queued before the handover, so that admit() already counts it while the
+    // handler runs
+    ++_queuedRequests;
+    void* messagePtr = &message;
+    zmq_send(socket, &messagePtr, sizeof(void*), 0);
+    bool done;
+    zmq_recv(socket, &done, sizeof(done), 0);
+    if (!message.response.valid())
+        --_queuedRequests;
+}
+
+Response RequestHandler::takeResponse(std::future<Response>& response,
+                                      const RouteMetricsPtr& route)
+{
+    // dequeued on every path, a leaked request would block admit() forever
+    struct Dequeue
+    {
+        std::atomic<size_t>* queued; // null if not counted by process()
+        ~Dequeue()
+        {
+            if (queued)
+                --*queued;
+        }
+    } dequeue{response.valid() ? &_queuedRequests : nullptr};
+
+    Response result(http::Code::INTERNAL_SERVER_ERROR);
+    try
+    {
+        result = response.get();
+    }
+    catch (const std::exception& error)
+    {
+        ZEROEQINFO << "Error during RequestHandler::takeResponse: "
+                   << error.what() << std::endl;
+    }
+    catch (...)
+    {
+        ZEROEQINFO << "Unknown error during RequestHandler::takeResponse"
+                   << std::endl;
+    }
+    if (route)
+        route->countResponse(result.code, result.body.size());
+    return result;
+}
+
 void RequestHandler::operator()(const HTTPServer::request& request,
                                 HTTPServer::connection_ptr connection)
 {
@@ -246,7 +1169,8 @@ void RequestHandler::operator()(const HTTPServer::request& request,
     // a shared instance of the handler object that is passed to cppnetlib for
     // processing the request.
     std::shared_ptr<ConnectionHandler> connectionHandler(
-        new ConnectionHandler(request, _socket));
+        new ConnectionHandler(request, *this, _compressor, _maxBodySize,
+                              _bodySpillSize));
     (*connectionHandler)(connection);
 }
 }
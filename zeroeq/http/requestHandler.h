@@ -11,10 +11,21 @@
 #include <zeroeq/http/request.h>  // member
 #include <zeroeq/http/response.h> // member
 
+#include "compression.h" // member
+#include "eventStream.h"     // EventStreamPtr member
+#include "fileServer.h"      // member
+#include "metrics.h"         // member
+#include "pendingResponse.h" // PendingResponsePtr member
+#include "rateLimiter.h"     // member
+#include "webSocket.h"       // WebSocketHubPtr member
+
 #include <zeroeq/detail/context.h>
 
 #include <boost/network/protocol/http/server.hpp>
+#include <atomic>
 #include <future>
+#include <mutex>
+#include <vector>
 
 namespace zeroeq
 {
@@ -31,6 +42,21 @@ enum class CorsResponseHeader
     access_control_allow_origin
 };
 
+/** @return the name of the given header, e.g. "Content-Type". */
+const std::string& toString(Header header);
+
+/** @return the name of the given CORS header. */
+const std::string& toString(CorsResponseHeader header);
+
+/**
+ * @return the method with the given name, e.g. "GET".
+ * @throw std::invalid_argument for unsupported methods
+ */
+Method toMethod(const std::string& name);
+
+/** @return the name of the given method, e.g. "GET". */
+const std::string& toString(Method method);
+
 // Contains in/out values for an HTTP request to exchange information between
 // cppnetlib and zeroeq::http::Server
 struct Message
@@ -46,8 +72,41 @@ struct Message
     // output from zeroeq::http::Server
     std::future<Response> response;
 
+    // output from zeroeq::http::Server, set if the response is completed
+    // later than the processing of the request
+    PendingResponsePtr pending;
+
     // output from zeroeq::http::Server, internal for CORS responses
     std::map<CorsResponseHeader, std::string> corsResponseHeaders;
+
+    // output from zeroeq::http::Server, the stream to connect the client to
+    // for requests on event stream endpoints
+    EventStreamPtr eventStream;
+
+    // input from cppnetlib, internal for WebSocket upgrade requests and for
+    // the messages received on WebSocket connections in request.body
+    bool webSocketUpgrade = false;
+    bool webSocketMessage = false;
+
+    // output from zeroeq::http::Server, the hub to connect an upgraded
+    // WebSocket connection to, with its maximum number of queued messages
+    WebSocketHubPtr webSocket;
+    size_t webSocketQueueSize = 0;
+
+    // input from cppnetlib if metrics are enabled, the time of process()
+    ServerMetrics::Clock::time_point received;
+
+    // output from zeroeq::http::Server if metrics are enabled, the route
+    // counting the response
+    RouteMetricsPtr route;
+};
+
+// Connection counters of all listeners, see Server::getConnectionStats()
+struct ConnectionCounters
+{
+    std::atomic<uint64_t> opened{0};
+    std::atomic<uint64_t> reused{0};
+    std::atomic<uint64_t> closed{0};
 };
 
 // The handler class called for each incoming HTTP request from cppnetlib
@@ -66,9 +125,119 @@ public:
     void operator()(const HTTPServer::request& request,
                     HTTPServer::connection_ptr connection);
 
+    /** @sa Server::setCompressionThreshold() */
+    void setCompressionThreshold(size_t size);
+
+    /** @return the current compression threshold. */
+    size_t getCompressionThreshold() const;
+
+    /** @sa Server::setMaxBodySize() */
+    void setMaxBodySize(size_t size);
+
+    /** @return the current maximum request body size, 0 for no limit. */
+    size_t getMaxBodySize() const { return _maxBodySize; }
+
+    /** @sa Server::setBodySpillSize() */
+    void setBodySpillSize(size_t size);
+
+    /** @return the compressor shared by all connections. */
+    Compressor& getCompressor() { return _compressor; }
+
+    /** @return the directories served from the cppnetlib threads. */
+    FileServer& getFileServer() { return _fileServer; }
+
+    /** Set the I/O service of the cppnetlib server, which runs its timers. */
+    void setIOService(boost::asio::io_service& ioService)
+    {
+        _ioService = &ioService;
+    }
+
+    /** @return the I/O service of the cppnetlib server. */
+    boost::asio::io_service& getIOService() { return *_ioService; }
+
+    /**
+     * Connect the calling I/O thread to the zeroeq::http::Server thread with
+     * its own socket, before it handles any request. The I/O threads which
+     * are not connected share the socket given in the constructor, which is
+     * only valid for a single thread.
+     *
+     * @param zmqURL URL to the inproc socket for this thread
+     */
+    void connectThread(const std::string& zmqURL);
+
+    /** @sa Server::setKeepAlive() */
+    void setKeepAlive(uint32_t timeout, size_t maxRequests);
+
+    /** @return the idle time in ms before a connection is closed. */
+    uint32_t getKeepAliveTimeout() const { return _keepAliveTimeout; }
+
+    /** @return the number of requests per connection, 0 for no limit. */
+    size_t getMaxKeepAliveRequests() const { return _maxKeepAliveRequests; }
+
+    /** @return the counters updated by the listeners. */
+    ConnectionCounters& getConnectionCounters() { return _connectionCounters; }
+    const ConnectionCounters& getConnectionCounters() const
+    {
+        return _connectionCounters;
+    }
+
+    /** @return the request metrics updated by process() and takeResponse(). */
+    ServerMetrics& getMetrics() { return _metrics; }
+    const ServerMetrics& getMetrics() const { return _metrics; }
+
+    /** @return the number of processed requests not answered yet. */
+    size_t getQueuedRequests() const { return _queuedRequests; }
+
+    /** @return the rate limits checked by admit(). */
+    RateLimiter& getRateLimiter() { return _rateLimiter; }
+
+    /** @sa Server::setMaxQueuedRequests() */
+    void setMaxQueuedRequests(size_t count) { _maxQueuedRequests = count; }
+
+    /**
+     * Check the rate limits of the client and the number of queued requests
+     * before reading the request payload.
+     *
+     * @param source the client, see Request::source
+     * @param path the request path
+     * @return 0 if the request is admitted, otherwise the number of seconds
+     *         for the Retry-After header of the 503 response
+     */
+    uint32_t admit(const std::string& source, const std::string& path);
+
+    /**
+     * Hand a message to the zeroeq::http::Server thread, and wait until it
+     * has been processed during receive(). Must be called from an I/O thread.
+     * A request with a response counts as queued until takeResponse().
+     */
+    void process(Message& message);
+
+    /**
+     * @param response the response of a processed message
+     * @param route the metrics to count the response in, see Message::route
+     * @return the response once it is ready, 500 Internal Server Error if it
+     *         holds an exception.
+     */
+    Response takeResponse(std::future<Response>& response,
+                          const RouteMetricsPtr& route = RouteMetricsPtr());
+
 private:
     zmq::ContextPtr _context;
     void* _socket;
+    std::mutex _threadSocketsMutex;
+    std::vector<void*> _threadSockets; // of connectThread(), for cleanup
+    boost::asio::io_service* _ioService = nullptr;
+    Compressor _compressor;
+    FileServer _fileServer;
+    std::atomic<size_t> _maxBodySize{0};
+    std::atomic<size_t> _bodySpillSize{0};
+    RateLimiter _rateLimiter;
+    std::atomic<size_t> _maxQueuedRequests{0};
+    std::atomic<size_t> _queuedRequests{0}; // processed, not answered yet
+    std::atomic<uint32_t> _keepAliveTimeout{0}; // ms, see Server::setKeepAlive
+    std::atomic<size_t> _maxKeepAliveRequests{0};
+    ConnectionCounters _connectionCounters;
+    ServerMetrics _metrics;
 };
 }
 }
@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <zeroeq/http/types.h> // StreamFunc member
+
 #include <map>    // member
 #include <string> // member
+#include <utility>
 
 #ifdef NOT_IMPLEMENTED
 #undef NOT_IMPLEMENTED
@@ -22,12 +25,20 @@ enum class Header
     CONTENT_TYPE,
     LAST_MODIFIED,
     LOCATION,
-    RETRY_AFTER
+    RETRY_AFTER,
+    ACCEPT_RANGES,
+    CACHE_CONTROL,
+    CONTENT_ENCODING,
+    CONTENT_RANGE,
+    ETAG,
+    UPGRADE,
+    VARY
 };
 
 /** HTTP codes to be used in a Response. */
 enum Code
 {
+    SWITCHING_PROTOCOLS = 101,
     OK = 200,
     CREATED = 201,
     ACCEPTED = 202,
@@ -45,7 +56,9 @@ enum Code
     NOT_ACCEPTABLE = 406,
     REQUEST_TIMEOUT = 408,
     PRECONDITION_FAILED = 412,
+    PAYLOAD_TOO_LARGE = 413,
     UNSATISFIABLE_RANGE = 416,
+    UPGRADE_REQUIRED = 426,
     INTERNAL_SERVER_ERROR = 500,
     NOT_IMPLEMENTED = 501,
     BAD_GATEWAY = 502,
@@ -67,29 +80,42 @@ struct Response
     /** HTTP message headers. */
     std::map<Header, std::string> headers;
 
+    /**
+     * Optional producer of a streamed payload, replacing the body.
+     *
+     * If set, the payload is sent with chunked transfer encoding, starting
+     * right after the headers. The function is called from the HTTP server
+     * thread (not during receive()) whenever the previous chunk has been
+     * written to the client, until it returns false or throws. It must not
+     * block for long, and has to keep all captured data valid until then. If
+     * it has nothing to send yet, it leaves the chunk empty and is called
+     * again after a short delay.
+     * Streamed responses are neither compressed nor answered partially.
+     */
+    StreamFunc stream;
+
     /** Construct a Response with a given return code and payload. */
-    Response(const Code code_ = Code::OK,
-             const std::string& body_ = std::string())
+    Response(const Code code_ = Code::OK, std::string body_ = std::string())
         : code{code_}
-        , body{body_}
+        , body{std::move(body_)}
     {
     }
 
     /** Construct a Response with a given code, payload and content type. */
-    Response(const Code code_, const std::string& body_,
+    Response(const Code code_, std::string body_,
              const std::string& contentType)
         : code{code_}
-        , body{body_}
+        , body{std::move(body_)}
         , headers{{Header::CONTENT_TYPE, contentType}}
     {
     }
 
     /** Construct a Response with a given code, payload and map of headers. */
-    Response(const Code code_, const std::string& body_,
+    Response(const Code code_, std::string body_,
              std::map<Header, std::string> headers_)
         : code{code_}
-        , body{body_}
-        , headers{{std::move(headers_)}}
+        , body{std::move(body_)}
+        , headers{std::move(headers_)}
     {
     }
 };
@@ -0,0 +1,87 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "sendQueue.h"
+
+#include <algorithm>
+
+namespace zeroeq
+{
+namespace http
+{
+SendQueue::SendQueue(const size_t capacity, std::function<void()> notify)
+    : _capacity(std::max(capacity, size_t(1)))
+    , _notify(std::move(notify))
+{
+}
+
+void SendQueue::push(const std::string& key, std::string data)
+{
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_closed)
+            return;
+
+        // conflate: a slow client only needs the latest data of a key
+        const auto sameKey = [&key](const Item& item) {
+            return item.key == key;
+        };
+        const auto i = key.empty() ? _items.end()
+                                   : std::find_if(_items.begin(), _items.end(),
+                                                  sameKey);
+        if (i != _items.end())
+            i->data = std::move(data);
+        else
+        {
+            if (_items.size() >= _capacity)
+            {
+                _items.pop_front();
+                ++_dropped;
+            }
+            _items.push_back({key, std::move(data)});
+        }
+
+        if (_writing)
+            return;
+        _writing = true;
+        notify = _notify;
+    }
+    notify();
+}
+
+std::string SendQueue::take()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::string data;
+    for (const auto& item : _items)
+        data.append(item.data);
+    _items.clear();
+    _writing = !data.empty();
+    return data;
+}
+
+void SendQueue::close()
+{
+    std::function<void()> notify;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    _items.clear();
+    notify.swap(_notify); // released after the lock, may own the writer
+}
+
+bool SendQueue::isClosed() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _closed;
+}
+
+size_t SendQueue::getDropped() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _dropped;
+}
+}
+}
@@ -0,0 +1,72 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_SENDQUEUE_H
+#define ZEROEQ_HTTP_SENDQUEUE_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace zeroeq
+{
+namespace http
+{
+// The bounded queue of data to send on a long-lived client connection. Data is
+// pushed by the zeroeq::http::Server thread and taken by the cppnetlib thread
+// writing it to the client connection.
+class SendQueue
+{
+public:
+    /**
+     * @param capacity the maximum number of queued items
+     * @param notify called outside of the lock when data has been pushed while
+     *               the writer was idle, the writer is busy afterwards.
+     */
+    SendQueue(size_t capacity, std::function<void()> notify);
+
+    /**
+     * Queue data to send. Queued data with the same, non-empty key is
+     * replaced, otherwise the oldest item is dropped if the queue is full.
+     */
+    void push(const std::string& key, std::string data);
+
+    /**
+     * @return all queued data, or an empty string if nothing is queued, in
+     *         which case the writer is idle.
+     */
+    std::string take();
+
+    /** Close the queue and release the notify function. */
+    void close();
+
+    bool isClosed() const;
+
+    /** @return the number of items dropped for this client. */
+    size_t getDropped() const;
+
+private:
+    struct Item
+    {
+        std::string key;
+        std::string data;
+    };
+
+    mutable std::mutex _mutex;
+    const size_t _capacity;
+    std::function<void()> _notify;
+    std::deque<Item> _items;
+    bool _writing = true; // the initial response is written on connection
+    bool _closed = false;
+    size_t _dropped = 0;
+};
+
+using SendQueuePtr = std::shared_ptr<SendQueue>;
+}
+}
+
+#endif
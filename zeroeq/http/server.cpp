@@ -8,13 +8,17 @@
 
 #include "server.h"
 
+#include "epollServer.h"
+#include "executor.h"
 #include "helpers.h"
 #include "requestHandler.h"
+#include "unixListener.h"
 
 #include "../detail/common.h"
 #include "../detail/sender.h"
 #include "../detail/socket.h"
 #include "../log.h"
+#include "../subscriber.h"
 
 #include "jsoncpp/json/json.h"
 
@@ -30,7 +34,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <future>
+#include <list>
+#include <set>
 #include <thread>
 
 namespace
@@ -76,15 +86,57 @@ std::string _convertEndpointName(const std::string& endpoint)
 }
 
 const std::string JSON_TYPE = "application/json";
+const std::string BINARY_TYPE = "application/octet-stream";
+const std::string EVENT_STREAM_TYPE = "text/event-stream";
 const std::string REQUEST_REGISTRY = "registry";
+const std::string REQUEST_BATCH = "batch";
 const std::string REQUEST_SCHEMA = "schema";
+const std::string REQUEST_METRICS = "metrics";
+const std::string METRICS_TYPE = "text/plain; version=0.0.4";
 const std::string HTTP_SERVER_SERVICE = "_http._tcp"; // Standard HTTP service
+const uint32_t EPOLL_KEEP_ALIVE_TIMEOUT = 5000; // ms, see setKeepAlive()
+const std::string UNIX_SCHEME = "unix";
+const std::string EPOLL_ENGINE = "epoll";
+const std::string KEY_UNIX_SOCKET = "UnixSocket"; // zeroconf record key
+const size_t NUM_METHODS = size_t(zeroeq::http::Method::ALL);
+const std::array<const char*, NUM_METHODS> METHOD_NAMES{
+    {"GET", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"}};
+
+// @return the bit of a method in the bitmasks of handled methods
+uint8_t _getMethodBit(const zeroeq::http::Method method)
+{
+    return uint8_t(1u << size_t(method));
+}
+
+// @return the comma-separated names of a bitmask of methods, as listed in the
+//         Allow header. The lists of all bitmasks are built once.
+const std::string& _getMethodList(const uint8_t methods)
+{
+    static const auto lists = [] {
+        std::array<std::string, 1u << NUM_METHODS> all;
+        for (size_t mask = 0; mask < all.size(); ++mask)
+        {
+            for (size_t i = 0; i < NUM_METHODS; ++i)
+            {
+                if (!(mask & (1u << i)))
+                    continue;
+                if (!all[mask].empty())
+                    all[mask].append(", ");
+                all[mask].append(METHOD_NAMES[i]);
+            }
+        }
+        return all;
+    }();
+    return lists[methods];
+}
 
 void _checkEndpointName(const std::string& endpoint)
 {
     if (endpoint == REQUEST_REGISTRY)
         ZEROEQTHROW(
             std::runtime_error("'registry' not allowed as endpoint name"));
+    if (endpoint == REQUEST_BATCH)
+        ZEROEQTHROW(std::runtime_error("'batch' not allowed as endpoint name"));
 }
 
 bool _endsWithSchema(const std::string& uri)
@@ -107,6 +159,13 @@ std::string _removeEndpointFromPath(const std::string& endpoint,
     return path.substr(endpoint.size());
 }
 
+// @return true if the epoll engine is selected instead of cppnetlib
+bool _isEpollSelected()
+{
+    const char* engine = ::getenv("ZEROEQ_HTTP_ENGINE");
+    return engine && engine == EPOLL_ENGINE;
+}
+
 std::string _getHost(const zeroeq::URI& uri)
 {
     // INADDR_ANY translation: zmq -> boost.asio
@@ -115,6 +174,198 @@ std::string _getHost(const zeroeq::URI& uri)
     return uri.getHost();
 }
 
+// @return the media type without parameters, e.g. "text/html; charset=utf-8"
+//         -> "text/html"
+std::string _getMediaType(const std::string& value)
+{
+    const auto begin = value.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return std::string();
+    const auto end = value.find_first_of(" \t;", begin);
+    return value.substr(begin, end == std::string::npos ? end : end - begin);
+}
+
+float _getQuality(const std::string& mediaRange)
+{
+    const auto pos = mediaRange.find(";q=");
+    if (pos == std::string::npos)
+        return 1.f;
+    return std::strtof(mediaRange.c_str() + pos + 3, nullptr);
+}
+
+bool _isBinary(const zeroeq::http::Request& request)
+{
+    return _getMediaType(request.contentType) == BINARY_TYPE;
+}
+
+// Large payloads are spilled to disk by the RequestHandler and only available
+// through Request::getPayload(), not in the body.
+bool _isSpilled(const zeroeq::http::Request& request)
+{
+    return request.spilledPayload != nullptr;
+}
+
+std::string _copyPayload(const zeroeq::http::Request& request)
+{
+    return std::string(request.getPayload(), request.getPayloadSize());
+}
+
+// Binary payload is only served if explicitly accepted and preferred over JSON,
+// wildcards like "*/*" keep serving JSON.
+bool _acceptsBinary(const zeroeq::http::Request& request)
+{
+    float binary = 0.f;
+    float json = 0.f;
+    size_t begin = 0;
+    while (begin < request.accept.size())
+    {
+        auto end = request.accept.find(',', begin);
+        if (end == std::string::npos)
+            end = request.accept.size();
+
+        auto mediaRange = request.accept.substr(begin, end - begin);
+        mediaRange.erase(std::remove(mediaRange.begin(), mediaRange.end(), ' '),
+                         mediaRange.end());
+        const auto type = _getMediaType(mediaRange);
+        const auto quality = _getQuality(mediaRange);
+        if (type == BINARY_TYPE)
+            binary = quality;
+        else if (type == JSON_TYPE || type == "application/*" || type == "*/*")
+            json = std::max(json, quality);
+
+        begin = end + 1;
+    }
+    return binary > 0.f && binary > json;
+}
+
+// @return true if the query has the given parameter, e.g. "since=3"
+bool _getQueryValue(const std::string& query, const std::string& key,
+                    std::string& value)
+{
+    size_t begin = 0;
+    while (begin < query.size())
+    {
+        auto end = query.find('&', begin);
+        if (end == std::string::npos)
+            end = query.size();
+
+        const auto separator = query.find('=', begin);
+        if (separator < end &&
+            query.compare(begin, separator - begin, key) == 0)
+        {
+            value = query.substr(separator + 1, end - separator - 1);
+            return true;
+        }
+        begin = end + 1;
+    }
+    return false;
+}
+
+bool _parseVersion(const std::string& value, uint64_t& version)
+{
+    if (value.empty() ||
+        value.find_first_not_of("0123456789") != std::string::npos)
+    {
+        return false;
+    }
+    try
+    {
+        version = std::stoull(value);
+        return true;
+    }
+    catch (const std::out_of_range&)
+    {
+        return false;
+    }
+}
+
+zeroeq::http::Response _serialize(const servus::Serializable& serializable,
+                                  const zeroeq::http::Request& request)
+{
+    using zeroeq::http::Code;
+    using zeroeq::http::Header;
+    zeroeq::http::Response response(Code::OK);
+    if (_acceptsBinary(request))
+    {
+        const auto data = serializable.toBinary();
+        const auto ptr = static_cast<const char*>(data.ptr.get());
+        response.body.assign(ptr, ptr ? data.size : 0);
+        response.headers[Header::CONTENT_TYPE] = BINARY_TYPE;
+    }
+    else
+    {
+        response.body = serializable.toJSON();
+        response.headers[Header::CONTENT_TYPE] = JSON_TYPE;
+    }
+
+    // caches must not serve one representation for the other
+    response.headers[Header::VARY] = "Accept";
+    return response;
+}
+
+// Apply a JSON merge patch (RFC 7386): the members of a patch object replace
+// the members of the target recursively, null members remove them and any
+// other patch replaces the whole target.
+void _mergePatch(Json::Value& target, const Json::Value& patch)
+{
+    if (!patch.isObject())
+    {
+        target = patch;
+        return;
+    }
+
+    if (!target.isObject())
+        target = Json::Value(Json::objectValue);
+    for (const auto& name : patch.getMemberNames())
+    {
+        const auto& value = patch[name];
+        if (value.isNull())
+            target.removeMember(name);
+        else
+            _mergePatch(target[name], value);
+    }
+}
+
+bool _getMethod(const std::string& name, zeroeq::http::Method& method)
+{
+    using zeroeq::http::Method;
+    static const std::map<std::string, Method> methods{
+        {"GET", Method::GET},       {"POST", Method::POST},
+        {"PUT", Method::PUT},       {"PATCH", Method::PATCH},
+        {"DELETE", Method::DELETE}, {"OPTIONS", Method::OPTIONS}};
+
+    const auto i = methods.find(name);
+    if (i == methods.end())
+        return false;
+    method = i->second;
+    return true;
+}
+
+// Convert the response of a batch entry to {"status", "headers", "body"},
+// JSON bodies are embedded as JSON values, others as strings.
+Json::Value _toJSON(const zeroeq::http::Response& response)
+{
+    using zeroeq::http::Header;
+    Json::Value entry(Json::objectValue);
+    entry["status"] = int(response.code);
+
+    Json::Value headers(Json::objectValue);
+    for (const auto& header : response.headers)
+        headers[zeroeq::http::toString(header.first)] = header.second;
+    entry["headers"] = headers;
+
+    const auto contentType = response.headers.find(Header::CONTENT_TYPE);
+    Json::Value body;
+    if (contentType == response.headers.end() ||
+        _getMediaType(contentType->second) != JSON_TYPE ||
+        !Json::Reader().parse(response.body, body, false))
+    {
+        body = response.body;
+    }
+    entry["body"] = body;
+    return entry;
+}
+
 bool _isCorsRequest(const zeroeq::http::Message& message)
 {
     return !message.origin.empty();
@@ -135,38 +386,77 @@ namespace http
 class Server::Impl : public detail::Sender
 {
 public:
+    // The response to a request as returned by the handlers, with the pending
+    // response to wait for and the endpoint for the metrics, if any.
+    struct Reply
+    {
+        Reply() = default;
+        Reply(std::future<Response>&& response_)
+            : response(std::move(response_))
+        {
+        }
+        explicit Reply(PendingResponsePtr pending_)
+            : response(pending_->getFuture())
+            , pending(std::move(pending_))
+        {
+        }
+
+        std::future<Response> response;
+        PendingResponsePtr pending;
+        const std::string* endpoint = nullptr;
+    };
+    using Handler = std::function<Reply(const Request&)>;
+
     Impl(const URI& uri_, const std::string& session)
         : detail::Sender(URI(_getInprocURI()), ZMQ_PAIR, HTTP_SERVER_SERVICE,
                          session == DEFAULT_SESSION ? getDefaultPubSession()
                                                     : session)
         , _requestHandler(_getInprocURI())
+        , _ioService(std::make_shared<boost::asio::io_service>())
         , _httpOptions(_requestHandler)
         , _httpServer(_httpOptions.address(_getHost(uri_))
                           .port(std::to_string(int(uri_.getPort())))
                           .protocol_family(HTTPServer::options::ipv4)
-                          .reuse_address(true))
+                          .reuse_address(true)
+                          .io_service(_ioService)
+                          .thread_pool(_makeThreadPool(_ioService)))
     {
+        _requestHandler.setIOService(*_ioService);
+
         if (::zmq_bind(socket.get(), _getInprocURI().c_str()) == -1)
         {
             ZEROEQTHROW(
                 std::runtime_error("Cannot bind HTTPServer to inproc socket"));
         }
 
+        const bool epoll = _isEpollSelected();
+        // served by the cppnetlib thread, in addition to the TCP server
+        if (uri_.getScheme() == UNIX_SCHEME)
+        {
+            if (epoll)
+                ZEROEQTHROW(std::runtime_error(
+                    "Unix sockets are not supported by the epoll engine"));
+            _unixListener.reset(new UnixListener(*_ioService, uri_.getPath(),
+                                                 _requestHandler,
+                                                 _bindIOSocket()));
+        }
+
         try
         {
-            _httpServer.listen();
-            _httpThread.reset(new std::thread([&] {
-                try
-                {
-                    _httpServer.run();
-                }
-                catch (const std::exception& e)
-                {
-                    ZEROEQERROR
-                        << "Error during HTTPServer::run(): " << e.what()
-                        << std::endl;
-                }
-            }));
+            if (epoll)
+            {
+                _epollServer.reset(new EpollServer(_getHost(uri_),
+                                                   uri_.getPort(),
+                                                   _requestHandler));
+                _requestHandler.setKeepAlive(EPOLL_KEEP_ALIVE_TIMEOUT, 0);
+            }
+            else
+                _httpServer.listen();
+            // the first I/O thread of cppnetlib uses the socket of the
+            // detail::Sender
+            const auto url = epoll ? _bindIOSocket() : std::string();
+            _httpThreads.emplace_back(
+                new std::thread([this, url] { _runHTTPServer(url); }));
         }
         catch (const std::exception& e)
         {
@@ -175,8 +465,16 @@ public:
         }
 
         uri = URI();
-        uri.setHost(_httpServer.address());
-        uri.setPort(std::stoi(_httpServer.port()));
+        if (_epollServer)
+        {
+            uri.setHost(_epollServer->getAddress());
+            uri.setPort(_epollServer->getPort());
+        }
+        else
+        {
+            uri.setHost(_httpServer.address());
+            uri.setPort(std::stoi(_httpServer.port()));
+        }
 
         if (uri.getHost() == "0.0.0.0")
         {
@@ -186,166 +484,1095 @@ public:
             uri.setHost(hostname);
         }
 
-        if (uri_.getHost() != uri.getHost() || uri_.getPort() == 0)
-            ZEROEQINFO << "HTTP server bound to " << uri.getHost() << ":"
-                       << uri.getPort() << std::endl;
+        if (uri_.getHost() != uri.getHost() || uri_.getPort() == 0)
+            ZEROEQINFO << "HTTP server bound to " << uri.getHost() << ":"
+                       << uri.getPort() << std::endl;
+        if (_unixListener)
+            ZEROEQINFO << "HTTP server bound to unix://"
+                       << _unixListener->getPath() << std::endl;
+
+        if (!servus::Servus::isAvailable())
+            return;
+
+        if (_unixListener)
+            setAnnounceValue(KEY_UNIX_SOCKET, _unixListener->getPath());
+        announce();
+    }
+
+    ~Impl()
+    {
+        // answer the parked long-poll requests while the HTTP server is still
+        // running
+        if (_longPollThread)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_parkedMutex);
+                _stopLongPoll = true;
+            }
+            _parkedCondition.notify_one();
+            _longPollThread->join();
+        }
+        _completeParked([](const ParkedRequest&) { return true; },
+                        Response(Code::SERVICE_UNAVAILABLE));
+        {
+            std::unique_lock<std::mutex> lock(_dispatchedMutex);
+            _dispatchedCondition.wait(lock,
+                                      [this] { return _dispatched == 0; });
+        }
+
+        if (!_httpThreads.empty())
+        {
+            if (_epollServer)
+                _epollServer->stop();
+            else
+                _httpServer.stop();
+            for (auto& thread : _httpThreads)
+                thread->join();
+        }
+        _epollServer.reset();
+        _unixListener.reset();
+
+        // release the idle event stream and WebSocket connections before the
+        // HTTP server
+        for (auto& i : _eventStreams)
+            i.second->close();
+        _webSocketHub->close();
+    }
+
+    void registerSchema(const std::string& endpoint, const std::string& schema)
+    {
+        const std::string exist = getSchema(endpoint);
+        if (exist.empty())
+            _schemas[endpoint] = schema;
+        else if (schema != exist)
+            ZEROEQTHROW(std::runtime_error(
+                "Schema registered for endpoint differs: " + endpoint));
+    }
+
+    std::string getSchema(const std::string& endpoint) const
+    {
+        const auto& i = _schemas.find(endpoint);
+        return i != _schemas.end() ? i->second : std::string();
+    }
+
+    bool remove(const servus::Serializable& serializable)
+    {
+        const auto endpoint = _convertEndpointName(serializable.getTypeName());
+        _schemas.erase(endpoint);
+        _removeVersion(endpoint);
+        const bool foundPUT = _methods[int(Method::PUT)].erase(endpoint) != 0;
+        const bool foundGET = _methods[int(Method::GET)].erase(endpoint) != 0;
+        const bool foundPATCH =
+            _methods[int(Method::PATCH)].erase(endpoint) != 0;
+        _updateMethods(endpoint);
+        return foundPUT || foundGET || foundPATCH;
+    }
+
+    bool remove(const std::string& endpoint)
+    {
+        _schemas.erase(endpoint);
+        _removeVersion(endpoint);
+        _coalesced.erase(endpoint);
+        const auto stream = _eventStreams.find(endpoint);
+        if (stream != _eventStreams.end())
+        {
+            stream->second->close();
+            _eventStreams.erase(stream);
+        }
+        _webSocketEndpoints.erase(endpoint);
+        bool foundMethod =
+            _requestHandler.getFileServer().removeDirectory(endpoint);
+        for (auto& method : _methods)
+            if (method.erase(endpoint) != 0)
+                foundMethod = true;
+        _updateMethods(endpoint);
+        return foundMethod;
+    }
+
+    bool serveDirectory(const std::string& endpoint, const std::string& path)
+    {
+        _checkEndpointName(endpoint);
+        return _requestHandler.getFileServer().addDirectory(endpoint, path);
+    }
+
+    bool handle(const Method method, const std::string& endpoint, RESTFunc func)
+    {
+        return _handle(method, endpoint, [func](const Request& request) {
+            return Reply(func(request));
+        });
+    }
+
+    bool handle(const Method method, const std::string& endpoint,
+                RESTFunc func, ExecutorPtr executor)
+    {
+        if (!executor)
+            return handle(method, endpoint, func);
+
+        const auto dispatch = [this, func, executor](const Request& request) {
+            return _dispatch(request, func, *executor);
+        };
+        return _handle(method, endpoint, dispatch);
+    }
+
+    bool handlePUT(const std::string& endpoint,
+                   servus::Serializable& serializable)
+    {
+        const auto func = [this, endpoint,
+                           &serializable](const Request& request) {
+            bool success = false;
+            if (_isBinary(request))
+                success = serializable.fromBinary(request.getPayload(),
+                                                  request.getPayloadSize());
+            else if (_isSpilled(request))
+                success = serializable.fromJSON(_copyPayload(request));
+            else
+                success = serializable.fromJSON(request.body);
+            if (success)
+                notify(endpoint);
+            return make_ready_response(success ? Code::OK : Code::BAD_REQUEST);
+        };
+        return handle(Method::PUT, endpoint, serializable.getSchema(), func);
+    }
+
+    bool handlePUT(const std::string& endpoint, const std::string& schema,
+                   const PUTPayloadFunc& func)
+    {
+        const auto futureFunc = [this, endpoint, func](const Request& request) {
+            const bool success = _isSpilled(request)
+                                     ? func(_copyPayload(request))
+                                     : func(request.body);
+            if (success)
+                notify(endpoint);
+            const auto code = success ? Code::OK : Code::BAD_REQUEST;
+            return make_ready_response(code);
+        };
+        return handle(Method::PUT, endpoint, schema, futureFunc);
+    }
+
+    bool handlePATCH(const std::string& endpoint,
+                     servus::Serializable& serializable)
+    {
+        const auto func = [this, endpoint,
+                           &serializable](const Request& request) {
+            Json::Value object;
+            Json::Value patch;
+            if (_isBinary(request) ||
+                !Json::Reader().parse(request.getPayload(),
+                                      request.getPayload() +
+                                          request.getPayloadSize(),
+                                      patch, false))
+            {
+                return make_ready_response(Code::BAD_REQUEST);
+            }
+            if (!Json::Reader().parse(serializable.toJSON(), object, false))
+                return make_ready_response(Code::INTERNAL_SERVER_ERROR);
+
+            _mergePatch(object, patch);
+            if (!serializable.fromJSON(Json::FastWriter().write(object)))
+                return make_ready_response(Code::BAD_REQUEST);
+            notify(endpoint);
+            return make_ready_response(Code::OK);
+        };
+        return handle(Method::PATCH, endpoint, serializable.getSchema(), func);
+    }
+
+    bool handleGET(const std::string& endpoint,
+                   const servus::Serializable& serializable)
+    {
+        const auto func = [this, endpoint,
+                           &serializable](const Request& request) {
+            std::string since;
+            if (_getQueryValue(request.query, "since", since))
+                return longPoll(endpoint, serializable, request, since);
+
+            uint64_t version = 0;
+            {
+                std::lock_guard<std::mutex> lock(_parkedMutex);
+                version = _versions[endpoint];
+            }
+            return Reply(make_ready_response(
+                _serializeVersion(serializable, request, version)));
+        };
+        if (!_handle(Method::GET, endpoint, serializable.getSchema(), func))
+            return false;
+
+        std::lock_guard<std::mutex> lock(_parkedMutex);
+        _versions.insert({endpoint, 0});
+        return true;
+    }
+
+    bool handleGET(const std::string& endpoint, const std::string& schema,
+                   const GETFunc& func)
+    {
+        const auto futureFunc = [func](const Request&) {
+            return make_ready_response(Code::OK, func(), JSON_TYPE);
+        };
+        return handle(Method::GET, endpoint, schema, futureFunc);
+    }
+
+    bool handle(const Method method, const std::string& endpoint,
+                const std::string& schema, RESTFunc func)
+    {
+        return _handle(method, endpoint, schema,
+                       [func](const Request& request) {
+                           return Reply(func(request));
+                       });
+    }
+
+    Reply longPoll(const std::string& endpoint,
+                                   const servus::Serializable& serializable,
+                                   const Request& request,
+                                   const std::string& sinceValue)
+    {
+        uint64_t since = 0;
+        if (!_parseVersion(sinceValue, since))
+            return make_ready_response(Code::BAD_REQUEST);
+
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::milliseconds(_longPollTimeout);
+        uint64_t version = 0;
+        PendingResponsePtr pending;
+        {
+            std::lock_guard<std::mutex> lock(_parkedMutex);
+            version = _versions[endpoint];
+            if (version <= since)
+            {
+                pending = std::make_shared<PendingResponse>();
+                _parked.push_back({endpoint, since, request, &serializable,
+                                   pending, deadline});
+
+                if (!_longPollThread)
+                    _longPollThread.reset(
+                        new std::thread([this] { _expireParked(); }));
+            }
+        }
+
+        if (!pending)
+        {
+            return make_ready_response(
+                _serializeVersion(serializable, request, version));
+        }
+
+        _parkedCondition.notify_one();
+        return Reply(pending);
+    }
+
+    bool notify(const std::string& endpoint)
+    {
+        uint64_t version = 0;
+        std::vector<ParkedRequest> ready;
+        {
+            std::lock_guard<std::mutex> lock(_parkedMutex);
+            const auto i = _versions.find(endpoint);
+            if (i == _versions.end())
+                return false;
+
+            version = ++i->second;
+            ready = _takeParked([&endpoint, version](const ParkedRequest& p) {
+                return p.endpoint == endpoint && p.since < version;
+            });
+        }
+
+        for (const auto& parked : ready)
+            parked.pending->complete(_serializeVersion(*parked.serializable,
+                                                       parked.request,
+                                                       version));
+        return true;
+    }
+
+    void setLongPollTimeout(const uint32_t timeout)
+    {
+        _longPollTimeout = timeout;
+    }
+
+    bool handleEventStream(const std::string& endpoint,
+                           const size_t bufferSize)
+    {
+        const auto func = [](const Request&) {
+            using Headers = std::map<Header, std::string>;
+            Headers headers{{Header::CONTENT_TYPE, EVENT_STREAM_TYPE},
+                            {Header::CACHE_CONTROL, "no-cache"}};
+            return make_ready_response(Code::OK, std::string(),
+                                       std::move(headers));
+        };
+        if (!handle(Method::GET, endpoint, func))
+            return false;
+
+        _eventStreams[endpoint] = std::make_shared<EventStream>(bufferSize);
+        return true;
+    }
+
+    bool pushEvent(const std::string& endpoint, const std::string& name,
+                   const std::string& data)
+    {
+        const auto i = _eventStreams.find(endpoint);
+        if (i == _eventStreams.end())
+            return false;
+
+        i->second->push(name, data);
+        return true;
+    }
+
+    bool hasEventStream(const std::string& endpoint) const
+    {
+        return _eventStreams.count(endpoint) != 0;
+    }
+
+    EventStreamPtr getEventStream(const Request& request) const
+    {
+        if (request.method != Method::GET)
+            return EventStreamPtr();
+
+        const auto i = _eventStreams.find(request.path.substr(1));
+        return i == _eventStreams.end() ? EventStreamPtr() : i->second;
+    }
+
+    bool handleWebSocket(const std::string& endpoint, const size_t queueSize)
+    {
+        // accepts the upgrade requests, see respondToWebSocketUpgrade()
+        const auto func = [this](const Request&) {
+            if (_upgrading)
+                return make_ready_response(Code::OK);
+            using Headers = std::map<Header, std::string>;
+            Headers headers{{Header::UPGRADE, "websocket"}};
+            return make_ready_response(Code::UPGRADE_REQUIRED, std::string(),
+                                       std::move(headers));
+        };
+        if (!handle(Method::GET, endpoint, func))
+            return false;
+
+        _webSocketEndpoints[endpoint] = queueSize;
+        return true;
+    }
+
+    bool subscribe(const uint128_t& event, const EventPayloadFunc& func)
+    {
+        if (_webSocketFuncs.count(event) != 0)
+            return false;
+
+        _webSocketFuncs[event] = func;
+        return true;
+    }
+
+    bool unsubscribe(const uint128_t& event)
+    {
+        return _webSocketFuncs.erase(event) != 0;
+    }
+
+    bool publish(const uint128_t& event, const void* data, const size_t size)
+    {
+        const auto threshold = _requestHandler.getCompressionThreshold();
+        return _webSocketHub->publish(encodeWebSocketEvent(event, data, size),
+                                      threshold);
+    }
+
+    bool isWebSocketUpgrade(const Message& message) const
+    {
+        return message.webSocketUpgrade &&
+               _webSocketEndpoints.count(message.request.path.substr(1)) != 0;
+    }
+
+    // Respond to a WebSocket upgrade request through the (possibly
+    // overridden) Server::respondTo(), like the other requests, where the
+    // endpoint handler answers OK. The connection is only upgraded if the
+    // response is OK and ready during receive(), otherwise the response is
+    // sent as it is.
+    Reply respondToWebSocketUpgrade(Message& message, const Server& server)
+    {
+        Reply reply;
+        _upgrading = true;
+        try
+        {
+            reply = respondThrough(message.request, server);
+        }
+        catch (...)
+        {
+            _upgrading = false;
+            throw;
+        }
+        _upgrading = false;
+
+        const bool ready = !reply.pending &&
+                           reply.response.wait_for(std::chrono::seconds(0)) !=
+                               std::future_status::timeout;
+        if (!ready)
+            return reply;
+
+        auto response = reply.response.get();
+        if (response.code != Code::OK)
+        {
+            reply.response = make_ready_response(std::move(response));
+            return reply;
+        }
+
+        const auto path = message.request.path.substr(1);
+        message.webSocket = _webSocketHub;
+        message.webSocketQueueSize = _webSocketEndpoints.at(path);
+        reply.response = make_ready_response(Code::SWITCHING_PROTOCOLS);
+        return reply;
+    }
+
+    void processWebSocketMessage(Message& message) const
+    {
+        uint128_t event;
+        const char* data = nullptr;
+        size_t size = 0;
+        if (!decodeWebSocketEvent(message.request.body, event, data, size))
+        {
+            ZEROEQINFO << "Ignoring WebSocket message without event"
+                       << std::endl;
+            return;
+        }
+
+        // like a Subscriber, events nobody subscribed to are ignored
+        const auto i = _webSocketFuncs.find(event);
+        if (i == _webSocketFuncs.end())
+            return;
+
+        // the HTTP server thread waits for completion, exceptions must not
+        // escape from receive()
+        try
+        {
+            i->second(data, size);
+        }
+        catch (const std::exception& e)
+        {
+            ZEROEQWARN << "WebSocket event handler exception: " << e.what()
+                       << std::endl;
+        }
+    }
+
+    void setCompressionThreshold(const size_t size)
+    {
+        _requestHandler.setCompressionThreshold(size);
+    }
+
+    void setIOThreads(const size_t count)
+    {
+        if (count < _httpThreads.size())
+        {
+            ZEROEQWARN << "Cannot reduce the number of HTTP I/O threads from "
+                       << _httpThreads.size() << " to " << count << std::endl;
+            return;
+        }
+
+        while (_httpThreads.size() < count)
+        {
+            const auto url = _bindIOSocket();
+            _httpThreads.emplace_back(new std::thread([this, url] {
+                // the epoll loops hand over their requests from a Dispatcher
+                if (!_epollServer)
+                    _requestHandler.connectThread(url);
+                _runHTTPServer(url);
+            }));
+        }
+    }
+
+    void setRateLimit(const std::string& endpoint, const double rate,
+                      const size_t burst)
+    {
+        _requestHandler.getRateLimiter().setLimit(endpoint, rate, burst);
+    }
+
+    void setMaxQueuedRequests(const size_t count)
+    {
+        _requestHandler.setMaxQueuedRequests(count);
+    }
+
+    void setKeepAlive(const uint32_t timeout, const size_t maxRequests)
+    {
+        _requestHandler.setKeepAlive(timeout, maxRequests);
+    }
+
+    ConnectionStats getConnectionStats()
+    {
+        const auto& counters = _requestHandler.getConnectionCounters();
+        ConnectionStats stats;
+        stats.opened = counters.opened;
+        stats.reused = counters.reused;
+        stats.closed = counters.closed;
+        return stats;
+    }
+
+    void setMaxBodySize(const size_t size)
+    {
+        _requestHandler.setMaxBodySize(size);
+    }
+
+    void setBodySpillSize(const size_t size)
+    {
+        _requestHandler.setBodySpillSize(size);
+    }
+
+    void addSockets(std::vector<detail::Socket>& entries)
+    {
+        detail::Socket entry;
+        entry.socket = socket.get();
+        entry.events = ZMQ_POLLIN;
+        entries.push_back(entry);
+        for (const auto& ioSocket : _ioSockets)
+        {
+            entry.socket = ioSocket.get();
+            entries.push_back(entry);
+        }
+    }
+
+    const std::string& getRegistry() const
+    {
+        if (!_registry.empty())
+            return _registry;
+
+        Json::Value body(Json::objectValue);
+        for (const auto& endpoint : _endpointMethods)
+            for (size_t i = 0; i < NUM_METHODS; ++i)
+                if (endpoint.second & (1u << i))
+                    body[endpoint.first].append(METHOD_NAMES[i]);
+        _registry = body.toStyledString();
+        return _registry;
+    }
+
+    // @return the bitmask of the methods handled on an endpoint
+    uint8_t getMethods(const std::string& endpoint) const
+    {
+        const auto i = _endpointMethods.find(endpoint);
+        return i == _endpointMethods.end() ? 0 : i->second;
+    }
+
+    // Server::respondTo(), which hands the pending response and endpoint to
+    // the innermost respondThrough() instead of returning them. Requests to
+    // coalesced endpoints are coalesced here, after the possibly overridden
+    // Server::respondTo() has seen each of them.
+    std::future<Response> respondTo(Request& request) const
+    {
+        const auto coalesced = _getCoalesced(request);
+        auto reply = coalesced ? _respondToCoalesced(request, *coalesced)
+                               : _respondTo(request);
+        if (_currentReply)
+        {
+            _currentReply->pending = reply.pending;
+            _currentReply->endpoint = reply.endpoint;
+            _currentReply = nullptr; // the first call answers the request
+        }
+        return std::move(reply.response);
+    }
+
+    // Respond through the (possibly overridden) Server::respondTo(). Only
+    // called from the receive() thread, like the handlers.
+    Reply respondThrough(Request& request, const Server& server) const
+    {
+        Reply reply;
+        Reply* const outer = _currentReply;
+        _currentReply = &reply;
+        try
+        {
+            reply.response = server.respondTo(request);
+        }
+        catch (...)
+        {
+            _currentReply = outer;
+            throw;
+        }
+        _currentReply = outer;
+        return reply;
+    }
+
+    void setMetrics(const bool enable)
+    {
+        _requestHandler.getMetrics().setEnabled(enable);
+    }
+
+    bool isMeasured() const { return _requestHandler.getMetrics().isEnabled(); }
+
+    // Count a request answered during receive() in the metrics of the
+    // endpoint which handled it, or of the empty endpoint if none did.
+    void measure(Message& message, const std::string* endpoint,
+                 const ServerMetrics::Clock::time_point start)
+    {
+        static const std::string unrouted;
+        if (!endpoint)
+            endpoint = &unrouted;
+
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        auto& metrics = _requestHandler.getMetrics();
+        const auto& route = metrics.getRoute(*endpoint, message.request.method);
+        const auto now = ServerMetrics::Clock::now();
+        if (message.received != ServerMetrics::Clock::time_point())
+            route->queueTime.observe(
+                duration_cast<microseconds>(start - message.received).count());
+        route->handlerTime.observe(
+            duration_cast<microseconds>(now - start).count());
+        message.route = route;
+    }
+
+    void setCoalescing(const std::string& endpoint, const bool enable)
+    {
+        if (enable)
+            _coalesced.insert(endpoint);
+        else
+            _coalesced.erase(endpoint);
+    }
+
+    bool isBatchRequest(const Request& request) const
+    {
+        return request.method == Method::POST &&
+               request.path.substr(1) == REQUEST_BATCH;
+    }
+
+    // Respond to all requests of a batch through the (possibly overridden)
+    // Server::respondTo(). The combined response is completed by the last
+    // pending entry, or else waited for by the I/O thread if an entry is
+    // computed asynchronously without a pending response.
+    Reply respondToBatch(const Request& request, const Server& server) const
+    {
+        Json::Value entries;
+        const auto begin = request.getPayload();
+        const auto size = request.getPayloadSize();
+        if (!Json::Reader().parse(begin, begin + size, entries, false) ||
+            !entries.isArray())
+        {
+            return make_ready_response(Code::BAD_REQUEST);
+        }
+
+        using Responses = std::vector<std::future<Response>>;
+        auto responses = std::make_shared<Responses>();
+        responses->reserve(entries.size());
+        std::vector<PendingResponsePtr> pendings;
+        bool waiting = false; // for an entry which is neither ready nor pending
+        for (const auto& entry : entries)
+        {
+            auto reply = _respondToBatchEntry(entry, request, server);
+            if (reply.pending)
+                pendings.push_back(reply.pending);
+            else if (reply.response.wait_for(std::chrono::seconds(0)) !=
+                     std::future_status::ready)
+            {
+                waiting = true;
+            }
+            responses->push_back(std::move(reply.response));
+        }
+
+        const auto combine = [responses] {
+            Json::Value body(Json::arrayValue);
+            for (auto& response : *responses)
+            {
+                try
+                {
+                    body.append(_toJSON(response.get()));
+                }
+                catch (const std::exception& e)
+                {
+                    body.append(_toJSON(
+                        Response(Code::INTERNAL_SERVER_ERROR,
+                                 std::string("Request handler exception: ") +
+                                     e.what())));
+                }
+            }
+            return Response(Code::OK, Json::FastWriter().write(body),
+                            JSON_TYPE);
+        };
+        if (waiting)
+            return _routed(std::async(std::launch::deferred, combine),
+                           REQUEST_BATCH);
+        if (pendings.empty())
+            return _routed(make_ready_response(combine()), REQUEST_BATCH);
+
+        auto batch = std::make_shared<PendingResponse>();
+        auto remaining = std::make_shared<std::atomic<size_t>>(pendings.size());
+        Reply reply(batch);
+        for (const auto& pending : pendings)
+        {
+            pending->onReady([batch, remaining, combine] {
+                if (--*remaining == 0)
+                    batch->complete(combine());
+            });
+        }
+        return _routed(std::move(reply), REQUEST_BATCH);
+    }
+
+    void processCorsPreflightRequest(Message& message) const
+    {
+        // In a typical situation, user agents discover via a preflight request
+        // whether a cross-origin resource is prepared to accept requests.
+        // The current implementation accepts all sources for all requests.
+        // More information can be found here: https://www.w3.org/TR/cors
+
+        // remove leading '/'
+        const auto path = message.request.path.substr(1);
+
+        const bool isSchemaRequest = _isSchemaRequest(message);
+        const bool isBatchRequest =
+            path == REQUEST_BATCH &&
+            message.accessControlRequestMethod == Method::POST;
+        const auto methods = getMethods(path);
+        if (!(methods & _getMethodBit(message.accessControlRequestMethod)) &&
+            !isSchemaRequest && !isBatchRequest)
+        {
+            message.response = make_ready_response(Code::NOT_SUPPORTED);
+            return;
+        }
+
+        const auto allowedMethods =
+            isSchemaRequest ? "GET"
+                            : isBatchRequest ? "POST" : _getMethodList(methods);
+        message.corsResponseHeaders = {
+            {CorsResponseHeader::access_control_allow_headers, "Content-Type"},
+            {CorsResponseHeader::access_control_allow_methods, allowedMethods},
+            {CorsResponseHeader::access_control_allow_origin, "*"}};
+        message.response = make_ready_response(Code::OK);
+    }
+
+private:
+    bool _handle(const Method method, const std::string& endpoint,
+                 Handler func)
+    {
+        _checkEndpointName(endpoint);
+
+        if (_methods[int(method)].count(endpoint) != 0)
+            return false;
+
+        _methods[int(method)][endpoint] = func;
+        _updateMethods(endpoint);
+        return true;
+    }
+
+    bool _handle(const Method method, const std::string& endpoint,
+                 const std::string& schema, Handler func)
+    {
+        if (!_handle(method, endpoint, func))
+            return false;
+
+        if (!schema.empty())
+            registerSchema(endpoint, schema);
+        return true;
+    }
+
+    // Call a handler with a copy of the request on a thread of the executor,
+    // answering the request once the handler's response is ready.
+    Reply _dispatch(const Request& request, const RESTFunc& func,
+                    Executor& executor)
+    {
+        auto copy = std::make_shared<Request>(request);
+        auto pending = std::make_shared<PendingResponse>();
+        {
+            std::lock_guard<std::mutex> lock(_dispatchedMutex);
+            ++_dispatched;
+        }
+
+        executor.post([this, func, copy, pending] {
+            std::shared_future<Response> response;
+            try
+            {
+                response = func(*copy).share();
+            }
+            catch (...)
+            {
+                std::promise<Response> failed;
+                failed.set_exception(std::current_exception());
+                response = failed.get_future().share();
+            }
+            pending->complete(_getResponse(response));
+
+            std::lock_guard<std::mutex> lock(_dispatchedMutex);
+            if (--_dispatched == 0)
+                _dispatchedCondition.notify_all();
+        });
+
+        return Reply(pending);
+    }
+
+    // @return the coalesced endpoint of a GET request, nullptr if none
+    const std::string* _getCoalesced(const Request& request) const
+    {
+        if (request.method != Method::GET || _coalesced.empty())
+            return nullptr;
+
+        // same endpoint matching as respondTo()
+        const auto path = request.path.substr(1);
+        for (const auto& endpoint : _coalesced)
+        {
+            if (path == endpoint ||
+                (*endpoint.rbegin() == '/' &&
+                 path.compare(0, endpoint.size(), endpoint) == 0))
+            {
+                return &endpoint;
+            }
+        }
+        return nullptr;
+    }
+
+    // Share the response of an identical GET request still being computed,
+    // otherwise compute it with the handler. Responses computed asynchronously
+    // are completed for all requests by the first one: by its pending response
+    // once ready, or else by its I/O thread once that has waited for the
+    // response.
+    Reply _respondToCoalesced(Request& request,
+                              const std::string& endpoint) const
+    {
+        _pruneInflight();
+
+        const auto key = request.path + '?' + request.query + '\n' +
+                         request.accept;
+        auto i = _inflight.find(key);
+        const std::string* route = &endpoint;
+        if (i == _inflight.end())
+        {
+            auto reply = _respondTo(request);
+            if (reply.response.wait_for(std::chrono::seconds(0)) !=
+                std::future_status::timeout)
+            {
+                return reply;
+            }
 
-        if (!servus::Servus::isAvailable())
-            return;
+            auto inflight = std::make_shared<Inflight>();
+            inflight->response = reply.response.share();
+            i = _inflight.insert({key, inflight}).first;
+            if (!reply.pending)
+            {
+                reply.response = std::async(std::launch::deferred, [inflight] {
+                    _completeInflight(*inflight);
+                    return _getResponse(inflight->response);
+                });
+                return reply;
+            }
 
-        announce();
-    }
+            // answered as a waiter below, like the identical requests
+            reply.pending->onReady(
+                [inflight] { _completeInflight(*inflight); });
+            if (reply.endpoint)
+                route = reply.endpoint;
+        }
 
-    ~Impl()
-    {
-        if (_httpThread)
+        auto& inflight = *i->second;
+        std::lock_guard<std::mutex> lock(inflight.mutex);
+        if (inflight.done)
         {
-            _httpServer.stop();
-            _httpThread->join();
+            return _routed(make_ready_response(
+                               _getResponse(inflight.response)),
+                           *route);
         }
+
+        auto pending = std::make_shared<PendingResponse>();
+        inflight.waiters.push_back(pending);
+        return _routed(Reply(pending), *route);
     }
 
-    void registerSchema(const std::string& endpoint, const std::string& schema)
+    // A coalesced GET request whose response is computed asynchronously
+    struct Inflight
     {
-        const std::string exist = getSchema(endpoint);
-        if (exist.empty())
-            _schemas[endpoint] = schema;
-        else if (schema != exist)
-            ZEROEQTHROW(std::runtime_error(
-                "Schema registered for endpoint differs: " + endpoint));
-    }
+        std::mutex mutex;
+        std::shared_future<Response> response;
+        std::vector<PendingResponsePtr> waiters;
+        bool done = false;
+    };
 
-    std::string getSchema(const std::string& endpoint) const
+    static Response _getResponse(const std::shared_future<Response>& future)
     {
-        const auto& i = _schemas.find(endpoint);
-        return i != _schemas.end() ? i->second : std::string();
+        try
+        {
+            return future.get();
+        }
+        catch (const std::exception& e)
+        {
+            return Response(Code::INTERNAL_SERVER_ERROR,
+                            std::string("Request handler exception: ") +
+                                e.what());
+        }
+        catch (...)
+        {
+            return Response(Code::INTERNAL_SERVER_ERROR,
+                            "An unknown exception occured");
+        }
     }
 
-    bool remove(const servus::Serializable& serializable)
+    void _pruneInflight() const
     {
-        const auto endpoint = _convertEndpointName(serializable.getTypeName());
-        _schemas.erase(endpoint);
-        const bool foundPUT = _methods[int(Method::PUT)].erase(endpoint) != 0;
-        const bool foundGET = _methods[int(Method::GET)].erase(endpoint) != 0;
-        return foundPUT || foundGET;
+        for (auto i = _inflight.begin(); i != _inflight.end();)
+        {
+            std::unique_lock<std::mutex> lock(i->second->mutex);
+            if (i->second->done)
+            {
+                lock.unlock();
+                i = _inflight.erase(i);
+            }
+            else
+                ++i;
+        }
     }
 
-    bool remove(const std::string& endpoint)
+    // Answer the requests waiting for a coalesced response, once it is ready
+    // or from the thread waiting for it.
+    static void _completeInflight(Inflight& inflight)
     {
-        _schemas.erase(endpoint);
-        bool foundMethod = false;
-        for (auto& method : _methods)
-            if (method.erase(endpoint) != 0)
-                foundMethod = true;
-        return foundMethod;
+        const auto response = _getResponse(inflight.response);
+        std::vector<PendingResponsePtr> waiters;
+        {
+            std::lock_guard<std::mutex> lock(inflight.mutex);
+            inflight.done = true;
+            waiters.swap(inflight.waiters);
+        }
+        for (const auto& waiter : waiters)
+            waiter->complete(response);
     }
 
-    bool handle(const Method method, const std::string& endpoint, RESTFunc func)
+    Reply _respondToBatchEntry(const Json::Value& entry, const Request& batch,
+                               const Server& server) const
     {
-        _checkEndpointName(endpoint);
+        if (!entry.isObject() || !entry["method"].isString() ||
+            !entry["path"].isString())
+        {
+            return make_ready_response(Code::BAD_REQUEST);
+        }
 
-        if (_methods[int(method)].count(endpoint) != 0)
-            return false;
+        Request request;
+        request.source = batch.source;
+        if (!_getMethod(entry["method"].asString(), request.method))
+            return make_ready_response(Code::BAD_REQUEST);
+
+        const auto target = entry["path"].asString();
+        const auto query = target.find('?');
+        request.path = target.substr(0, query);
+        if (query != std::string::npos)
+            request.query = target.substr(query + 1);
+        if (request.path.empty() || request.path[0] != '/')
+            request.path.insert(0, "/");
+        if (request.path.substr(1) == REQUEST_BATCH)
+            return make_ready_response(Code::BAD_REQUEST); // no nesting
+
+        const auto& body = entry["body"];
+        if (body.isString())
+            request.body = body.asString();
+        else if (!body.isNull())
+            request.body = Json::FastWriter().write(body);
 
-        _methods[int(method)][endpoint] = func;
-        return true;
+        try
+        {
+            return respondThrough(request, server);
+        }
+        catch (const std::exception& e)
+        {
+            return make_ready_response(Code::INTERNAL_SERVER_ERROR,
+                                       std::string(
+                                           "Request handler exception: ") +
+                                           e.what());
+        }
+        catch (...)
+        {
+            return make_ready_response(Code::INTERNAL_SERVER_ERROR,
+                                       "An unknown exception occured");
+        }
     }
 
-    bool handlePUT(const std::string& endpoint,
-                   servus::Serializable& serializable)
+    // A long-poll GET request waiting for a newer version of its object
+    struct ParkedRequest
     {
-        const auto func = [&serializable](const std::string& json) {
-            return serializable.fromJSON(json);
-        };
-        return handlePUT(endpoint, serializable.getSchema(), func);
+        std::string endpoint;
+        uint64_t since;
+        Request request;
+        const servus::Serializable* serializable;
+        PendingResponsePtr pending;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    static Response _serializeVersion(const servus::Serializable& serializable,
+                                      const Request& request,
+                                      const uint64_t version)
+    {
+        // strong validators differ per representation, Compressor::encode()
+        // tags the encoding
+        auto response = _serialize(serializable, request);
+        const bool binary =
+            response.headers[Header::CONTENT_TYPE] == BINARY_TYPE;
+        response.headers[Header::ETAG] =
+            '"' + std::to_string(version) + (binary ? "-binary\"" : "\"");
+        return response;
     }
 
-    bool handlePUT(const std::string& endpoint, const std::string& schema,
-                   const PUTPayloadFunc& func)
+    // Remove the parked requests matching the given filter, the parked mutex
+    // has to be locked.
+    template <typename Filter>
+    std::vector<ParkedRequest> _takeParked(const Filter& filter)
     {
-        _checkEndpointName(endpoint);
-
-        const auto futureFunc = [func](const Request& request) {
-            const auto code = func(request.body) ? Code::OK : Code::BAD_REQUEST;
-            return make_ready_response(code);
-        };
-        if (!handle(Method::PUT, endpoint, futureFunc))
-            return false;
-
-        if (!schema.empty())
-            registerSchema(endpoint, schema);
-        return true;
+        std::vector<ParkedRequest> taken;
+        for (auto i = _parked.begin(); i != _parked.end();)
+        {
+            if (filter(*i))
+            {
+                taken.push_back(std::move(*i));
+                i = _parked.erase(i);
+            }
+            else
+                ++i;
+        }
+        return taken;
     }
 
-    bool handleGET(const std::string& endpoint,
-                   const servus::Serializable& serializable)
+    // Answer the parked requests matching the given filter, outside of the
+    // lock as completing writes the response.
+    template <typename Filter>
+    void _completeParked(const Filter& filter, const Response& response)
     {
-        const auto func = [&serializable] { return serializable.toJSON(); };
-        return handleGET(endpoint, serializable.getSchema(), func);
+        std::vector<ParkedRequest> ready;
+        {
+            std::lock_guard<std::mutex> lock(_parkedMutex);
+            ready = _takeParked(filter);
+        }
+        for (const auto& parked : ready)
+            parked.pending->complete(response);
     }
 
-    bool handleGET(const std::string& endpoint, const std::string& schema,
-                   const GETFunc& func)
+    void _removeVersion(const std::string& endpoint)
     {
-        _checkEndpointName(endpoint);
-
-        const auto futureFunc = [func](const Request&) {
-            return make_ready_response(Code::OK, func(), JSON_TYPE);
-        };
-        if (!handle(Method::GET, endpoint, futureFunc))
-            return false;
-
-        if (!schema.empty())
-            registerSchema(endpoint, schema);
-
-        return true;
+        {
+            std::lock_guard<std::mutex> lock(_parkedMutex);
+            if (_versions.erase(endpoint) == 0)
+                return;
+        }
+        _completeParked(
+            [&endpoint](const ParkedRequest& parked) {
+                return parked.endpoint == endpoint;
+            },
+            Response(Code::NOT_FOUND));
     }
 
-    void addSockets(std::vector<detail::Socket>& entries)
+    // Answer the parked requests with 304 Not Modified once timed out. Runs in
+    // its own thread, the versions are only known to the receive() thread.
+    void _expireParked()
     {
-        detail::Socket entry;
-        entry.socket = socket.get();
-        entry.events = ZMQ_POLLIN;
-        entries.push_back(entry);
+        std::unique_lock<std::mutex> lock(_parkedMutex);
+        while (!_stopLongPoll)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            auto next = std::chrono::steady_clock::time_point::max();
+            const auto expired =
+                _takeParked([now, &next](const ParkedRequest& parked) {
+                    if (parked.deadline <= now)
+                        return true;
+                    next = std::min(next, parked.deadline);
+                    return false;
+                });
+
+            if (!expired.empty())
+            {
+                lock.unlock();
+                for (const auto& parked : expired)
+                    parked.pending->complete(Response(Code::NOT_MODIFIED));
+                lock.lock();
+            }
+            else if (next == std::chrono::steady_clock::time_point::max())
+                _parkedCondition.wait(lock);
+            else
+                _parkedCondition.wait_until(lock, next);
+        }
     }
 
-    std::string getRegistry() const
+    static Reply _routed(Reply reply, const std::string& endpoint)
     {
-        Json::Value body(Json::objectValue);
-        for (const auto& i : _methods[int(Method::GET)])
-            body[i.first].append("GET");
-        for (const auto& i : _methods[int(Method::POST)])
-            body[i.first].append("POST");
-        for (const auto& i : _methods[int(Method::PUT)])
-            body[i.first].append("PUT");
-        for (const auto& i : _methods[int(Method::PATCH)])
-            body[i.first].append("PATCH");
-        for (const auto& i : _methods[int(Method::DELETE)])
-            body[i.first].append("DELETE");
-        for (const auto& i : _methods[int(Method::OPTIONS)])
-            body[i.first].append("OPTIONS");
-        return body.toStyledString();
-    }
-
-    std::string getAllowedMethods(const std::string& endpoint) const
-    {
-        std::string methods;
-        if (_methods[int(Method::GET)].count(endpoint))
-            methods.append(methods.empty() ? "GET" : ", GET");
-        if (_methods[int(Method::POST)].count(endpoint))
-            methods.append(methods.empty() ? "POST" : ", POST");
-        if (_methods[int(Method::PUT)].count(endpoint))
-            methods.append(methods.empty() ? "PUT" : ", PUT");
-        if (_methods[int(Method::PATCH)].count(endpoint))
-            methods.append(methods.empty() ? "PATCH" : ", PATCH");
-        if (_methods[int(Method::DELETE)].count(endpoint))
-            methods.append(methods.empty() ? "DELETE" : ", DELETE");
-        if (_methods[int(Method::OPTIONS)].count(endpoint))
-            methods.append(methods.empty() ? "OPTIONS" : ", OPTIONS");
-        return methods;
+        reply.endpoint = &endpoint;
+        return reply;
     }
 
-    std::future<Response> respondTo(Request& request) const
+    Reply _respondTo(Request& request) const
     {
         const auto method = request.method;
         const auto path = request.path.substr(1); // remove leading '/'
@@ -353,14 +1580,31 @@ public:
         if (method == Method::GET)
         {
             if (path == REQUEST_REGISTRY)
-                return make_ready_response(Code::OK, getRegistry(), JSON_TYPE);
+                return _routed(make_ready_response(Code::OK, getRegistry(),
+                                                  JSON_TYPE),
+                              REQUEST_REGISTRY);
+
+            const auto& metrics = _requestHandler.getMetrics();
+            if (path == REQUEST_METRICS && metrics.isEnabled())
+            {
+                return _routed(
+                    make_ready_response(
+                        Code::OK,
+                        metrics.toString(
+                            _requestHandler.getConnectionCounters(),
+                            _requestHandler.getQueuedRequests()),
+                        METRICS_TYPE),
+                    REQUEST_METRICS);
+            }
 
             if (_endsWithSchema(path))
             {
                 const auto endpoint = path.substr(0, path.find_last_of('/'));
                 const auto it = _schemas.find(endpoint);
                 if (it != _schemas.end())
-                    return make_ready_response(Code::OK, it->second, JSON_TYPE);
+                    return _routed(make_ready_response(Code::OK, it->second,
+                                                      JSON_TYPE),
+                                  REQUEST_SCHEMA);
             }
         }
 
@@ -380,59 +1624,50 @@ public:
             if (pathStripped.empty() || *endpoint.rbegin() == '/')
             {
                 request.path = pathStripped;
-                return func(request);
+                return _routed(func(request), endpoint);
             }
         }
 
         // if "/" is registered as an endpoint it should be passed all
         // unhandled requests.
-        if (funcMap.count("/"))
+        const auto root = funcMap.find("/");
+        if (root != funcMap.end())
         {
-            const auto& func = funcMap.at("/");
             request.path = path;
-            return func(request);
+            return _routed(root->second(request), root->first);
         }
 
         // return informative error 405 "Method Not Allowed" if possible
-        const auto allowedMethods = getAllowedMethods(path);
-        if (!allowedMethods.empty())
+        const auto endpoint = _endpointMethods.find(path);
+        if (endpoint != _endpointMethods.end())
         {
             using Headers = std::map<Header, std::string>;
-            Headers headers{{Header::ALLOW, allowedMethods}};
-            return make_ready_response(Code::NOT_SUPPORTED, std::string(),
-                                       std::move(headers));
+            Headers headers{{Header::ALLOW, _getMethodList(endpoint->second)}};
+            return _routed(make_ready_response(Code::NOT_SUPPORTED,
+                                              std::string(),
+                                              std::move(headers)),
+                          endpoint->first);
         }
 
         return make_ready_response(Code::NOT_FOUND);
     }
 
-    void processCorsPreflightRequest(Message& message) const
+    // Update the handled methods of an endpoint after handle() or remove(),
+    // instead of looking them up for each request.
+    void _updateMethods(const std::string& endpoint)
     {
-        // In a typical situation, user agents discover via a preflight request
-        // whether a cross-origin resource is prepared to accept requests.
-        // The current implementation accepts all sources for all requests.
-        // More information can be found here: https://www.w3.org/TR/cors
-
-        // remove leading '/'
-        const auto path = message.request.path.substr(1);
-
-        const bool isSchemaRequest = _isSchemaRequest(message);
-        if (!_methods[int(message.accessControlRequestMethod)].count(path) &&
-            !isSchemaRequest)
-        {
-            message.response = make_ready_response(Code::NOT_SUPPORTED);
-            return;
-        }
-
-        message.corsResponseHeaders = {
-            {CorsResponseHeader::access_control_allow_headers, "Content-Type"},
-            {CorsResponseHeader::access_control_allow_methods,
-             isSchemaRequest ? "GET" : getAllowedMethods(path)},
-            {CorsResponseHeader::access_control_allow_origin, "*"}};
-        message.response = make_ready_response(Code::OK);
+        uint8_t methods = 0;
+        for (size_t i = 0; i < NUM_METHODS; ++i)
+            if (_methods[i].count(endpoint))
+                methods |= uint8_t(1u << i);
+
+        if (methods)
+            _endpointMethods[endpoint] = methods;
+        else
+            _endpointMethods.erase(endpoint);
+        _registry.clear();
     }
 
-private:
     bool _isSchemaRequest(Message& message) const
     {
         const auto path = message.request.path.substr(1);
@@ -449,17 +1684,94 @@ private:
     // key stores endpoints of Serializable objects lower-case, hyphenated,
     // with '/' separators
     // must be an ordered map in order to iterate from the most specific path
-    typedef std::map<std::string, RESTFunc, std::greater<std::string>> FuncMap;
+    typedef std::map<std::string, Handler, std::greater<std::string>> FuncMap;
     typedef std::map<std::string, std::string> SchemaMap;
 
     SchemaMap _schemas;
     std::array<FuncMap, size_t(Method::ALL)> _methods;
+    std::map<std::string, uint8_t> _endpointMethods; // bitmasks of _methods
+    mutable std::string _registry; // of _endpointMethods, empty if outdated
+    mutable Reply* _currentReply = nullptr; // of respondThrough()
+    std::map<std::string, EventStreamPtr> _eventStreams;
+    std::map<std::string, size_t> _webSocketEndpoints; // queue size
+    bool _upgrading = false; // during respondToWebSocketUpgrade()
+    std::map<uint128_t, EventPayloadFunc> _webSocketFuncs;
+    WebSocketHubPtr _webSocketHub{std::make_shared<WebSocketHub>()};
+
+    std::atomic<uint32_t> _longPollTimeout{30000}; // ms
+    std::mutex _parkedMutex; // protects the versions and parked requests
+    std::map<std::string, uint64_t> _versions; // of long-poll endpoints
+    std::condition_variable _parkedCondition;
+    std::list<ParkedRequest> _parked;
+    bool _stopLongPoll = false;
+    std::unique_ptr<std::thread> _longPollThread;
+
+    std::set<std::string> _coalesced; // endpoints
+    mutable std::map<std::string, std::shared_ptr<Inflight>> _inflight;
+
+    std::mutex _dispatchedMutex;
+    std::condition_variable _dispatchedCondition;
+    size_t _dispatched = 0; // handlers posted to executors, not yet done
+
     RequestHandler _requestHandler;
+    std::shared_ptr<boost::asio::io_service> _ioService; // of _httpServer
     HTTPServer::options _httpOptions;
     HTTPServer _httpServer;
-    std::unique_ptr<std::thread> _httpThread;
+    std::unique_ptr<EpollServer> _epollServer; // replaces _httpServer if set
+    std::unique_ptr<UnixListener> _unixListener;
+    std::vector<std::unique_ptr<std::thread>> _httpThreads; // I/O threads
+    // of the additional I/O threads, the epoll loops and the Unix listener
+    std::vector<zmq::SocketPtr> _ioSockets;
+
+    // cppnetlib runs the request handlers and the reads of request payloads in
+    // its own pool of one thread by default, which would share the socket of
+    // the first I/O thread. Run them on the I/O threads instead, which have a
+    // socket each, so that setIOThreads() handles requests in parallel.
+    static std::shared_ptr<boost::network::utils::thread_pool> _makeThreadPool(
+        const std::shared_ptr<boost::asio::io_service>& ioService)
+    {
+        return std::make_shared<boost::network::utils::thread_pool>(0,
+                                                                    ioService);
+    }
+
+    // @param zmqURL the socket handing over the requests of the thread
+    void _runHTTPServer(const std::string& zmqURL)
+    {
+        try
+        {
+            if (_epollServer)
+                _epollServer->run(zmqURL);
+            else
+                _httpServer.run();
+        }
+        catch (const std::exception& e)
+        {
+            ZEROEQERROR << "Error during HTTPServer::run(): " << e.what()
+                        << std::endl;
+        }
+    }
+
+    // Bind another socket to hand over requests, as zmq sockets are not thread
+    // safe and each thread calling RequestHandler::process() needs its own
+    // @return the URL to connect the thread to
+    std::string _bindIOSocket()
+    {
+        auto context = detail::getContext();
+        const auto url = _getInprocURI(_ioSockets.size() + 1);
+        zmq::SocketPtr ioSocket(zmq_socket(context.get(), ZMQ_PAIR),
+                                [context](void* s) { ::zmq_close(s); });
+        if (::zmq_bind(ioSocket.get(), url.c_str()) == -1)
+        {
+            ZEROEQTHROW(
+                std::runtime_error("Cannot bind HTTPServer to inproc socket"));
+        }
+        _ioSockets.push_back(ioSocket);
+        return url;
+    }
 
-    std::string _getInprocURI() const
+    // @param thread the index of the socket, 0 for the one of the
+    //        detail::Sender
+    std::string _getInprocURI(const size_t thread = 0) const
     {
         std::ostringstream inprocURI;
 // No socket notifier possible on inproc ZMQ sockets,
@@ -471,6 +1783,8 @@ private:
 #else
         inprocURI << "ipc:///tmp/" << static_cast<const void*>(this);
 #endif
+        if (thread > 0)
+            inprocURI << "-" << thread;
         return inprocURI.str();
     }
 };
@@ -561,9 +1875,157 @@ SocketDescriptor Server::getSocketDescriptor() const
 #endif
 }
 
+void Server::setMetrics(const bool enable)
+{
+    _impl->setMetrics(enable);
+}
+
+void Server::setCoalescing(const std::string& endpoint, const bool enable)
+{
+    _impl->setCoalescing(endpoint, enable);
+}
+
+bool Server::notify(const servus::Serializable& object)
+{
+    return _impl->notify(_convertEndpointName(object.getTypeName()));
+}
+
+bool Server::notify(const std::string& endpoint)
+{
+    return _impl->notify(endpoint);
+}
+
+void Server::setLongPollTimeout(const uint32_t timeout)
+{
+    _impl->setLongPollTimeout(timeout);
+}
+
+bool Server::handleEventStream(const std::string& endpoint,
+                               const size_t bufferSize)
+{
+    return _impl->handleEventStream(endpoint, bufferSize);
+}
+
+bool Server::pushEvent(const std::string& endpoint, const std::string& name,
+                       const std::string& data)
+{
+    return _impl->pushEvent(endpoint, name, data);
+}
+
+bool Server::handleWebSocket(const std::string& endpoint,
+                             const size_t queueSize)
+{
+    return _impl->handleWebSocket(endpoint, queueSize);
+}
+
+bool Server::subscribe(servus::Serializable& object)
+{
+    return _impl->subscribe(object.getTypeIdentifier(),
+                            [&object](const void* data, const size_t size) {
+                                object.fromBinary(data, size);
+                            });
+}
+
+bool Server::subscribe(const uint128_t& event, const EventFunc& func)
+{
+    return _impl->subscribe(event,
+                            [func](const void*, const size_t) { func(); });
+}
+
+bool Server::subscribe(const uint128_t& event, const EventPayloadFunc& func)
+{
+    return _impl->subscribe(event, func);
+}
+
+bool Server::unsubscribe(const servus::Serializable& object)
+{
+    return _impl->unsubscribe(object.getTypeIdentifier());
+}
+
+bool Server::unsubscribe(const uint128_t& event)
+{
+    return _impl->unsubscribe(event);
+}
+
+bool Server::publish(const servus::Serializable& object)
+{
+    const auto data = object.toBinary();
+    return _impl->publish(object.getTypeIdentifier(), data.ptr.get(),
+                          data.size);
+}
+
+bool Server::publish(const uint128_t& event, const void* data,
+                     const size_t size)
+{
+    return _impl->publish(event, data, size);
+}
+
+bool Server::bridgeEvents(const std::string& endpoint, Subscriber& subscriber,
+                          servus::Serializable& object)
+{
+    if (!_impl->hasEventStream(endpoint))
+        return false;
+
+    Impl* impl = _impl.get();
+    return subscriber.subscribe(
+        object.getTypeIdentifier(),
+        [impl, endpoint, &object](const void* data, const size_t size) {
+            if (object.fromBinary(data, size))
+                impl->pushEvent(endpoint, object.getTypeName(),
+                                object.toJSON());
+        });
+}
+
+void Server::setCompressionThreshold(const size_t size)
+{
+    _impl->setCompressionThreshold(size);
+}
+
+void Server::setIOThreads(const size_t count)
+{
+    _impl->setIOThreads(count);
+}
+
+void Server::setRateLimit(const double rate, const size_t burst)
+{
+    _impl->setRateLimit(std::string(), rate, burst);
+}
+
+void Server::setRateLimit(const std::string& endpoint, const double rate,
+                          const size_t burst)
+{
+    _impl->setRateLimit(endpoint, rate, burst);
+}
+
+void Server::setMaxQueuedRequests(const size_t count)
+{
+    _impl->setMaxQueuedRequests(count);
+}
+
+void Server::setKeepAlive(const uint32_t timeout, const size_t maxRequests)
+{
+    _impl->setKeepAlive(timeout, maxRequests);
+}
+
+ConnectionStats Server::getConnectionStats() const
+{
+    return _impl->getConnectionStats();
+}
+
+void Server::setMaxBodySize(const size_t size)
+{
+    _impl->setMaxBodySize(size);
+}
+
+void Server::setBodySpillSize(const size_t size)
+{
+    _impl->setBodySpillSize(size);
+}
+
 bool Server::handle(const std::string& endpoint, servus::Serializable& object)
 {
-    return handlePUT(endpoint, object) && handleGET(endpoint, object);
+    return handlePUT(endpoint, object) && handlePATCH(endpoint, object) &&
+           handleGET(endpoint, object);
 }
 
 bool Server::handle(const Method action, const std::string& endpoint,
@@ -572,6 +2034,18 @@ bool Server::handle(const Method action, const std::string& endpoint,
     return _impl->handle(action, endpoint, func);
 }
 
+bool Server::handle(const Method action, const std::string& endpoint,
+                    RESTFunc func, ExecutorPtr executor)
+{
+    return _impl->handle(action, endpoint, func, executor);
+}
+
+bool Server::serveDirectory(const std::string& endpoint,
+                            const std::string& path)
+{
+    return _impl->serveDirectory(endpoint, path);
+}
+
 bool Server::remove(const servus::Serializable& object)
 {
     return _impl->remove(object);
@@ -617,6 +2091,18 @@ bool Server::handlePUT(const std::string& endpoint, const std::string& schema,
     return _impl->handlePUT(endpoint, schema, func);
 }
 
+bool Server::handlePATCH(servus::Serializable& object)
+{
+    return _impl->handlePATCH(_convertEndpointName(object.getTypeName()),
+                              object);
+}
+
+bool Server::handlePATCH(const std::string& endpoint,
+                         servus::Serializable& object)
+{
+    return _impl->handlePATCH(endpoint, object);
+}
+
 bool Server::handleGET(const servus::Serializable& object)
 {
     return _impl->handleGET(_convertEndpointName(object.getTypeName()), object);
@@ -660,23 +2146,42 @@ void Server::addSockets(std::vector<detail::Socket>& entries)
     _impl->addSockets(entries);
 }
 
-bool Server::process(detail::Socket&)
+bool Server::process(detail::Socket& socket)
 {
+    // the request is answered on the socket of the I/O thread it came from
     Message* message = nullptr;
-    ::zmq_recv(_impl->socket.get(), &message, sizeof(message), 0);
+    ::zmq_recv(socket.socket, &message, sizeof(message), 0);
     if (!message)
         ZEROEQTHROW(std::runtime_error(
             "Could not receive HTTP request from HTTP server"));
 
-    if (_isCorsPreflightRequest(*message))
+    if (message->webSocketMessage)
+    {
+        _impl->processWebSocketMessage(*message);
+    }
+    else if (_isCorsPreflightRequest(*message))
     {
         _impl->processCorsPreflightRequest(*message);
     }
     else
     {
+        message->eventStream = _impl->getEventStream(message->request);
+        const bool measured = _impl->isMeasured();
+        const auto start = measured ? ServerMetrics::Clock::now()
+                                    : ServerMetrics::Clock::time_point();
+        const std::string* endpoint = nullptr;
         try
         {
-            message->response = respondTo(message->request);
+            Impl::Reply reply;
+            if (_impl->isWebSocketUpgrade(*message))
+                reply = _impl->respondToWebSocketUpgrade(*message, *this);
+            else if (_impl->isBatchRequest(message->request))
+                reply = _impl->respondToBatch(message->request, *this);
+            else
+                reply = _impl->respondThrough(message->request, *this);
+            message->response = std::move(reply.response);
+            message->pending = std::move(reply.pending);
+            endpoint = reply.endpoint;
         }
         catch (const std::exception& e)
         {
@@ -691,6 +2196,8 @@ bool Server::process(detail::Socket&)
                 make_ready_response(Code::INTERNAL_SERVER_ERROR,
                                     "An unknown exception occured");
         }
+        if (measured)
+            _impl->measure(*message, endpoint, start);
 
         // When a client makes a CORS request (by setting an 'Origin' header) it
         // expects an 'Access-Control-Allow-Origin' response header. See:
@@ -704,7 +2211,7 @@ bool Server::process(detail::Socket&)
     }
 
     bool done = true;
-    ::zmq_send(_impl->socket.get(), &done, sizeof(done), 0);
+    ::zmq_send(socket.socket, &done, sizeof(done), 0);
     return true;
 }
 }
@@ -18,6 +18,14 @@ namespace zeroeq
 {
 namespace http
 {
+/** Counters of the HTTP connections of a Server since its construction. */
+struct ConnectionStats
+{
+    uint64_t opened = 0; //!< accepted connections
+    uint64_t reused = 0; //!< requests after the first one of a connection
+    uint64_t closed = 0; //!< closed connections
+};
+
 /**
  * Serves HTTP GET and PUT requests for servus::Serializable objects.
  *
@@ -28,6 +36,23 @@ namespace http
  * insensitive. For example, zerobuf::render::Camera is served at
  * 'GET|PUT [uri]/zerobuf/render/camera'.
  *
+ * Clients may exchange the binary form of objects instead of JSON by sending
+ * 'Accept: application/octet-stream' with GET requests and
+ * 'Content-Type: application/octet-stream' with PUT requests. GET responses
+ * of objects therefore carry a 'Vary: Accept' header. Single members of
+ * objects are updated by PATCH requests with a JSON merge patch.
+ *
+ * Several requests can be sent in one round-trip with 'POST [uri]/batch' and a
+ * JSON array of {"method", "path", "body"} objects, where the optional body is
+ * a string or a JSON value. All requests are passed to respondTo() during one
+ * receive(), and answered with a JSON array of {"status", "headers", "body"}
+ * objects in the same order. JSON response bodies are embedded as JSON values,
+ * other bodies as strings. 'batch' is reserved like 'registry'.
+ *
+ * Successful GET responses support single byte range requests ('Range:
+ * bytes=first-last'), which are answered with 206 Partial Content or 416 Range
+ * Not Satisfiable, and advertise it with 'Accept-Ranges: bytes'.
+ *
  * Announces itself if a zeroconf implementation is available, including
  * "Type=ZeroEQ" in the zeroconf record.
  *
@@ -49,7 +74,27 @@ public:
      * (INADDR_ANY). If no port is given, the server selects a random port. Use
      * getURI() to retrieve the chosen parameters.
      *
+     * A URI of the form "unix:///path/to/socket" additionally serves requests
+     * on a Unix domain socket at the given path, for local clients which skip
+     * the TCP stack. The TCP server still listens on INADDR_ANY and a random
+     * port, and the socket path is announced in the "UnixSocket" zeroconf
+     * key. The socket serves one request per connection unless enabled with
+     * setKeepAlive(), and does not support streamed, event stream nor
+     * WebSocket responses. Its
+     * requests are handed to receive() over a separate queue, which
+     * getSocketDescriptor() does not signal. Clients are rate limited per
+     * process on Linux, and share the limits of the socket path elsewhere. Not
+     * available on Windows.
+     *
+     * If the library is built with ZEROEQ_HTTP_EPOLL on Linux, setting the
+     * environment variable ZEROEQ_HTTP_ENGINE=epoll before the construction
+     * serves TCP connections with an epoll engine instead of cppnetlib. It
+     * keeps connections alive and answers pipelined requests in order, but
+     * does not support streamed, event stream nor WebSocket responses, range
+     * requests, served directories, IPv6 nor Unix domain sockets.
+     *
      * @param uri The server address in the form "[tcp://][hostname][:port]"
+     *            or "unix:///path"
      * @param shared a shared receiver, see Receiver constructor.
      * @throw std::runtime_error on malformed URI or connection issues.
      */
@@ -72,7 +117,8 @@ public:
      * parameters:
      * * --zeroeq-http-server [host][:port]: Enable the server. The optional
      *   parameters configure the web server, running by default on INADDR_ANY
-     *   and a randomly chosen port
+     *   and a randomly chosen port. "unix:///path" adds a Unix domain socket
+     *   listener, see the constructor.
      */
     ZEROEQHTTP_API
     static std::unique_ptr<Server> parse(int argc, const char* const* argv);
@@ -101,6 +147,122 @@ public:
      *       std::runtime_error
      */
     ZEROEQHTTP_API SocketDescriptor getSocketDescriptor() const;
+
+    /**
+     * Set the minimum body size of compressed responses.
+     *
+     * Response bodies of at least the given size are compressed using gzip or
+     * deflate if the client accepts it with an Accept-Encoding header. The
+     * compressed bodies of successful GET requests are cached until the
+     * uncompressed body changes, up to 16 MB in total. Compression is done by
+     * the HTTP server thread, not during receive().
+     *
+     * @param size the minimum body size in bytes, default 1024. 0 disables
+     *             compression.
+     */
+    ZEROEQHTTP_API void setCompressionThreshold(size_t size);
+
+    /**
+     * Set the number of threads serving the HTTP connections.
+     *
+     * The threads share the listening socket and handle the reading, parsing,
+     * compression and writing of the requests they accept. Each one hands its
+     * requests over its own queue to receive() and waits for their responses,
+     * so that busy connections or slow responses on one thread don't delay
+     * the requests of the others. Threads are only added, lower counts than
+     * the current one are ignored.
+     *
+     * @param count the number of I/O threads, default 1.
+     * @note getSocketDescriptor() only signals the requests of the first
+     *       thread, call receive() regularly when using more threads.
+     */
+    ZEROEQHTTP_API void setIOThreads(size_t count);
+
+    /**
+     * Limit the request rate of each client for all endpoints.
+     *
+     * Every client, identified by Request::source, has a bucket of burst
+     * tokens refilled at the given rate. Requests arriving on an empty bucket
+     * are answered with 503 Service Unavailable and a Retry-After header by
+     * the HTTP server thread, without reading their payload nor reaching
+     * receive().
+     *
+     * @param rate the sustained number of requests per second, 0 to remove
+     *             the limit
+     * @param burst the number of requests accepted at once
+     */
+    ZEROEQHTTP_API void setRateLimit(double rate, size_t burst);
+
+    /**
+     * @overload
+     * @param endpoint limit the requests of each client for this endpoint, in
+     *                 addition to the limit for all endpoints
+     */
+    ZEROEQHTTP_API void setRateLimit(const std::string& endpoint, double rate,
+                                     size_t burst);
+
+    /**
+     * Set the maximum number of requests waiting for their response.
+     *
+     * Requests are queued from the time they are handed over to receive()
+     * until their response is ready, including deferred ones like long-poll
+     * requests. New requests beyond this limit are answered with 503 Service
+     * Unavailable and a Retry-After header by the HTTP server thread.
+     *
+     * @param count the maximum number of queued requests, default 0 for no
+     *              limit.
+     */
+    ZEROEQHTTP_API void setMaxQueuedRequests(size_t count);
+
+    /**
+     * Configure the persistent connections.
+     *
+     * HTTP/1.1 connections, and HTTP/1.0 ones asking for keep-alive, stay
+     * open after a response, and pipelined requests are answered in order.
+     * Connections are closed once they are idle for the given time, or after
+     * the given number of requests. Applies to the epoll engine and the Unix
+     * domain socket only: the default TCP server of cppnetlib serves one
+     * request per connection and closes it after the response, persistent
+     * TCP connections need ZEROEQ_HTTP_ENGINE=epoll. With the epoll engine,
+     * connections idle in the middle of a request head or body, or of a
+     * response, are closed after 10 seconds regardless of this timeout.
+     *
+     * @param timeout the idle time in milliseconds before a connection is
+     *                closed, default 5000 for the epoll engine and 0 for the
+     *                Unix domain socket; 0 closes each connection after one
+     *                request.
+     * @param maxRequests the number of requests served per connection,
+     *                    default 0 for no limit.
+     */
+    ZEROEQHTTP_API void setKeepAlive(uint32_t timeout, size_t maxRequests);
+
+    /** @return the counters of the connections of all listeners. */
+    ZEROEQHTTP_API ConnectionStats getConnectionStats() const;
+
+    /**
+     * Set the maximum payload size of requests.
+     *
+     * Requests announcing a larger Content-Length are answered with
+     * 413 Payload Too Large, without reading their payload.
+     *
+     * @param size the maximum payload size in bytes, default 0 for no limit.
+     */
+    ZEROEQHTTP_API void setMaxBodySize(size_t size);
+
+    /**
+     * Set the payload size from which requests are spilled to disk.
+     *
+     * Larger payloads are written to a temporary file while they are received,
+     * and passed to the handlers as a read-only memory mapping in
+     * Request::spilledPayload, leaving Request::body empty. Use
+     * Request::getPayload() to read either. The handlers registered for
+     * Serializable objects and PUTPayloadFunc read such payloads as usual.
+     *
+     * @param size the payload size in bytes, default 0 to keep all payloads in
+     *             memory.
+     * @note not supported on Windows, payloads are always kept in memory.
+     */
+    ZEROEQHTTP_API void setBodySpillSize(size_t size);
     //@}
 
     /**
@@ -115,17 +277,74 @@ public:
     ZEROEQHTTP_API bool handle(Method method, const std::string& endpoint,
                                RESTFunc func);
 
-    /** @name Object registration for PUT and GET requests */
+    /**
+     * Handle a single method on a given endpoint outside of receive().
+     *
+     * The callback is called on a thread of the executor with a copy of the
+     * request, and the connection is answered once its response is ready.
+     * receive() only routes the request, so a slow callback does not delay
+     * the other endpoints. The callback is called concurrently for several
+     * requests if the executor has more than one thread. The server waits
+     * for its callbacks still running on destruction.
+     *
+     * @param method to handle
+     * @param endpoint the endpoint to receive requests for
+     * @param func the callback function for serving the request
+     * @param executor the threads to call the callback on
+     * @return true if subscription was successful, false otherwise
+     * @sa Executor
+     */
+    ZEROEQHTTP_API bool handle(Method method, const std::string& endpoint,
+                               RESTFunc func, ExecutorPtr executor);
+
+    /**
+     * Enable or disable the coalescing of identical GET requests.
+     *
+     * Identical GET requests (same path, query and Accept header) on the given
+     * endpoint which arrive while the response to an earlier one is still
+     * being computed share that response, instead of calling the handler
+     * again. This applies to handlers whose response is not ready yet, e.g.
+     * those run by an Executor; the later requests are completed along with
+     * the first one, without blocking the HTTP server thread. Every request is
+     * still passed to respondTo(), only the response of the handler is shared.
+     *
+     * @param endpoint the endpoint as registered with handle()
+     * @param enable true to coalesce requests, false to handle each one
+     */
+    ZEROEQHTTP_API void setCoalescing(const std::string& endpoint,
+                                      bool enable = true);
+
+    /**
+     * Enable or disable the request metrics served on 'GET [uri]/metrics'.
+     *
+     * The metrics are served in the Prometheus text format, instead of any
+     * handler registered on the 'metrics' endpoint while enabled. They count
+     * the requests passed to receive() by method, endpoint and status code,
+     * with histograms of the time they were queued before receive(), of the
+     * time spent in respondTo() and of the request and response body sizes,
+     * and the number of open connections. Requests not handled by any
+     * endpoint are counted with an empty endpoint. Requests answered by the
+     * HTTP server thread alone, e.g. rejected ones or served files, are not
+     * counted.
+     *
+     * The counters are updated without locking; disabled metrics are not
+     * updated at all.
+     *
+     * @param enable true to update and serve the metrics, false to stop
+     */
+    ZEROEQHTTP_API void setMetrics(bool enable = true);
+
+    /** @name Object registration for PUT, PATCH and GET requests */
     //@{
     /**
-     * Handle PUT and GET for the given object.
+     * Handle PUT, PATCH and GET for the given object.
      *
      * @param object the object to update and serve on receive()
      * @return true if subscription was successful, false otherwise
      */
     bool handle(servus::Serializable& object)
     {
-        return handlePUT(object) && handleGET(object);
+        return handlePUT(object) && handlePATCH(object) && handleGET(object);
     }
 
     /**
@@ -137,7 +356,27 @@ public:
     ZEROEQHTTP_API bool handle(const std::string& endpoint,
                                servus::Serializable& object);
 
-    /** Remove PUT and GET handling for given object. */
+    /**
+     * Serve the files of a directory on the given endpoint.
+     *
+     * GET requests for "/endpoint/file" are answered with the file at
+     * "path/file" directly by the HTTP server thread, not during receive().
+     * Paths ending with a slash serve index.html, and an empty endpoint serves
+     * the directory on "/". Requests for missing files are handled by the
+     * other endpoints as usual.
+     *
+     * Files are read in slices and sent uncompressed, with a Content-Type
+     * derived from their extension, Last-Modified and ETag validators for
+     * conditional requests (304 Not Modified), and byte range support.
+     *
+     * @param endpoint the endpoint to serve the files on
+     * @param path the directory on the file system
+     * @return false if the endpoint already serves a directory
+     */
+    ZEROEQHTTP_API bool serveDirectory(const std::string& endpoint,
+                                       const std::string& path);
+
+    /** Remove PUT, PATCH and GET handling for given object. */
     ZEROEQHTTP_API bool remove(const servus::Serializable& object);
 
     /** Remove all handling for given endpoint. */
@@ -148,8 +387,9 @@ public:
      * requests.
      *
      * Every update will be directly applied on the object during receive()
-     * using fromJSON(). To track updates on the object, the serializable's
-     * updated function is called accordingly.
+     * using fromJSON(), or fromBinary() if the request has the
+     * 'application/octet-stream' content type. To track updates on the object,
+     * the serializable's updated function is called accordingly.
      *
      * The subscribed object instance has to be valid until remove().
      *
@@ -212,12 +452,39 @@ public:
     ZEROEQHTTP_API bool handlePUT(const std::string& endpoint,
                                   const std::string& schema,
                                   const PUTPayloadFunc& func);
+    /**
+     * Subscribe a serializable object to receive partial updates from HTTP
+     * PATCH requests.
+     *
+     * The request body is a JSON merge patch (RFC 7386), e.g.
+     * '{"fov": 60, "name": null}' to set the 'fov' member and remove the
+     * 'name' member of the object. The patch is applied on the JSON of the
+     * object during receive(), which is updated with fromJSON() and its
+     * updated function called accordingly. Binary payloads are rejected.
+     *
+     * The subscribed object instance has to be valid until remove().
+     *
+     * @param object the object to update on receive()
+     * @return true if subscription was successful, false otherwise
+     */
+    ZEROEQHTTP_API bool handlePATCH(servus::Serializable& object);
+
+    /**
+     * @overload
+     * @param object the object to update on receive()
+     * @param endpoint use this as the URL endpoint instead of the default
+     *                 servus::Serializable::getTypeName()
+     */
+    ZEROEQHTTP_API bool handlePATCH(const std::string& endpoint,
+                                    servus::Serializable& object);
+
     /**
      * Subscribe a serializable object to serve HTTP GET requests.
      *
      * Every request will be directly handled during receive() by using
-     * toJSON(). To track updates on the object, the serializable's received
-     * function is called accordingly.
+     * toJSON(), or toBinary() if the client prefers 'application/octet-stream'
+     * in its Accept header. To track updates on the object, the serializable's
+     * received function is called accordingly.
      *
      * The subscribed object instance has to be valid until remove().
      *
@@ -269,6 +536,169 @@ public:
     ZEROEQHTTP_API std::string getSchema(const std::string& endpoint) const;
     //@}
 
+    /** @name Long polling */
+    //@{
+    /**
+     * Notify the long-poll clients of an object registered with handleGET().
+     *
+     * Objects registered with handleGET() have a version, starting at 0 and
+     * incremented by every successful PUT request and every notify(), which
+     * GET responses return in the ETag header. The strong ETag of each
+     * representation differs: "<version>" for JSON, with a "-binary" suffix
+     * for toBinary() and a "-gzip" or "-deflate" suffix for compressed
+     * bodies. A 'GET /endpoint?since=<version>' request is answered as soon
+     * as the version of the object is newer than the given one, with the
+     * current version in the ETag response header. Otherwise it is answered
+     * with 304 Not Modified after the timeout set by setLongPollTimeout().
+     *
+     * Waiting requests are parked without blocking the HTTP server thread, and
+     * answered during notify() or the PUT request using the toJSON() or
+     * toBinary() serialization of the object. notify() may be called from any
+     * thread which may access the object.
+     *
+     * @param object the object which has changed
+     * @return true if the object is registered for GET requests, false
+     *         otherwise
+     */
+    ZEROEQHTTP_API bool notify(const servus::Serializable& object);
+
+    /** @overload */
+    ZEROEQHTTP_API bool notify(const std::string& endpoint);
+
+    /**
+     * Set the maximum time a long-poll request waits for a newer version.
+     *
+     * @param timeout the timeout in milliseconds, default 30000.
+     */
+    ZEROEQHTTP_API void setLongPollTimeout(uint32_t timeout);
+    //@}
+
+    /** @name Server-Sent Events */
+    //@{
+    /**
+     * Serve a text/event-stream of the events pushed to the given endpoint.
+     *
+     * A GET request on the endpoint keeps the connection open and receives all
+     * events pushed afterwards. The events are written by the HTTP server
+     * thread, independently of receive(). Each client has a buffer for the
+     * given number of events: if a client does not keep up, a buffered event
+     * of the same name is replaced by the newer one, otherwise the oldest
+     * buffered event is dropped.
+     *
+     * @param endpoint the endpoint to serve the events on
+     * @param bufferSize the maximum number of buffered events per client
+     * @return true if the endpoint was registered, false otherwise
+     */
+    ZEROEQHTTP_API bool handleEventStream(const std::string& endpoint,
+                                          size_t bufferSize = 64);
+
+    /**
+     * Push an event to all clients of an event stream endpoint.
+     *
+     * May be called from any thread, but not concurrently with the
+     * registration or removal of the endpoint.
+     *
+     * @param endpoint the event stream endpoint
+     * @param name the event name, empty for unnamed events which are never
+     *             replaced in the client buffers
+     * @param data the event data, may contain multiple lines
+     * @return true if the event was pushed, false if the endpoint is not an
+     *         event stream
+     */
+    ZEROEQHTTP_API bool pushEvent(const std::string& endpoint,
+                                  const std::string& name,
+                                  const std::string& data);
+
+    /**
+     * Push the events of an object received by a subscriber to an event
+     * stream endpoint.
+     *
+     * The object is updated from each received event and pushed as JSON, with
+     * its type name as event name. The subscriber may share this server's
+     * receiver. The object and this server have to be valid until the
+     * subscriber unsubscribes from the object.
+     *
+     * @param endpoint the event stream endpoint
+     * @param subscriber the subscriber to receive the events with
+     * @param object the object to update and push
+     * @return true if the subscription was successful, false otherwise
+     */
+    ZEROEQHTTP_API bool bridgeEvents(const std::string& endpoint,
+                                     Subscriber& subscriber,
+                                     servus::Serializable& object);
+    //@}
+
+    /** @name WebSocket */
+    //@{
+    /**
+     * Accept WebSocket connections on the given endpoint.
+     *
+     * WebSocket clients exchange events with the server in binary messages,
+     * each carrying the 16 bytes event identifier in network byte order
+     * followed by the event payload. Received events are dispatched during
+     * receive() like Subscriber events, see subscribe(). Published events are
+     * sent to all WebSocket clients, see publish(). Messages are compressed
+     * using permessage-deflate if negotiated by the client, following
+     * setCompressionThreshold(). Received messages are limited by
+     * setMaxBodySize().
+     *
+     * Each client has a send queue for the given number of messages. If a
+     * client does not keep up, its oldest queued message is dropped. Plain GET
+     * requests on the endpoint are answered with 426 Upgrade Required.
+     *
+     * Upgrade requests are passed to respondTo() like the other requests, the
+     * connection is only upgraded if it answers OK during receive(). Derived
+     * classes thereby reject WebSocket clients like other requests.
+     *
+     * @param endpoint the endpoint to accept WebSocket connections on
+     * @param queueSize the maximum number of queued messages per client
+     * @return true if the endpoint was registered, false otherwise
+     */
+    ZEROEQHTTP_API bool handleWebSocket(const std::string& endpoint,
+                                        size_t queueSize = 64);
+
+    /**
+     * Subscribe a serializable object to receive updates from WebSocket
+     * clients.
+     *
+     * Every update will be directly applied on the object during receive()
+     * using fromBinary().
+     *
+     * @param object the object to update on receive()
+     * @return true if subscription was successful, false otherwise
+     * @sa Subscriber::subscribe()
+     */
+    ZEROEQHTTP_API bool subscribe(servus::Serializable& object);
+
+    /** @overload */
+    ZEROEQHTTP_API bool subscribe(const uint128_t& event,
+                                  const EventFunc& func);
+
+    /** @overload */
+    ZEROEQHTTP_API bool subscribe(const uint128_t& event,
+                                  const EventPayloadFunc& func);
+
+    /** Unsubscribe a serializable object from WebSocket client updates. */
+    ZEROEQHTTP_API bool unsubscribe(const servus::Serializable& object);
+
+    /** @overload */
+    ZEROEQHTTP_API bool unsubscribe(const uint128_t& event);
+
+    /**
+     * Send a serializable object to all connected WebSocket clients.
+     *
+     * @param object the object to serialize using toBinary()
+     * @return true if the event was queued for at least one client, false
+     *         if no client is connected
+     * @sa Publisher::publish()
+     */
+    ZEROEQHTTP_API bool publish(const servus::Serializable& object);
+
+    /** @overload */
+    ZEROEQHTTP_API bool publish(const uint128_t& event,
+                                const void* data = nullptr, size_t size = 0);
+    //@}
+
 protected:
     /**
      * Respond to a request.
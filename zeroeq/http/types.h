@@ -9,6 +9,8 @@
 
 #include <functional>
 #include <future>
+#include <memory>
+#include <string>
 
 namespace zeroeq
 {
@@ -19,10 +21,14 @@ namespace zeroeq
  */
 namespace http
 {
+class Executor;
 class Server;
 struct Request;
 struct Response;
 
+/** Shared thread pool running REST callbacks, see Server::handle(). */
+using ExecutorPtr = std::shared_ptr<Executor>;
+
 /** HTTP PUT callback w/o payload, return reply success. */
 using PUTFunc = std::function<bool()>;
 
@@ -34,5 +40,13 @@ using GETFunc = std::function<std::string()>;
 
 /** HTTP REST callback with Request parameter returning a Response future. */
 using RESTFunc = std::function<std::future<Response>(const Request&)>;
+
+/**
+ * Producer of a streamed HTTP response body, see Response::stream.
+ *
+ * Fills the given (empty) chunk with the next part of the body, if any yet,
+ * returns false if this was the last chunk.
+ */
+using StreamFunc = std::function<bool(std::string& chunk)>;
 }
 }
@@ -0,0 +1,397 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "unixListener.h"
+
+#include "dispatcher.h"
+#include "protocol.h"
+#include "requestHandler.h"
+
+#include <zeroeq/log.h>
+#include <zeroeq/uri.h>
+
+#include <boost/asio.hpp>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory> // shared_from_this
+#include <stdexcept>
+
+namespace zeroeq
+{
+namespace http
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+namespace
+{
+using Protocol = boost::asio::local::stream_protocol;
+using ErrorCode = boost::system::error_code;
+
+const size_t readChunkSize = 16 * 1024;
+
+using DispatcherPtr = std::shared_ptr<Dispatcher>;
+
+// Identify the clients by their process where the platform tells, as they all
+// connect to the same path
+std::string _getSource(Protocol::socket& socket, const std::string& path)
+{
+#ifdef SO_PEERCRED
+    struct ucred credentials;
+    socklen_t size = sizeof(credentials);
+    if (::getsockopt(socket.native_handle(), SOL_SOCKET, SO_PEERCRED,
+                     &credentials, &size) == 0)
+    {
+        return path + ":" + std::to_string(credentials.pid);
+    }
+#else
+    (void)socket;
+#endif
+    return path;
+}
+
+// Reads the HTTP/1.1 requests of an accepted connection and answers them in
+// order, until the client closes the connection, the keep-alive limits are
+// reached or the connection is idle for too long. Owned by its pending
+// asynchronous operations.
+class UnixConnection : public std::enable_shared_from_this<UnixConnection>
+{
+public:
+    UnixConnection(boost::asio::io_service& ioService, RequestHandler& handler,
+                   DispatcherPtr dispatcher, const std::string& path)
+        : _ioService(ioService)
+        , _socket(ioService)
+        , _handler(handler)
+        , _dispatcher(std::move(dispatcher))
+        , _path(path)
+        , _buffer(maxRequestHeadSize)
+        , _timer(ioService)
+    {
+    }
+
+    ~UnixConnection()
+    {
+        if (_started)
+            ++_handler.getConnectionCounters().closed;
+    }
+
+    Protocol::socket& getSocket() { return _socket; }
+
+    void start()
+    {
+        _started = true;
+        _source = _getSource(_socket, _path);
+        ++_handler.getConnectionCounters().opened;
+        _readHead();
+    }
+
+private:
+    boost::asio::io_service& _ioService;
+    Protocol::socket _socket;
+    RequestHandler& _handler;
+    const DispatcherPtr _dispatcher;
+    const std::string _path;
+    std::string _source; // the client, see _getSource()
+    boost::asio::streambuf _buffer; // limited to maxRequestHeadSize
+    boost::asio::steady_timer _timer; // closes idle connections
+    bool _started = false;
+    size_t _requests = 0;
+    bool _keepAlive = false; // after the current request
+
+    std::string _requestHead;
+    RequestHead _head; // refers to _requestHead
+    std::string _body;
+    std::array<char, readChunkSize> _chunk;
+
+    Message _message; // of the current request
+    std::string _responseHead;
+    std::string _responseBody;
+
+    void _readHead()
+    {
+        auto self = shared_from_this();
+        const auto timeout = _handler.getKeepAliveTimeout();
+        if (timeout > 0)
+        {
+            _timer.expires_from_now(std::chrono::milliseconds(timeout));
+            _timer.async_wait([self](const ErrorCode& error) {
+                ErrorCode ignored;
+                if (!error)
+                    self->_socket.close(ignored);
+            });
+        }
+
+        boost::asio::async_read_until(_socket, _buffer, "\r\n\r\n",
+                                      [self](const ErrorCode& error,
+                                             const size_t size) {
+                                          self->_timer.cancel();
+                                          if (!error)
+                                              self->_readHeaders(size);
+                                      });
+    }
+
+    void _readHeaders(const size_t size)
+    {
+        const auto data = boost::asio::buffers_begin(_buffer.data());
+        _requestHead.assign(data, data + size);
+        _buffer.consume(size);
+
+        if (parseRequestHead(_requestHead.data(), _requestHead.size(),
+                             _head) != ParseResult::complete)
+        {
+            _reply(_head.error);
+            return;
+        }
+
+        const auto retryAfter =
+            _handler.admit(_source, URI(_head.target.str()).getPath());
+        if (retryAfter > 0)
+        {
+            _reply(Code::SERVICE_UNAVAILABLE, retryAfter);
+            return;
+        }
+
+        const size_t contentLength = _head.contentLength;
+        const size_t maxBodySize = _handler.getMaxBodySize();
+        if (maxBodySize > 0 && contentLength > maxBodySize)
+        {
+            _reply(Code::PAYLOAD_TOO_LARGE);
+            return;
+        }
+
+        // the beginning of the body may have been read with the headers
+        const size_t buffered = std::min(contentLength, _buffer.size());
+        const auto body = boost::asio::buffers_begin(_buffer.data());
+        _body.assign(body, body + buffered);
+        _buffer.consume(buffered);
+
+        if (_body.size() < contentLength)
+            _readBody(contentLength);
+        else
+            _handleRequest();
+    }
+
+    void _readBody(const size_t contentLength)
+    {
+        auto self = shared_from_this();
+        _socket.async_read_some(
+            boost::asio::buffer(_chunk),
+            [self, contentLength](const ErrorCode& error, const size_t size) {
+                if (error)
+                    return;
+
+                const size_t missing = contentLength - self->_body.size();
+                const size_t used = std::min(size, missing);
+                self->_body.append(self->_chunk.data(), used);
+
+                // keep the beginning of a pipelined request
+                if (size > used)
+                {
+                    const auto extra = size - used;
+                    boost::asio::buffer_copy(
+                        self->_buffer.prepare(extra),
+                        boost::asio::buffer(self->_chunk.data() + used, extra));
+                    self->_buffer.commit(extra);
+                }
+
+                if (self->_body.size() < contentLength)
+                    self->_readBody(contentLength);
+                else
+                    self->_handleRequest();
+            });
+    }
+
+    void _handleRequest()
+    {
+        if (_requests++ > 0)
+            ++_handler.getConnectionCounters().reused;
+        const size_t maxRequests = _handler.getMaxKeepAliveRequests();
+        _keepAlive = _head.keepAlive && _handler.getKeepAliveTimeout() > 0 &&
+                     (maxRequests == 0 || _requests < maxRequests);
+
+        _message = Message();
+        setRequest(_head, _source, _message);
+        _message.request.body.swap(_body);
+
+        auto self = shared_from_this();
+        _dispatcher->post([self] {
+            self->_handler.process(self->_message);
+            self->_ioService.post([self] { self->_handleResponse(); });
+        });
+    }
+
+    void _handleResponse()
+    {
+        // the response is completed later by the zeroeq::http::Server, on any
+        // thread; the socket is only used from the I/O threads
+        if (_message.pending)
+        {
+            auto self = shared_from_this();
+            _message.pending->onReady([self] {
+                self->_ioService.post([self] {
+                    auto response =
+                        self->_handler.takeResponse(self->_message.response,
+                                                    self->_message.route);
+                    self->_writeResponse(response, !self->_keepAlive);
+                });
+            });
+            return;
+        }
+
+        auto response =
+            _handler.takeResponse(_message.response, _message.route);
+        if (response.stream || (_message.eventStream && response.code == OK))
+            response = Response(Code::NOT_IMPLEMENTED);
+        _writeResponse(response, !_keepAlive);
+    }
+
+    // Answer an invalid or rejected request, whose body is not read, and
+    // close the connection
+    void _reply(const Code code, const uint32_t retryAfter = 0)
+    {
+        Response response(code);
+        if (retryAfter > 0)
+            response.headers[Header::RETRY_AFTER] = std::to_string(retryAfter);
+        _writeResponse(response, true);
+    }
+
+    void _writeResponse(Response& response, const bool close)
+    {
+        // only the unmodified GET resources are worth caching
+        static const std::string noCacheKey;
+        const bool cacheable =
+            _head.method == Method::GET && response.code == OK;
+        _handler.getCompressor().encode(
+            response, _head.getHeader("Accept-Encoding").str(),
+            cacheable ? _head.target.str() : noCacheKey);
+        if (response.code == Code::NOT_MODIFIED)
+            response.body.clear(); // not announced by appendResponseHead()
+
+        _responseHead.clear();
+        appendResponseHead(response, {},
+                           getConnectionHeader(_head.http10, close),
+                           _responseHead);
+        _responseBody.swap(response.body);
+
+        const std::array<boost::asio::const_buffer, 2> buffers{
+            {boost::asio::buffer(_responseHead),
+             boost::asio::buffer(_responseBody)}};
+        auto self = shared_from_this();
+        boost::asio::async_write(_socket, buffers,
+                                 [self, close](const ErrorCode& error,
+                                               const size_t) {
+                                     if (!error && !close)
+                                     {
+                                         self->_readHead();
+                                         return;
+                                     }
+                                     ErrorCode ignored;
+                                     self->_socket.shutdown(
+                                         Protocol::socket::shutdown_both,
+                                         ignored);
+                                 });
+    }
+};
+
+// Remove a socket left behind by a crashed process, which would fail the
+// bind. Other files are left alone, the bind reports them.
+void _removeStaleSocket(const std::string& path)
+{
+    struct stat info;
+    if (::stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+        ::unlink(path.c_str());
+}
+}
+
+struct UnixListener::Acceptor : public std::enable_shared_from_this<Acceptor>
+{
+    Acceptor(boost::asio::io_service& ioService_, RequestHandler& handler_,
+             const std::string& path_, const std::string& zmqURL)
+        : ioService(ioService_)
+        , acceptor(ioService_)
+        , handler(handler_)
+        , path(path_)
+        , dispatcher(std::make_shared<Dispatcher>(handler_, zmqURL))
+    {
+    }
+
+    void accept()
+    {
+        auto self = shared_from_this();
+        auto connection = std::make_shared<UnixConnection>(ioService, handler,
+                                                           dispatcher, path);
+        acceptor.async_accept(connection->getSocket(),
+                              [self, connection](const ErrorCode& error) {
+                                  if (!self->acceptor.is_open())
+                                      return;
+                                  if (!error)
+                                      connection->start();
+                                  self->accept();
+                              });
+    }
+
+    boost::asio::io_service& ioService;
+    Protocol::acceptor acceptor;
+    RequestHandler& handler;
+    const std::string path;
+    const DispatcherPtr dispatcher; // shared with the connections
+};
+
+UnixListener::UnixListener(boost::asio::io_service& ioService,
+                           const std::string& path, RequestHandler& handler,
+                           const std::string& zmqURL)
+    : _path(path)
+    , _acceptor(std::make_shared<Acceptor>(ioService, handler, path, zmqURL))
+{
+    _removeStaleSocket(path);
+
+    const Protocol::endpoint endpoint(path);
+    ErrorCode error;
+    _acceptor->acceptor.open(endpoint.protocol(), error);
+    if (!error)
+        _acceptor->acceptor.bind(endpoint, error);
+    if (!error)
+        _acceptor->acceptor.listen(boost::asio::socket_base::max_connections,
+                                   error);
+    if (error)
+    {
+        ZEROEQTHROW(std::runtime_error("Cannot listen on Unix socket " + path +
+                                       ": " + error.message()));
+    }
+    _acceptor->accept();
+}
+
+UnixListener::~UnixListener()
+{
+    ErrorCode ignored;
+    _acceptor->acceptor.close(ignored);
+    _acceptor->dispatcher->stop();
+    ::unlink(_path.c_str());
+}
+#else
+struct UnixListener::Acceptor
+{
+};
+
+UnixListener::UnixListener(boost::asio::io_service&, const std::string& path,
+                           RequestHandler&, const std::string&)
+    : _path(path)
+{
+    ZEROEQTHROW(std::runtime_error(
+        "Unix domain sockets are not supported on this platform"));
+}
+
+UnixListener::~UnixListener()
+{
+}
+#endif
+}
+}
@@ -0,0 +1,54 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_UNIXLISTENER_H
+#define ZEROEQ_HTTP_UNIXLISTENER_H
+
+#include <boost/asio/io_service.hpp>
+
+#include <memory>
+#include <string>
+
+namespace zeroeq
+{
+namespace http
+{
+class RequestHandler;
+
+// Accepts HTTP/1.1 requests on a Unix domain socket on the I/O threads of the
+// cppnetlib server, and hands them to the RequestHandler from a thread with its
+// own socket to the zeroeq::http::Server. Clients are identified by their
+// process where supported, by the socket path otherwise. Connections are kept
+// alive as configured in the RequestHandler; streamed, event stream and
+// WebSocket responses are not supported.
+class UnixListener
+{
+public:
+    /**
+     * Bind and listen on the given socket path, replacing a stale socket.
+     *
+     * @param zmqURL URL to the inproc socket handing over the requests, see
+     *        RequestHandler::connectThread()
+     * @throw std::runtime_error if the socket cannot be bound, or if Unix
+     *        domain sockets are not supported on this platform.
+     */
+    UnixListener(boost::asio::io_service& ioService, const std::string& path,
+                 RequestHandler& handler, const std::string& zmqURL);
+
+    /** Close the socket, drop the unhandled requests and remove its path. */
+    ~UnixListener();
+
+    const std::string& getPath() const { return _path; }
+
+private:
+    struct Acceptor;
+
+    const std::string _path;
+    std::shared_ptr<Acceptor> _acceptor; // shared with the pending accept
+};
+}
+}
+
+#endif
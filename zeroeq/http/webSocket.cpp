@@ -0,0 +1,337 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "webSocket.h"
+
+#include "compression.h"
+
+#include <boost/archive/iterators/base64_from_binary.hpp>
+#include <boost/archive/iterators/transform_width.hpp>
+#include <boost/uuid/detail/sha1.hpp>
+#include <boost/version.hpp>
+#include <algorithm>
+#include <array>
+
+namespace zeroeq
+{
+namespace http
+{
+namespace
+{
+const std::string WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const std::string DEFLATE_TAIL("\x00\x00\xff\xff", 4); // RFC 7692, 7.2.1
+const size_t eventSize = 16;                           // uint128_t
+
+// SHA-1 of the opening handshake, from the WebSocket key and GUID
+std::array<uint8_t, 20> _sha1(const std::string& input)
+{
+    boost::uuids::detail::sha1 sha1;
+    sha1.process_bytes(input.data(), input.size());
+    boost::uuids::detail::sha1::digest_type hash;
+    sha1.get_digest(hash);
+
+    std::array<uint8_t, 20> digest;
+#if BOOST_VERSION >= 108600 // digest of bytes instead of 32 bit words
+    std::copy(hash, hash + 20, digest.begin());
+#else
+    for (size_t i = 0; i < 20; ++i)
+        digest[i] = uint8_t(hash[i / 4] >> (24 - (i % 4) * 8));
+#endif
+    return digest;
+}
+
+std::string _base64(const std::array<uint8_t, 20>& data)
+{
+    namespace it = boost::archive::iterators;
+    using Base64 = it::base64_from_binary<
+        it::transform_width<std::array<uint8_t, 20>::const_iterator, 6, 8>>;
+    std::string out(Base64(data.begin()), Base64(data.end()));
+    out.append((3 - data.size() % 3) % 3, '=');
+    return out;
+}
+
+void _appendUInt(std::string& out, const uint64_t value, const size_t bytes)
+{
+    for (size_t i = bytes; i > 0; --i)
+        out.push_back(char((value >> ((i - 1) * 8)) & 0xff));
+}
+
+uint64_t _readUInt(const std::string& in, const size_t pos, const size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        value = (value << 8) | uint8_t(in[pos + i]);
+    return value;
+}
+}
+
+std::string computeWebSocketAccept(const std::string& key)
+{
+    return _base64(_sha1(key + WEBSOCKET_GUID));
+}
+
+bool offersPerMessageDeflate(const std::string& extensions)
+{
+    size_t begin = 0;
+    while (begin < extensions.size())
+    {
+        auto end = extensions.find(',', begin);
+        if (end == std::string::npos)
+            end = extensions.size();
+
+        const auto offer = extensions.substr(begin, end - begin);
+        const auto first = offer.find_first_not_of(" \t");
+        if (first != std::string::npos &&
+            offer.compare(first, 18, "permessage-deflate") == 0)
+        {
+            return true;
+        }
+        begin = end + 1;
+    }
+    return false;
+}
+
+std::string encodeWebSocketFrame(const Opcode opcode,
+                                 const std::string& payload,
+                                 const bool compressed)
+{
+    std::string frame;
+    frame.reserve(payload.size() + 10);
+    frame.push_back(char(0x80 | (compressed ? 0x40 : 0) | uint8_t(opcode)));
+
+    const size_t size = payload.size();
+    if (size < 126)
+        frame.push_back(char(size));
+    else if (size <= 0xffff)
+    {
+        frame.push_back(char(126));
+        _appendUInt(frame, size, 2);
+    }
+    else
+    {
+        frame.push_back(char(127));
+        _appendUInt(frame, size, 8);
+    }
+    frame.append(payload);
+    return frame;
+}
+
+std::string encodeClosePayload(const uint16_t code)
+{
+    std::string payload;
+    _appendUInt(payload, code, 2);
+    return payload;
+}
+
+std::string encodeWebSocketEvent(const uint128_t& event, const void* data,
+                                 const size_t size)
+{
+    std::string message;
+    message.reserve(eventSize + size);
+    _appendUInt(message, event.high(), 8);
+    _appendUInt(message, event.low(), 8);
+    if (size > 0)
+        message.append(static_cast<const char*>(data), size);
+    return message;
+}
+
+bool decodeWebSocketEvent(const std::string& message, uint128_t& event,
+                          const char*& data, size_t& size)
+{
+    if (message.size() < eventSize)
+        return false;
+
+    event = uint128_t(_readUInt(message, 0, 8), _readUInt(message, 8, 8));
+    data = message.data() + eventSize;
+    size = message.size() - eventSize;
+    return true;
+}
+
+WebSocketDecoder::WebSocketDecoder(const bool deflate,
+                                   const size_t maxMessageSize)
+    : _deflate(deflate)
+    , _maxMessageSize(maxMessageSize)
+{
+}
+
+bool WebSocketDecoder::decode(const char* data, const size_t size,
+                              const MessageFunc& onMessage,
+                              const ControlFunc& onControl)
+{
+    _buffer.append(data, size);
+
+    size_t pos = 0;
+    while (_buffer.size() - pos >= 2)
+    {
+        const auto available = _buffer.size() - pos;
+        const uint8_t byte0 = _buffer[pos];
+        const uint8_t byte1 = _buffer[pos + 1];
+        const bool fin = byte0 & 0x80;
+        const bool rsv1 = byte0 & 0x40;
+        const auto opcode = Opcode(byte0 & 0x0f);
+
+        // clients have to mask their frames (RFC 6455, 5.1)
+        if ((byte0 & 0x30) || (rsv1 && !_deflate) || !(byte1 & 0x80))
+            return _error(CLOSE_PROTOCOL_ERROR);
+
+        uint64_t length = byte1 & 0x7f;
+        size_t header = 2;
+        if (length == 126)
+            header = 4;
+        else if (length == 127)
+            header = 10;
+        if (available < header + 4)
+            break;
+        if (header > 2)
+            length = _readUInt(_buffer, pos + 2, header - 2);
+
+        if (_maxMessageSize > 0 &&
+            length + _message.size() > uint64_t(_maxMessageSize))
+        {
+            return _error(CLOSE_MESSAGE_TOO_BIG);
+        }
+        if (length > available - header - 4)
+            break;
+
+        const auto mask = _buffer.data() + pos + header;
+        std::string payload = _buffer.substr(pos + header + 4, size_t(length));
+        for (size_t i = 0; i < payload.size(); ++i)
+            payload[i] ^= mask[i % 4];
+        pos += header + 4 + size_t(length);
+
+        if (!_decodeFrame(opcode, fin, rsv1, payload, onMessage, onControl))
+            return false;
+    }
+    _buffer.erase(0, pos);
+    return true;
+}
+
+bool WebSocketDecoder::_error(const uint16_t code)
+{
+    _closeCode = code;
+    _buffer.clear();
+    _message.clear();
+    return false;
+}
+
+bool WebSocketDecoder::_decodeFrame(const Opcode opcode, const bool fin,
+                                    const bool rsv1, std::string& payload,
+                                    const MessageFunc& onMessage,
+                                    const ControlFunc& onControl)
+{
+    switch (opcode)
+    {
+    case Opcode::close:
+    case Opcode::ping:
+    case Opcode::pong:
+        if (!fin || rsv1 || payload.size() > 125)
+            return _error(CLOSE_PROTOCOL_ERROR);
+        onControl(opcode, payload);
+        return true;
+
+    case Opcode::text:
+        return _error(CLOSE_UNSUPPORTED_DATA); // events are binary
+
+    case Opcode::binary:
+        if (_fragmented)
+            return _error(CLOSE_PROTOCOL_ERROR);
+        _compressed = rsv1;
+        _message.swap(payload);
+        break;
+
+    case Opcode::continuation:
+        if (!_fragmented || rsv1)
+            return _error(CLOSE_PROTOCOL_ERROR);
+        _message.append(payload);
+        break;
+
+    default:
+        return _error(CLOSE_PROTOCOL_ERROR);
+    }
+
+    _fragmented = !fin;
+    if (_fragmented)
+        return true;
+
+    if (_compressed)
+    {
+        std::string inflated;
+        if (!inflateRaw(_message + DEFLATE_TAIL, _maxMessageSize, inflated))
+            return _error(_maxMessageSize > 0 ? CLOSE_MESSAGE_TOO_BIG
+                                              : CLOSE_PROTOCOL_ERROR);
+        _message.swap(inflated);
+    }
+
+    onMessage(_message);
+    _message.clear();
+    return true;
+}
+
+SendQueuePtr WebSocketHub::addClient(const size_t queueSize, const bool deflate,
+                                     std::function<void()> notify)
+{
+    auto queue = std::make_shared<SendQueue>(queueSize, std::move(notify));
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_closed)
+        queue->close();
+    else
+        _clients.push_back({queue, deflate});
+    return queue;
+}
+
+bool WebSocketHub::publish(const std::string& message,
+                           const size_t compressionThreshold)
+{
+    std::vector<Client> clients;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto isClosed = [](const Client& client) {
+            return client.queue->isClosed();
+        };
+        _clients.erase(std::remove_if(_clients.begin(), _clients.end(),
+                                      isClosed),
+                       _clients.end());
+        clients = _clients;
+    }
+    if (clients.empty())
+        return false;
+
+    // each message is compressed on its own, without context takeover
+    const auto frame = encodeWebSocketFrame(Opcode::binary, message);
+    std::string compressedFrame;
+    const bool compress =
+        compressionThreshold > 0 && message.size() >= compressionThreshold;
+    for (const auto& client : clients)
+    {
+        if (client.deflate && compress && compressedFrame.empty())
+        {
+            auto compressed = deflateRaw(message);
+            if (compressed.size() >= DEFLATE_TAIL.size())
+                compressed.resize(compressed.size() - DEFLATE_TAIL.size());
+            compressedFrame =
+                compressed.empty() || compressed.size() >= message.size()
+                    ? frame
+                    : encodeWebSocketFrame(Opcode::binary, compressed, true);
+        }
+        client.queue->push(std::string(), client.deflate && compress
+                                              ? compressedFrame
+                                              : frame);
+    }
+    return true;
+}
+
+void WebSocketHub::close()
+{
+    std::vector<Client> clients;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        clients.swap(_clients);
+    }
+    for (const auto& client : clients)
+        client.queue->close();
+}
+}
+}
@@ -0,0 +1,161 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_HTTP_WEBSOCKET_H
+#define ZEROEQ_HTTP_WEBSOCKET_H
+
+#include "sendQueue.h"
+
+#include <zeroeq/types.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace zeroeq
+{
+namespace http
+{
+// WebSocket frame opcodes (RFC 6455, 5.2)
+enum class Opcode : uint8_t
+{
+    continuation = 0x0,
+    text = 0x1,
+    binary = 0x2,
+    close = 0x8,
+    ping = 0x9,
+    pong = 0xA
+};
+
+// WebSocket close status codes (RFC 6455, 7.4.1)
+enum CloseCode : uint16_t
+{
+    CLOSE_NORMAL = 1000,
+    CLOSE_PROTOCOL_ERROR = 1002,
+    CLOSE_UNSUPPORTED_DATA = 1003,
+    CLOSE_MESSAGE_TOO_BIG = 1009
+};
+
+/** @return the Sec-WebSocket-Accept value for a Sec-WebSocket-Key. */
+std::string computeWebSocketAccept(const std::string& key);
+
+/**
+ * @return true if the Sec-WebSocket-Extensions request header offers the
+ *         permessage-deflate extension (RFC 7692).
+ */
+bool offersPerMessageDeflate(const std::string& extensions);
+
+/**
+ * @return an unmasked server frame with the given payload, with the RSV1 bit
+ *         set for compressed payloads.
+ */
+std::string encodeWebSocketFrame(Opcode opcode, const std::string& payload,
+                                 bool compressed = false);
+
+/** @return the payload of a close frame with the given status code. */
+std::string encodeClosePayload(uint16_t code);
+
+/**
+ * @return the binary message for an event: the event identifier as 16 bytes
+ *         in network byte order followed by the event payload.
+ */
+std::string encodeWebSocketEvent(const uint128_t& event, const void* data,
+                                 size_t size);
+
+/**
+ * Split a binary message into the event identifier and its payload.
+ * @return false if the message is too short to hold an event identifier.
+ */
+bool decodeWebSocketEvent(const std::string& message, uint128_t& event,
+                          const char*& data, size_t& size);
+
+// Decodes the frames received from a WebSocket client into complete messages,
+// independently of the transport.
+class WebSocketDecoder
+{
+public:
+    using MessageFunc = std::function<void(const std::string&)>;
+    using ControlFunc = std::function<void(Opcode, const std::string&)>;
+
+    /**
+     * @param deflate true if permessage-deflate has been negotiated
+     * @param maxMessageSize the maximum (decompressed) message size, 0 for no
+     *                       limit
+     */
+    WebSocketDecoder(bool deflate, size_t maxMessageSize);
+
+    /**
+     * Decode received data, buffering incomplete frames.
+     *
+     * @param data the received data
+     * @param size the size of the received data
+     * @param onMessage called for each complete binary message
+     * @param onControl called for each ping, pong and close frame
+     * @return false on a protocol error, the connection has to be closed
+     *         using getCloseCode().
+     */
+    bool decode(const char* data, size_t size, const MessageFunc& onMessage,
+                const ControlFunc& onControl);
+
+    /** @return the close status code after a protocol error. */
+    uint16_t getCloseCode() const { return _closeCode; }
+
+private:
+    const bool _deflate;
+    const size_t _maxMessageSize;
+    std::string _buffer;  // received data not decoded yet
+    std::string _message; // payload of the fragments of the current message
+    bool _fragmented = false;
+    bool _compressed = false;
+    uint16_t _closeCode = CLOSE_NORMAL;
+
+    bool _error(uint16_t code);
+    bool _decodeFrame(Opcode opcode, bool fin, bool rsv1, std::string& payload,
+                      const MessageFunc& onMessage,
+                      const ControlFunc& onControl);
+};
+
+// The WebSocket clients of a zeroeq::http::Server, distributing the published
+// messages to the send queues of all connected clients.
+class WebSocketHub
+{
+public:
+    /** Add a client, called from the cppnetlib thread. */
+    SendQueuePtr addClient(size_t queueSize, bool deflate,
+                           std::function<void()> notify);
+
+    /**
+     * Send a binary message to all open clients, and prune the closed ones.
+     *
+     * @param message the message to send
+     * @param compressionThreshold the minimum size of messages compressed for
+     *                             the clients which negotiated
+     *                             permessage-deflate, 0 to never compress
+     * @return true if the message was queued for at least one client
+     */
+    bool publish(const std::string& message, size_t compressionThreshold);
+
+    /** Close all clients, they are disconnected once idle. */
+    void close();
+
+private:
+    struct Client
+    {
+        SendQueuePtr queue;
+        bool deflate;
+    };
+
+    std::mutex _mutex;
+    std::vector<Client> _clients;
+    bool _closed = false;
+};
+
+using WebSocketHubPtr = std::shared_ptr<WebSocketHub>;
+}
+}
+
+#endif
@@ -0,0 +1,279 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#include "metrics.h"
+
+#include "detail/metrics.h"
+#include "publisher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace zeroeq
+{
+namespace
+{
+// The counters of all types, never removed since the caches refer to them
+struct Registry
+{
+    std::mutex mutex;
+    std::map<uint128_t, std::unique_ptr<detail::EventCounters>> counters;
+    std::map<uint128_t, std::unique_ptr<detail::SourceCounters>> sources;
+};
+
+Registry& _getRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+Metrics::Time _getTime(const detail::TimeCounter& counter)
+{
+    Metrics::Time time;
+    time.count = counter.count.load(std::memory_order_relaxed);
+    time.total = counter.total.load(std::memory_order_relaxed);
+    time.max = counter.max.load(std::memory_order_relaxed);
+    return time;
+}
+
+Metrics::Latency _getLatency(const detail::LatencyHistogram& histogram)
+{
+    Metrics::Latency latency;
+    static_cast<Metrics::Time&>(latency) = _getTime(histogram.time);
+    latency.p50 = histogram.getPercentile(.5);
+    latency.p90 = histogram.getPercentile(.9);
+    latency.p99 = histogram.getPercentile(.99);
+    latency.p999 = histogram.getPercentile(.999);
+    return latency;
+}
+
+void _writeTime(const Metrics::Time& time, std::ostream& os)
+{
+    os << "{\"count\":" << time.count << ",\"total\":" << time.total
+       << ",\"max\":" << time.max << "}";
+}
+
+void _writeLatency(const Metrics::Latency& latency, std::ostream& os)
+{
+    os << "{\"count\":" << latency.count << ",\"total\":" << latency.total
+       << ",\"max\":" << latency.max << ",\"p50\":" << latency.p50
+       << ",\"p90\":" << latency.p90 << ",\"p99\":" << latency.p99
+       << ",\"p999\":" << latency.p999 << "}";
+}
+
+size_t _getHighestBit(const uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+}
+
+namespace detail
+{
+std::atomic<bool> MetricsCache::_enabled{false};
+
+void TimeCounter::add(const Clock::duration duration)
+{
+    const uint64_t us =
+        std::chrono::duration_cast<std::chrono::microseconds>(duration)
+            .count();
+    count.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (us > current &&
+           !max.compare_exchange_weak(current, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::add(const uint64_t us)
+{
+    time.add(std::chrono::microseconds(us));
+    buckets[getBucket(us)].fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::getBucket(const uint64_t value)
+{
+    if (value < subBuckets)
+        return value;
+
+    const size_t bit = _getHighestBit(value);
+    const size_t sub = (value >> (bit - subBucketBits)) & (subBuckets - 1);
+    return subBuckets * (bit - subBucketBits + 1) + sub;
+}
+
+uint64_t LatencyHistogram::getLowest(const size_t bucket)
+{
+    if (bucket < subBuckets)
+        return bucket;
+
+    const size_t bit = bucket / subBuckets + subBucketBits - 1;
+    const uint64_t sub = bucket % subBuckets;
+    return (subBuckets + sub) << (bit - subBucketBits);
+}
+
+uint64_t LatencyHistogram::getPercentile(const double fraction) const
+{
+    const uint64_t count = time.count.load(std::memory_order_relaxed);
+    if (count == 0)
+        return 0;
+
+    const uint64_t rank = std::max<uint64_t>(1, std::ceil(fraction * count));
+    const uint64_t max = time.max.load(std::memory_order_relaxed);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < numBuckets - 1; ++i)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) // highest value of the bucket, at most the maximum
+            return std::min(getLowest(i + 1) - 1, max);
+    }
+    return max;
+}
+
+EventCounters& MetricsCache::_register(const uint128_t& type)
+{
+    Registry& registry = _getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto& counters = registry.counters[type];
+    if (!counters)
+        counters.reset(new EventCounters);
+    return *counters;
+}
+
+SourceCounters& MetricsCache::_registerSource(const uint128_t& publisher)
+{
+    Registry& registry = _getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto& counters = registry.sources[publisher];
+    if (!counters)
+        counters.reset(new SourceCounters);
+    return *counters;
+}
+}
+
+const Metrics::Event* Metrics::Snapshot::find(const uint128_t& type) const
+{
+    const auto i = std::lower_bound(events.begin(), events.end(), type,
+                                    [](const Event& event,
+                                       const uint128_t& value) {
+                                        return event.type < value;
+                                    });
+    return i != events.end() && i->type == type ? &*i : nullptr;
+}
+
+const Metrics::Source* Metrics::Snapshot::findSource(
+    const uint128_t& publisher) const
+{
+    const auto i = std::lower_bound(sources.begin(), sources.end(), publisher,
+                                    [](const Source& source,
+                                       const uint128_t& value) {
+                                        return source.publisher < value;
+                                    });
+    return i != sources.end() && i->publisher == publisher ? &*i : nullptr;
+}
+
+std::string Metrics::Snapshot::toJSON() const
+{
+    std::ostringstream os;
+    os << "{\"events\":[";
+    for (auto i = events.begin(); i != events.end(); ++i)
+    {
+        if (i != events.begin())
+            os << ",";
+        os << "{\"type\":\"" << i->type.getString() << "\",\"sent\":"
+           << i->sent << ",\"sentBytes\":" << i->sentBytes
+           << ",\"received\":" << i->received
+           << ",\"receivedBytes\":" << i->receivedBytes
+           << ",\"dropped\":" << i->dropped << ",\"lost\":" << i->lost
+           << ",\"handlerTime\":";
+        _writeTime(i->handlerTime, os);
+        os << ",\"roundTripTime\":";
+        _writeTime(i->roundTripTime, os);
+        os << "}";
+    }
+    os << "],\"sources\":[";
+    for (auto i = sources.begin(); i != sources.end(); ++i)
+    {
+        if (i != sources.begin())
+            os << ",";
+        os << "{\"publisher\":\"" << i->publisher.getString()
+           << "\",\"received\":" << i->received << ",\"lost\":" << i->lost
+           << ",\"latency\":";
+        _writeLatency(i->latency, os);
+        os << "}";
+    }
+    os << "]}";
+    return os.str();
+}
+
+void Metrics::setEnabled(const bool enabled)
+{
+    detail::MetricsCache::_enabled = enabled;
+}
+
+bool Metrics::isEnabled()
+{
+    return detail::MetricsCache::isMetricsEnabled();
+}
+
+Metrics::Snapshot Metrics::getSnapshot()
+{
+    Registry& registry = _getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    Snapshot snapshot;
+    snapshot.events.reserve(registry.counters.size());
+    for (const auto& i : registry.counters)
+    {
+        const detail::EventCounters& counters = *i.second;
+        Event event;
+        event.type = i.first;
+        event.sent = counters.sent.load(std::memory_order_relaxed);
+        event.sentBytes = counters.sentBytes.load(std::memory_order_relaxed);
+        event.received = counters.received.load(std::memory_order_relaxed);
+        event.receivedBytes =
+            counters.receivedBytes.load(std::memory_order_relaxed);
+        event.dropped = counters.dropped.load(std::memory_order_relaxed);
+        event.lost = counters.lost.load(std::memory_order_relaxed);
+        event.handlerTime = _getTime(counters.handlerTime);
+        event.roundTripTime = _getTime(counters.roundTripTime);
+        snapshot.events.push_back(event);
+    }
+
+    snapshot.sources.reserve(registry.sources.size());
+    for (const auto& i : registry.sources)
+    {
+        const detail::SourceCounters& counters = *i.second;
+        Source source;
+        source.publisher = i.first;
+        source.received = counters.received.load(std::memory_order_relaxed);
+        source.lost = counters.lost.load(std::memory_order_relaxed);
+        source.latency = _getLatency(counters.latency);
+        snapshot.sources.push_back(source);
+    }
+    return snapshot;
+}
+
+bool Metrics::publish(Publisher& publisher)
+{
+    const std::string json = getSnapshot().toJSON();
+    return publisher.publish(METRICS_EVENT, json.data(), json.size());
+}
+}
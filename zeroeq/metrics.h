@@ -0,0 +1,115 @@
+
+/* Copyright (c) 2017, Human Brain Project
+ *                     Stefan.Eilemann@epfl.ch
+ */
+
+#ifndef ZEROEQ_METRICS_H
+#define ZEROEQ_METRICS_H
+
+#include <zeroeq/api.h>
+#include <zeroeq/types.h>
+
+#include <string>
+#include <vector>
+
+namespace zeroeq
+{
+/** The event type of the snapshots sent by Metrics::publish(). */
+static const uint128_t METRICS_EVENT(make_uint128("zeroeq::Metrics"));
+
+/**
+ * Process-wide counters of the messages of all publishers, subscribers,
+ * servers and clients, per event and request type.
+ *
+ * Subscribers also count the events received from each publisher which sends
+ * an extended header, and measure their latency and losses.
+ *
+ * Collection is disabled by default. Once enabled, the counters are updated
+ * without locking; only the first message of a type on an object takes a lock
+ * to register the type.
+ *
+ * Example: @include tests/metrics.cpp
+ */
+class Metrics
+{
+public:
+    /** Durations in microseconds. */
+    struct Time
+    {
+        uint64_t count = 0; //!< number of measured durations
+        uint64_t total = 0; //!< sum of all durations
+        uint64_t max = 0;   //!< longest duration
+    };
+
+    /** Latencies in microseconds, with their distribution. */
+    struct Latency : public Time
+    {
+        uint64_t p50 = 0;  //!< median
+        uint64_t p90 = 0;  //!< 90th percentile
+        uint64_t p99 = 0;  //!< 99th percentile
+        uint64_t p999 = 0; //!< 99.9th percentile
+    };
+
+    /**
+     * The events received from one publisher with an extended header.
+     *
+     * @sa Publisher::setExtendedHeader()
+     */
+    struct Source
+    {
+        uint128_t publisher;   //!< the random identifier of the publisher
+        uint64_t received = 0; //!< subscribed events with a header
+        uint64_t lost = 0;     //!< missed events, from the sequence numbers
+        Latency latency;       //!< from publish to receive, across clocks
+    };
+
+    /** The counters of one event or request type. */
+    struct Event
+    {
+        uint128_t type;             //!< the event or request type
+        uint64_t sent = 0;          //!< published events, requests, replies
+        uint64_t sentBytes = 0;     //!< the payload bytes of sent messages
+        uint64_t received = 0;      //!< events, requests and replies
+        uint64_t receivedBytes = 0; //!< the payload bytes of received messages
+        uint64_t dropped = 0;       //!< failed sends, unhandled messages
+        uint64_t lost = 0;          //!< events missed by subscribers
+        Time handlerTime;           //!< in subscriber and server handlers
+        Time roundTripTime;         //!< from Client::request() to its reply
+    };
+
+    /** All counters at one point in time. */
+    struct Snapshot
+    {
+        std::vector<Event> events;   //!< sorted by type
+        std::vector<Source> sources; //!< sorted by publisher
+
+        /** @return the counters of the given type, or null if none. */
+        ZEROEQ_API const Event* find(const uint128_t& type) const;
+
+        /** @return the counters of the given publisher, or null if none. */
+        ZEROEQ_API const Source* findSource(const uint128_t& publisher) const;
+
+        /** @return the snapshot as a JSON object with events and sources. */
+        ZEROEQ_API std::string toJSON() const;
+    };
+
+    /** Enable or disable the collection of metrics in this process. */
+    ZEROEQ_API static void setEnabled(bool enabled = true);
+
+    /** @return true if metrics are collected. */
+    ZEROEQ_API static bool isEnabled();
+
+    /** @return the current value of all counters. */
+    ZEROEQ_API static Snapshot getSnapshot();
+
+    /**
+     * Publish the JSON of a snapshot on the METRICS_EVENT.
+     *
+     * @param publisher the publisher to send the snapshot with
+     * @return true if publish was successful
+     */
+    ZEROEQ_API static bool publish(Publisher& publisher);
+};
+}
+
+#endif
@@ -9,7 +9,10 @@
 #include "detail/byteswap.h"
 #include "detail/common.h"
 #include "detail/constants.h"
+#include "detail/header.h"
+#include "detail/metrics.h"
 #include "detail/sender.h"
+#include "detail/trace.h"
 #include "log.h"
 
 #include <servus/serializable.h>
@@ -18,6 +21,7 @@
 
 #include <cstring>
 #include <map>
+#include <unordered_map>
 
 namespace zeroeq
 {
@@ -45,6 +49,9 @@ public:
     }
 
     ~Impl() {}
+    void setExtendedHeader(const bool enable) { _extendedHeader = enable; }
+    const uint128_t& getIdentifier() const { return _identifier; }
+
     bool publish(const servus::Serializable& serializable)
     {
         const servus::Serializable::Data& data = serializable.toBinary();
@@ -54,14 +61,49 @@ public:
 
     bool publish(uint128_t event, const void* data, const size_t size)
     {
+        detail::EventCounters* counters = _metrics.get(event);
+        if (!_send(event, data, size))
+        {
+            if (counters)
+                counters->countDropped();
+            return false;
+        }
+        if (counters)
+            counters->countSent(data ? size : 0);
+        return true;
+    }
+
+private:
+    detail::MetricsCache _metrics;
+    const uint128_t _identifier{servus::make_UUID()};
+    bool _extendedHeader{false};
+    std::unordered_map<uint128_t, uint64_t> _sequences; // next, per event
+
+    bool _send(uint128_t event, const void* data, const size_t size)
+    {
+        ZEROEQ_TRACE("publish");
+        detail::HeaderExtension extension;
+        if (_extendedHeader)
+        {
+            extension.publisher = _identifier;
+            extension.sequence = _sequences[event]++;
+            extension.time = detail::getHeaderTime();
+        }
 #ifdef ZEROEQ_BIGENDIAN
         detail::byteswap(event); // convert to little endian wire protocol
 #endif
         const bool hasPayload = data && size > 0;
 
         zmq_msg_t msgHeader;
-        zmq_msg_init_size(&msgHeader, sizeof(event));
+        zmq_msg_init_size(&msgHeader, _extendedHeader
+                                          ? detail::EXTENDED_HEADER_SIZE
+                                          : detail::EVENT_HEADER_SIZE);
         memcpy(zmq_msg_data(&msgHeader), &event, sizeof(event));
+        if (_extendedHeader)
+        {
+            auto frame = static_cast<uint8_t*>(zmq_msg_data(&msgHeader));
+            detail::writeHeaderExtension(extension, frame);
+        }
         int ret = zmq_msg_send(&msgHeader, socket.get(),
                                hasPayload ? ZMQ_SNDMORE : 0);
         zmq_msg_close(&msgHeader);
@@ -114,6 +156,16 @@ Publisher::~Publisher()
 {
 }
 
+void Publisher::setExtendedHeader(const bool enable)
+{
+    _impl->setExtendedHeader(enable);
+}
+
+const uint128_t& Publisher::getIdentifier() const
+{
+    return _impl->getIdentifier();
+}
+
 bool Publisher::publish(const servus::Serializable& serializable)
 {
     return _impl->publish(serializable);
@@ -116,6 +116,21 @@ public:
     ZEROEQ_API bool publish(const uint128_t& event, const void* data,
                             size_t size);
 
+    /**
+     * Send the publisher identifier, a sequence number and the send time with
+     * each event.
+     *
+     * The extension is appended to the event type, which older subscribers
+     * ignore. Subscribers use it to measure the latency and to count the lost
+     * events of each publisher, see Metrics::Source. Disabled by default.
+     *
+     * @param enable true to send the extended header, false for the event only
+     */
+    ZEROEQ_API void setExtendedHeader(bool enable = true);
+
+    /** @return the random identifier sent in the extended header. */
+    ZEROEQ_API const uint128_t& getIdentifier() const;
+
     /**
      * Get the publisher URI.
      *
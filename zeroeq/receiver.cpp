@@ -8,6 +8,7 @@
 
 #include "receiver.h"
 #include "detail/socket.h"
+#include "detail/trace.h"
 #include "log.h"
 
 #include <algorithm>
@@ -107,7 +108,14 @@ private:
                                        high_resolution_clock::now() - startTime)
                                        .count();
 
-            switch (zmq_poll(sockets.data(), int(sockets.size()), remaining))
+            int result;
+            {
+                ZEROEQ_TRACE("poll");
+                result = zmq_poll(sockets.data(), int(sockets.size()),
+                                  remaining);
+            }
+
+            switch (result)
             {
             case -1: // error
                 ZEROEQTHROW(std::runtime_error(std::string("Poll error: ") +
@@ -142,6 +150,7 @@ private:
 
                     if (socket.revents & ZMQ_POLLIN)
                     {
+                        ZEROEQ_TRACE("dispatch");
                         if ((*i)->process(socket))
                         {
                             haveData = true;
@@ -5,8 +5,10 @@
 
 #include "server.h"
 
+#include "detail/metrics.h"
 #include "detail/receiver.h"
 #include "detail/sender.h"
+#include "detail/trace.h"
 
 #include <zmq.h>
 
@@ -69,9 +71,15 @@ public:
             zmq_msg_recv(&msg, socket.get(), 0);
         }
 
+        detail::EventCounters* counters = _metrics.get(requestID);
+        if (counters)
+            counters->countReceived(payload ? zmq_msg_size(&msg) : 0);
+
         auto i = _handlers.find(requestID);
         if (i == _handlers.cend()) // no handler, return "0"
         {
+            if (counters)
+                counters->countDropped();
             const uint128_t zero;
             _send(&zero, sizeof(zero), 0); // request and reply, no playload
         }
@@ -79,22 +87,23 @@ public:
         {
             try
             {
-                auto reply =
-                    payload ? i->second(zmq_msg_data(&msg), zmq_msg_size(&msg))
-                            : i->second(nullptr, 0);
-                const bool hasReplyData = reply.second.ptr && reply.second.size;
-#ifdef ZEROEQ_BIGENDIAN
-                detail::byteswap(reply.first); // convert to little endian
-#endif
-                if (_send(&reply.first, sizeof(reply.first),
-                          hasReplyData ? ZMQ_SNDMORE : 0) &&
-                    hasReplyData)
+                const auto start = counters ? detail::Clock::now()
+                                            : detail::Clock::time_point();
+                ReplyData reply;
                 {
-                    _send(reply.second.ptr.get(), reply.second.size, 0);
+                    ZEROEQ_TRACE("handler");
+                    reply = payload ? i->second(zmq_msg_data(&msg),
+                                                zmq_msg_size(&msg))
+                                    : i->second(nullptr, 0);
                 }
+                if (counters)
+                    counters->handlerTime.add(detail::Clock::now() - start);
+                _reply(reply);
             }
             catch (...) // handler had exception
             {
+                if (counters)
+                    counters->countDropped();
                 const uint128_t zero;
                 _send(&zero, sizeof(zero), 0); // request and reply, no playload
             }
@@ -106,6 +115,27 @@ public:
     }
 
 private:
+    void _reply(ReplyData& reply)
+    {
+        ZEROEQ_TRACE("reply");
+        detail::EventCounters* counters = _metrics.get(reply.first);
+        const bool hasReplyData = reply.second.ptr && reply.second.size;
+#ifdef ZEROEQ_BIGENDIAN
+        detail::byteswap(reply.first); // convert to little endian
+#endif
+        const bool sent =
+            _send(&reply.first, sizeof(reply.first),
+                  hasReplyData ? ZMQ_SNDMORE : 0) &&
+            (!hasReplyData ||
+             _send(reply.second.ptr.get(), reply.second.size, 0));
+        if (!counters)
+            return;
+        if (sent)
+            counters->countSent(hasReplyData ? reply.second.size : 0);
+        else
+            counters->countDropped();
+    }
+
     bool _send(const void* data, const size_t size, const int flags)
     {
         zmq_msg_t msg;
@@ -143,6 +173,7 @@ private:
     }
 
     std::unordered_map<uint128_t, HandleFunc> _handlers;
+    detail::MetricsCache _metrics;
 };
 
 Server::Server()
@@ -9,9 +9,12 @@
 #include "detail/byteswap.h"
 #include "detail/common.h"
 #include "detail/constants.h"
+#include "detail/header.h"
+#include "detail/metrics.h"
 #include "detail/receiver.h"
 #include "detail/sender.h"
 #include "detail/socket.h"
+#include "detail/trace.h"
 #include "log.h"
 
 #include <servus/serializable.h>
@@ -21,6 +24,7 @@
 #include <cstring>
 #include <map>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace zeroeq
 {
@@ -74,6 +78,9 @@ public:
         return true;
     }
 
+    void setGapFunc(const GapFunc& func) { _gapFunc = func; }
+    uint64_t getLostEvents() const { return _lost; }
+
     bool unsubscribe(const servus::Serializable& serializable)
     {
         return unsubscribe(serializable.getTypeIdentifier());
@@ -85,6 +92,8 @@ public:
             return false;
 
         _unsubscribe(event);
+        for (auto& sequences : _sequences) // events missed from now aren't lost
+            sequences.second.erase(event);
         return true;
     }
 
@@ -99,6 +108,10 @@ public:
 #ifndef ZEROEQ_LITTLEENDIAN
         detail::byteswap(type); // convert from little endian wire
 #endif
+        detail::HeaderExtension extension;
+        const bool extended = detail::readHeaderExtension(
+            static_cast<const uint8_t*>(zmq_msg_data(&msg)),
+            zmq_msg_size(&msg), extension);
         const bool payload = zmq_msg_more(&msg);
         zmq_msg_close(&msg);
 
@@ -108,23 +121,43 @@ public:
             zmq_msg_recv(&msg, socket.socket, 0);
         }
 
+        detail::EventCounters* counters = _metrics.get(type);
         EventFuncMap::const_iterator i = _eventFuncs.find(type);
         if (i == _eventFuncs.cend())
         {
             if (payload)
                 zmq_msg_close(&msg);
+            if (counters)
+                counters->countDropped();
 
             ZEROEQTHROW(std::runtime_error("Got unsubscribed event " +
                                            type.getString()));
         }
 
-        if (payload)
+        if (counters)
+            counters->countReceived(payload ? zmq_msg_size(&msg) : 0);
+        const uint64_t lost = extended ? _receivedExtended(type, extension) : 0;
+        if (lost > 0)
         {
-            i->second(zmq_msg_data(&msg), zmq_msg_size(&msg));
-            zmq_msg_close(&msg);
+            _lost += lost;
+            if (counters)
+                counters->lost.fetch_add(lost, std::memory_order_relaxed);
+            if (_gapFunc)
+                _gapFunc(extension.publisher, type, lost);
+        }
+        const auto start = counters ? detail::Clock::now()
+                                    : detail::Clock::time_point();
+        {
+            ZEROEQ_TRACE("callback");
+            if (payload)
+                i->second(zmq_msg_data(&msg), zmq_msg_size(&msg));
+            else
+                i->second(nullptr, 0);
         }
-        else
-            i->second(nullptr, 0);
+        if (payload)
+            zmq_msg_close(&msg);
+        if (counters)
+            counters->handlerTime.add(detail::Clock::now() - start);
         return true;
     }
 
@@ -166,6 +199,39 @@ private:
     EventFuncMap _eventFuncs;
 
     const uint128_t _selfInstance;
+    detail::MetricsCache _metrics;
+
+    // The next expected sequence number per publisher and event
+    using Sequences = std::unordered_map<uint128_t, uint64_t>;
+    std::unordered_map<uint128_t, Sequences> _sequences;
+
+    GapFunc _gapFunc;
+    uint64_t _lost{0};
+
+    /** @return the number of events missed before the received one */
+    uint64_t _receivedExtended(const uint128_t& type,
+                               const detail::HeaderExtension& extension)
+    {
+        Sequences& sequences = _sequences[extension.publisher];
+        auto i = sequences.find(type);
+        uint64_t lost = 0;
+        if (i == sequences.end()) // first event of the stream
+            i = sequences.emplace(type, extension.sequence).first;
+        else if (extension.sequence > i->second)
+            lost = extension.sequence - i->second;
+        i->second = extension.sequence + 1;
+
+        auto source = _metrics.getSource(extension.publisher);
+        if (!source)
+            return lost;
+
+        const uint64_t now = detail::getHeaderTime();
+        source->received.fetch_add(1, std::memory_order_relaxed);
+        source->lost.fetch_add(lost, std::memory_order_relaxed);
+        // clocks of different hosts may be behind the one of the publisher
+        source->latency.add(now > extension.time ? now - extension.time : 0);
+        return lost;
+    }
 
     void _subscribe(const uint128_t& event)
     {
@@ -261,6 +327,16 @@ bool Subscriber::unsubscribe(const uint128_t& event)
     return _impl->unsubscribe(event);
 }
 
+void Subscriber::setGapFunc(const GapFunc& func)
+{
+    _impl->setGapFunc(func);
+}
+
+uint64_t Subscriber::getLostEvents() const
+{
+    return _impl->getLostEvents();
+}
+
 const std::string& Subscriber::getSession() const
 {
     return _impl->getSession();
@@ -161,6 +161,21 @@ public:
 
     ZEROEQ_API bool unsubscribe(const uint128_t& event);
 
+    /**
+     * Set the function called when events of a publisher were missed.
+     *
+     * Gaps are detected from the sequence numbers which publishers send per
+     * event in the extended header, see Publisher::setExtendedHeader(). The
+     * function is called before the handler of the event following the gap,
+     * e.g. to request the full state instead of applying an update.
+     *
+     * @param func the function to call, or an empty function for none
+     */
+    ZEROEQ_API void setGapFunc(const GapFunc& func);
+
+    /** @return the number of subscribed events missed so far. */
+    ZEROEQ_API uint64_t getLostEvents() const;
+
     /** @return the session name that is used for filtering. */
     ZEROEQ_API const std::string& getSession() const;
 
@@ -44,6 +44,7 @@
 namespace zeroeq
 {
 using servus::uint128_t;
+class Metrics;
 class Monitor;
 class Publisher;
 class Sender;
@@ -58,6 +59,13 @@ using EventFunc = std::function<void()>;
 /** Callback for receival of subscribed event with payload. */
 using EventPayloadFunc = std::function<void(const void*, size_t)>;
 
+/**
+ * Callback for events missed by a Subscriber (publisher identifier, event,
+ * number of missed events).
+ */
+using GapFunc =
+    std::function<void(const uint128_t&, const uint128_t&, uint64_t)>;
+
 /** Callback for the reply of a Client::request() (reply ID, reply data). */
 using ReplyFunc = std::function<void(const uint128_t&, const void*, size_t)>;
 